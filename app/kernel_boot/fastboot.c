@@ -62,6 +62,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <kernel/thread.h>
+#include <platform.h>
 #include <boot.h>
 #include <fastboot.h>
 #include <fastboot_a_b.h>
@@ -85,6 +86,11 @@ static fastboot_usb_state_t
 static thread_t *fastboot_thread;
 static fastboot_thread_status_t thread_state = TERMINATED;
 
+/* power button sampling started by check_enter_fastboot_start() */
+static thread_t *key_poll_thread;
+static bool key_poll_long_press;
+static lk_time_t key_poll_time_ms;
+
 #if defined(IS_T186)
 static bool is_in_ota_progress(void)
 {
@@ -127,7 +133,8 @@ static tegrabl_error_t is_fastboot_gpio_long_pressed(bool *is_long_press)
 			*is_long_press = false;
 			return TEGRABL_NO_ERROR;
 		}
-		tegrabl_mdelay(sampling_delay);
+		/* sleep rather than spin, boot carries on while the button is held */
+		thread_sleep(sampling_delay);
 	}
 
 	pr_info("Power button long press detected\n");
@@ -136,6 +143,55 @@ static tegrabl_error_t is_fastboot_gpio_long_pressed(bool *is_long_press)
 	return TEGRABL_NO_ERROR;
 }
 
+static int fastboot_key_poll(void *arg)
+{
+	lk_time_t start = current_time();
+	tegrabl_error_t ret;
+	(void)arg;
+
+	ret = is_fastboot_gpio_long_pressed(&key_poll_long_press);
+	key_poll_time_ms = current_time() - start;
+
+	return (int)ret;
+}
+
+void check_enter_fastboot_start(void)
+{
+	if (key_poll_thread != NULL) {
+		return;
+	}
+
+	key_poll_long_press = false;
+	key_poll_thread = thread_create("fastboot key", fastboot_key_poll, NULL, DEFAULT_PRIORITY,
+									DEFAULT_STACK_SIZE);
+	if (key_poll_thread == NULL) {
+		/* check_enter_fastboot() samples the button itself */
+		pr_warn("Failed to create fastboot key thread\n");
+		return;
+	}
+	thread_resume(key_poll_thread);
+}
+
+static tegrabl_error_t fastboot_key_poll_join(bool *is_long_press)
+{
+	lk_time_t start = current_time();
+	lk_time_t waited;
+	int ret = 0;
+
+	thread_join(key_poll_thread, &ret, INFINITE_TIME);
+	key_poll_thread = NULL;
+
+	waited = current_time() - start;
+	if (key_poll_time_ms > waited) {
+		pr_info("Power button sampled in background, %u of %u ms overlapped\n",
+				(uint32_t)(key_poll_time_ms - waited), (uint32_t)key_poll_time_ms);
+	}
+
+	*is_long_press = key_poll_long_press;
+
+	return (tegrabl_error_t)ret;
+}
+
 tegrabl_error_t check_enter_fastboot(bool *out)
 {
 	/* This function has to be implemented based on platform requirements */
@@ -168,9 +224,18 @@ tegrabl_error_t check_enter_fastboot(bool *out)
 	}
 
 	/* check fastboot gpio long press */
-	ret = is_fastboot_gpio_long_pressed(out);
+	if (key_poll_thread != NULL) {
+		ret = fastboot_key_poll_join(out);
+	} else {
+		ret = is_fastboot_gpio_long_pressed(out);
+	}
 
 done:
+	/* the early exits still have to reap the sampling thread */
+	if (key_poll_thread != NULL) {
+		bool is_long_press;
+		(void)fastboot_key_poll_join(&is_long_press);
+	}
 	return ret;
 }
 
@@ -80,6 +80,13 @@ fastboot_thread_status_t is_fastboot_running(void);
  */
 tegrabl_error_t check_enter_fastboot(bool *out);
 
+/**
+ * @brief start sampling the fastboot button in a background thread, so that
+ * the long press check overlaps with other boot work. check_enter_fastboot()
+ * then only waits for what is left of the sampling.
+ */
+void check_enter_fastboot_start(void);
+
 /**
  * @brief locks bootloader
  * @return TEGRABL_NO_ERROR if success, specific error if fails
@@ -176,8 +176,26 @@ static status_t kernel_boot(void)
 	/* Init the menu early since fastboot and verified boot both need menu */
 	menu_init();
 
+#if defined(CONFIG_ENABLE_FASTBOOT)
+	/* a long press takes seconds, sample the button while the boot logo loads */
+	check_enter_fastboot_start();
+#endif
+
+#if defined(CONFIG_ENABLE_DISPLAY) && defined(CONFIG_ENABLE_NVBLOB)
+	err = tegrabl_load_bmp_blob("bootlogo");
+	if (err != TEGRABL_NO_ERROR)
+		pr_warn("Loading bmp blob to memory failed\n");
+
+#if defined(IS_T186)
+	tegrabl_profiler_record("Load BMP blob", 0, DETAILED);
+#endif
+#endif
+
 #if defined(CONFIG_ENABLE_FASTBOOT)
 	err = check_enter_fastboot(&is_enter_fastboot);
+#if defined(IS_T186)
+	tegrabl_profiler_record("Fastboot key check", 0, DETAILED);
+#endif
 	if (err) {
 		goto fail;
 	}
@@ -213,16 +231,6 @@ static status_t kernel_boot(void)
 	}
 	tegrabl_profiler_record("menu init", 0, DETAILED);
 
-#endif
-
-#if defined(CONFIG_ENABLE_DISPLAY) && defined(CONFIG_ENABLE_NVBLOB)
-	err = tegrabl_load_bmp_blob("bootlogo");
-	if (err != TEGRABL_NO_ERROR)
-		pr_warn("Loading bmp blob to memory failed\n");
-
-#if defined(IS_T186)
-	tegrabl_profiler_record("Load BMP blob", 0, DETAILED);
-#endif
 #endif
 
 	kernel.bin_type = tegrabl_get_kernel_type();
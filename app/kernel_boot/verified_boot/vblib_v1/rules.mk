@@ -16,7 +16,9 @@ MODULE_DEPS += \
 	../common/lib/external/asn1 \
 	../common/lib/external/mincrypt \
 	../common/lib/external/mbedtls \
-	../t18x/common/soc/t186/pkc_ops
+	../t18x/common/soc/t186/pkc_ops \
+	lib/cksum \
+	lib/workpool
 
 ifneq ($(TARGET_FAMILY), t19x)
 MODULE_DEPS += \
@@ -33,6 +33,11 @@
 #include <libfdt.h>
 #include <nvboot_crypto_param.h>
 #include <verified_boot_ui.h>
+#include <lib/workpool.h>
+#if defined(CONFIG_ENABLE_ETHERNET_BOOT)
+#include <lib/cksum.h>
+#include <net_boot.h>
+#endif
 
 #if defined(IS_T186)
 #include <tegrabl_se.h>
@@ -59,10 +64,26 @@ static status_t hash_payload_authattr(uintptr_t payload, size_t payload_size,
 	struct se_sha_input_params sha_input;
 	struct se_sha_context sha_context;
 #endif
+#if defined(CONFIG_ENABLE_ETHERNET_BOOT)
+	struct sha256_ctx ctx;
+	size_t hashed_size;
+#endif
 
 	if (!payload || !authaddr || !output)
 		return ERR_INVALID_ARGS;
 
+#if defined(CONFIG_ENABLE_ETHERNET_BOOT)
+	/* A net booted image was hashed as it arrived, only finish the hash */
+	if (net_boot_get_sha256_state((void *)payload, payload_size, &ctx,
+								  &hashed_size)) {
+		cksum_sha256_update(&ctx, (void *)(payload + hashed_size),
+							payload_size - hashed_size);
+		cksum_sha256_update(&ctx, (void *)authaddr, auth_size);
+		cksum_sha256_final(&ctx, output);
+		return NO_ERROR;
+	}
+#endif
+
 	size = payload_size + auth_size;
 	buf_payload_auth = malloc(size);
 	if (buf_payload_auth == NULL) {
@@ -70,7 +91,9 @@ static status_t hash_payload_authattr(uintptr_t payload, size_t payload_size,
 		return ERR_NO_MEMORY;
 	}
 
-	memcpy((void *)buf_payload_auth, (const void *)payload, payload_size);
+	/* the payload is the whole kernel image, copy it on all cpus */
+	workpool_memcpy((void *)buf_payload_auth, (const void *)payload,
+					payload_size);
 	memcpy((void *)(buf_payload_auth + payload_size), (const void *)authaddr,
 		   auth_size);
 
@@ -3,8 +3,13 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS += \
-	$(LOCAL_DIR)/string_tests.c \
+	$(LOCAL_DIR)/string_tests.c
+
+# hand written alternatives to compare the libc routines against
+ifeq ($(ARCH),arm)
+MODULE_SRCS += \
 	$(LOCAL_DIR)/mymemcpy.S \
 	$(LOCAL_DIR)/mymemset.S
+endif
 
 include make/module.mk
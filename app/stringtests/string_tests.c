@@ -36,8 +36,73 @@ static uint8_t *dst2;
 #define BUFFER_SIZE (1024*1024)
 #define ITERATIONS 16
 
+/* large enough for the non-temporal path of the arm64 memcpy */
+#define LARGE_BUFFER_SIZE (16*1024*1024)
+#define LARGE_ITERATIONS 4
+
+#define FUZZ_ITERATIONS 100000
+
+/* byte at a time references that the libc routines are checked against */
+static void *ref_memcpy(void *dst, const void *src, size_t len)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	while (len--)
+		*d++ = *s++;
+	return dst;
+}
+
+static void *ref_memmove(void *dst, const void *src, size_t len)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	if (d <= s)
+		return ref_memcpy(dst, src, len);
+	while (len--)
+		d[len] = s[len];
+	return dst;
+}
+
+static void *ref_memset(void *dst, int c, size_t len)
+{
+	uint8_t *d = dst;
+
+	while (len--)
+		*d++ = (uint8_t)c;
+	return dst;
+}
+
+static int ref_memcmp(const void *s1, const void *s2, size_t len)
+{
+	const uint8_t *a = s1;
+	const uint8_t *b = s2;
+
+	for (; len > 0; len--, a++, b++) {
+		if (*a != *b)
+			return *a - *b;
+	}
+	return 0;
+}
+
+static size_t ref_strlen(const char *s)
+{
+	size_t len = 0;
+
+	while (s[len] != '\0')
+		len++;
+	return len;
+}
+
+#if ARCH_arm
 extern void *mymemcpy(void *dst, const void *src, size_t len);
 extern void *mymemset(void *dst, int c, size_t len);
+#else
+/* there are no alternative routines to try out, measure against the references */
+#define mymemcpy ref_memcpy
+#define mymemset ref_memset
+#endif
 
 static void *null_memcpy(void *dst, const void *src, size_t len)
 {
@@ -192,6 +257,185 @@ static void validate_memset(void)
 	}
 }
 
+static int sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+static uint32_t fuzz_rand(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static void validate_memmove(void)
+{
+	size_t srcoff, dstoff, size;
+	const size_t maxsize = 256;
+
+	printf("testing memmove for correctness\n");
+
+	/* overlapping in both directions, within one buffer */
+	for (srcoff = 0; srcoff < 80; srcoff++) {
+		for (dstoff = 0; dstoff < 80; dstoff++) {
+			for (size = 0; size < maxsize; size++) {
+				fillbuf(dst, maxsize * 2, 567);
+				fillbuf(dst2, maxsize * 2, 567);
+
+				memmove(dst + dstoff, dst + srcoff, size);
+				ref_memmove(dst2 + dstoff, dst2 + srcoff, size);
+
+				if (memcmp(dst, dst2, maxsize * 2) != 0) {
+					printf("error! srcoff %zu, dstoff %zu, size %zu\n", srcoff, dstoff, size);
+				}
+			}
+		}
+	}
+}
+
+static void validate_memcmp(void)
+{
+	size_t align1, align2, size, pos;
+	const size_t maxsize = 128;
+	int res, ref;
+
+	printf("testing memcmp for correctness\n");
+
+	for (align1 = 0; align1 < 16; align1++) {
+		for (align2 = 0; align2 < 16; align2++) {
+			for (size = 0; size < maxsize; size++) {
+				fillbuf(src + align1, size, 567);
+				fillbuf(dst + align2, size, 567);
+				if (memcmp(src + align1, dst + align2, size) != 0) {
+					printf("error! equal, align %zu/%zu, size %zu\n", align1, align2, size);
+				}
+
+				/* a difference at every position, both ways round */
+				for (pos = 0; pos < size; pos++) {
+					dst[align2 + pos] ^= 0x80;
+					res = memcmp(src + align1, dst + align2, size);
+					ref = ref_memcmp(src + align1, dst + align2, size);
+					if (sign(res) != sign(ref)) {
+						printf("error! align %zu/%zu, size %zu, pos %zu\n", align1, align2, size, pos);
+					}
+					dst[align2 + pos] ^= 0x80;
+				}
+			}
+		}
+	}
+}
+
+static void validate_strlen(void)
+{
+	size_t align, len;
+	const size_t maxlen = 256;
+
+	printf("testing strlen for correctness\n");
+
+	for (align = 0; align < 16; align++) {
+		for (len = 0; len < maxlen; len++) {
+			ref_memset(src, 0x5a, maxlen * 2);
+			src[align + len] = 0;
+			if (strlen((char *)src + align) != len) {
+				printf("error! align %zu, len %zu\n", align, len);
+			}
+		}
+	}
+}
+
+/* random sizes and offsets in the whole buffer, compared against the references */
+static void validate_fuzz(void)
+{
+	uint32_t seed = 0x12345678;
+	size_t a, b, size, lo, span, j;
+	int c, i;
+	const size_t maxsize = BUFFER_SIZE / 4;
+
+	printf("fuzzing string routines, %d iterations\n", FUZZ_ITERATIONS);
+
+	for (i = 0; i < FUZZ_ITERATIONS; i++) {
+		/* mostly small sizes, where the edge cases are */
+		if (fuzz_rand(&seed) & 1)
+			size = fuzz_rand(&seed) % 300;
+		else
+			size = fuzz_rand(&seed) % maxsize;
+		a = fuzz_rand(&seed) % (BUFFER_SIZE - size);
+		b = fuzz_rand(&seed) % (BUFFER_SIZE - size);
+		c = fuzz_rand(&seed) & 0xff;
+
+		switch (fuzz_rand(&seed) % 4) {
+		case 0:
+			fillbuf(src + a, size, i);
+			memcpy(dst + b, src + a, size);
+			if (ref_memcmp(dst + b, src + a, size) != 0)
+				printf("error! memcpy %zu -> %zu, size %zu\n", a, b, size);
+			break;
+		case 1:
+			/* only the span covering both ranges can change */
+			lo = (a < b) ? a : b;
+			span = ((a > b) ? a : b) + size - lo;
+			ref_memcpy(dst2 + lo, dst + lo, span);
+			memmove(dst + b, dst + a, size);
+			ref_memmove(dst2 + b, dst2 + a, size);
+			if (ref_memcmp(dst + lo, dst2 + lo, span) != 0)
+				printf("error! memmove %zu -> %zu, size %zu\n", a, b, size);
+			break;
+		case 2:
+			memset(dst + b, c, size);
+			for (j = 0; j < size; j++) {
+				if (dst[b + j] != c) {
+					printf("error! memset at %zu, size %zu\n", b, size);
+					break;
+				}
+			}
+			break;
+		default:
+			ref_memcpy(dst + b, src + a, size);
+			if (size != 0)
+				dst[b + (fuzz_rand(&seed) % size)] ^= (c | 1);
+			if (sign(memcmp(src + a, dst + b, size)) != sign(ref_memcmp(src + a, dst + b, size)))
+				printf("error! memcmp %zu/%zu, size %zu\n", a, b, size);
+			break;
+		}
+	}
+}
+
+static void bench_memcpy_large(void)
+{
+	uint8_t *lsrc, *ldst;
+	lk_time_t t0, libc, ref;
+	int i;
+
+	lsrc = memalign(64, LARGE_BUFFER_SIZE);
+	ldst = memalign(64, LARGE_BUFFER_SIZE);
+	if ((lsrc == NULL) || (ldst == NULL)) {
+		printf("not enough memory for %u byte buffers\n", LARGE_BUFFER_SIZE);
+		goto out;
+	}
+
+	printf("large memcpy speed test\n");
+	thread_sleep(200); // let the debug string clear the serial port
+
+	t0 = current_time();
+	for (i = 0; i < LARGE_ITERATIONS; i++)
+		memcpy(ldst, lsrc, LARGE_BUFFER_SIZE);
+	libc = current_time() - t0;
+
+	t0 = current_time();
+	for (i = 0; i < LARGE_ITERATIONS; i++)
+		ref_memcpy(ldst, lsrc, LARGE_BUFFER_SIZE);
+	ref = current_time() - t0;
+
+	printf("   libc memcpy %lu msecs, %llu bytes/sec\n", libc,
+		   (unsigned long long)LARGE_BUFFER_SIZE * LARGE_ITERATIONS * 1000ULL / libc);
+	printf("   byte memcpy %lu msecs, %llu bytes/sec\n", ref,
+		   (unsigned long long)LARGE_BUFFER_SIZE * LARGE_ITERATIONS * 1000ULL / ref);
+
+out:
+	free(lsrc);
+	free(ldst);
+}
+
 #if defined(WITH_LIB_CONSOLE)
 #include <lib/console.h>
 
@@ -218,12 +462,22 @@ usage:
 			validate_memcpy();
 		} else if (!strcmp(argv[2].str, "memset")) {
 			validate_memset();
+		} else if (!strcmp(argv[2].str, "memmove")) {
+			validate_memmove();
+		} else if (!strcmp(argv[2].str, "memcmp")) {
+			validate_memcmp();
+		} else if (!strcmp(argv[2].str, "strlen")) {
+			validate_strlen();
+		} else if (!strcmp(argv[2].str, "fuzz")) {
+			validate_fuzz();
 		}
 	} else if (!strcmp(argv[1].str, "bench")) {
 		if (!strcmp(argv[2].str, "memcpy")) {
 			bench_memcpy();
 		} else if (!strcmp(argv[2].str, "memset")) {
 			bench_memset();
+		} else if (!strcmp(argv[2].str, "memcpy_large")) {
+			bench_memcpy_large();
 		}
 	} else {
 		goto usage;
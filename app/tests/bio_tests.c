@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <app/tests.h>
+#include <kernel/event.h>
+
+#if WITH_LIB_BIO
+#include <lib/bio.h>
+
+#define BIO_TEST_DEV "biotest"
+#define BIO_TEST_BLOCK_SIZE 512
+#define BIO_TEST_BLOCKS 64
+#define BIO_TEST_REQS 16
+
+static event_t gate;
+static int completed[BIO_TEST_REQS];
+static int completed_count;
+
+/* keeps the worker busy with the first request until the rest are queued */
+static void bio_test_hold(bio_request_t *req, void *arg)
+{
+	event_wait(&gate);
+}
+
+static void bio_test_log(bio_request_t *req, void *arg)
+{
+	completed[completed_count++] = (int)(uintptr_t)arg;
+}
+
+#define BIO_TEST_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("bio_tests: %s failed at line %d\n", #cond, __LINE__); \
+			errors++; \
+		} \
+	} while (0)
+
+static int bio_ordering_test(bdev_t *dev, uint8_t *backing)
+{
+	static bio_request_t reqs[BIO_TEST_REQS];
+	static uint8_t data[BIO_TEST_REQS][BIO_TEST_BLOCK_SIZE];
+	bio_request_t hold;
+	uint8_t scratch[BIO_TEST_BLOCK_SIZE];
+	int errors = 0;
+	int i;
+
+	printf("bio ordering and cancellation test\n");
+
+	event_init(&gate, false, 0);
+	completed_count = 0;
+
+	bio_request_init(&hold, BIO_OP_READ, scratch, 0, sizeof(scratch), &bio_test_hold, NULL);
+	BIO_TEST_CHECK(bio_submit(dev, &hold) == NO_ERROR);
+
+	/* every request overwrites block 1, the last one to run wins */
+	for (i = 0; i < BIO_TEST_REQS; i++) {
+		memset(data[i], i + 1, BIO_TEST_BLOCK_SIZE);
+		bio_request_init(&reqs[i], BIO_OP_WRITE, data[i], BIO_TEST_BLOCK_SIZE, BIO_TEST_BLOCK_SIZE,
+		                 &bio_test_log, (void *)(uintptr_t)i);
+		BIO_TEST_CHECK(bio_submit(dev, &reqs[i]) == NO_ERROR);
+	}
+
+	/* queued ones come back cancelled right away, resubmitting or recancelling is refused */
+	BIO_TEST_CHECK(bio_submit(dev, &reqs[0]) == ERR_ALREADY_STARTED);
+	for (i = 1; i < BIO_TEST_REQS; i += 2) {
+		BIO_TEST_CHECK(bio_cancel(&reqs[i]) == NO_ERROR);
+		BIO_TEST_CHECK(bio_wait(&reqs[i], 0) == ERR_CANCELLED);
+		BIO_TEST_CHECK(bio_cancel(&reqs[i]) == ERR_NOT_VALID);
+	}
+
+	event_signal(&gate, true);
+
+	BIO_TEST_CHECK(bio_wait(&hold, INFINITE_TIME) == BIO_TEST_BLOCK_SIZE);
+	for (i = 0; i < BIO_TEST_REQS; i += 2)
+		BIO_TEST_CHECK(bio_wait(&reqs[i], INFINITE_TIME) == BIO_TEST_BLOCK_SIZE);
+
+	/* the survivors ran in submission order and the cancelled ones never ran */
+	BIO_TEST_CHECK(completed_count == BIO_TEST_REQS);
+	int ran = 0;
+	for (i = 0; i < completed_count; i++) {
+		if (completed[i] & 1)
+			continue;
+		BIO_TEST_CHECK(completed[i] == ran * 2);
+		ran++;
+	}
+	BIO_TEST_CHECK(ran == BIO_TEST_REQS / 2);
+	BIO_TEST_CHECK(memcmp(backing + BIO_TEST_BLOCK_SIZE, data[BIO_TEST_REQS - 2], BIO_TEST_BLOCK_SIZE) == 0);
+
+	event_destroy(&gate);
+
+	return errors;
+}
+
+static int bio_readback_test(bdev_t *dev, uint8_t *backing)
+{
+	static bio_request_t reqs[BIO_TEST_REQS];
+	static uint8_t bufs[BIO_TEST_REQS][BIO_TEST_BLOCK_SIZE + 3];
+	int errors = 0;
+	int i;
+
+	printf("bio async readback test\n");
+
+	for (i = 0; i < BIO_TEST_BLOCKS * BIO_TEST_BLOCK_SIZE; i++)
+		backing[i] = (uint8_t)(i * 7 + (i >> 9));
+
+	/* unaligned offsets and lengths go through the device's deblocking read */
+	for (i = 0; i < BIO_TEST_REQS; i++) {
+		off_t offset = (off_t)i * (BIO_TEST_BLOCKS / BIO_TEST_REQS) * BIO_TEST_BLOCK_SIZE + i;
+		bio_request_init(&reqs[i], BIO_OP_READ, bufs[i], offset, sizeof(bufs[i]), NULL, NULL);
+		BIO_TEST_CHECK(bio_submit(dev, &reqs[i]) == NO_ERROR);
+	}
+
+	for (i = 0; i < BIO_TEST_REQS; i++) {
+		BIO_TEST_CHECK(bio_wait(&reqs[i], INFINITE_TIME) == (ssize_t)sizeof(bufs[i]));
+		BIO_TEST_CHECK(memcmp(bufs[i], backing + reqs[i].offset, sizeof(bufs[i])) == 0);
+	}
+
+	/* past the end reads nothing, same as bio_read() */
+	bio_request_init(&reqs[0], BIO_OP_READ, bufs[0], BIO_TEST_BLOCKS * BIO_TEST_BLOCK_SIZE, BIO_TEST_BLOCK_SIZE, NULL, NULL);
+	BIO_TEST_CHECK(bio_submit(dev, &reqs[0]) == NO_ERROR);
+	BIO_TEST_CHECK(bio_wait(&reqs[0], INFINITE_TIME) == 0);
+
+	return errors;
+}
+
+static int bio_vector_test(uint8_t *backing)
+{
+	static uint8_t out[3][700];
+	static uint8_t in[4][530];
+	const off_t sub_start = 8 * BIO_TEST_BLOCK_SIZE;
+	const off_t offset = 100;
+	int errors = 0;
+	uint i;
+
+	printf("bio vectored io test\n");
+
+	/* go through a subdevice so the offset translation is covered too */
+	BIO_TEST_CHECK(bio_publish_subdevice(BIO_TEST_DEV, BIO_TEST_DEV ".sub", 8, 32) == NO_ERROR);
+	bdev_t *sub = bio_open(BIO_TEST_DEV ".sub");
+	if (!sub)
+		return errors + 1;
+
+	/* segment sizes that split blocks between segments */
+	bio_iovec_t wiov[3] = {
+		{ out[0], 412 },
+		{ out[1], 700 },
+		{ out[2], 300 },
+	};
+	for (i = 0; i < sizeof(out); i++)
+		((uint8_t *)out)[i] = (uint8_t)(i * 13 + 5);
+	BIO_TEST_CHECK(bio_writev(sub, wiov, 3, offset) == 412 + 700 + 300);
+	BIO_TEST_CHECK(memcmp(backing + sub_start + offset, out[0], 412) == 0);
+	BIO_TEST_CHECK(memcmp(backing + sub_start + offset + 412, out[1], 700) == 0);
+	BIO_TEST_CHECK(memcmp(backing + sub_start + offset + 412 + 700, out[2], 300) == 0);
+
+	bio_iovec_t riov[4] = {
+		{ in[0], 1 },
+		{ in[1], 0 },
+		{ in[2], 530 },
+		{ in[3], 530 },
+	};
+	memset(in, 0, sizeof(in));
+	BIO_TEST_CHECK(bio_readv(sub, riov, 4, offset + 411) == 1 + 530 + 530);
+	BIO_TEST_CHECK(memcmp(in[0], backing + sub_start + offset + 411, 1) == 0);
+	BIO_TEST_CHECK(memcmp(in[2], backing + sub_start + offset + 412, 530) == 0);
+	BIO_TEST_CHECK(memcmp(in[3], backing + sub_start + offset + 942, 530) == 0);
+
+	/* reads are clipped to the end of the subdevice */
+	BIO_TEST_CHECK(bio_readv(sub, riov, 4, 32 * BIO_TEST_BLOCK_SIZE - 100) == 100);
+
+	bio_unregister_device(sub);
+	bio_close(sub);
+
+	return errors;
+}
+
+int bio_tests(void)
+{
+	int errors = 0;
+	uint8_t *backing = calloc(BIO_TEST_BLOCKS, BIO_TEST_BLOCK_SIZE);
+	if (!backing)
+		return ERR_NO_MEMORY;
+
+	create_membdev(BIO_TEST_DEV, backing, BIO_TEST_BLOCKS * BIO_TEST_BLOCK_SIZE);
+	bdev_t *dev = bio_open(BIO_TEST_DEV);
+	if (!dev) {
+		free(backing);
+		return ERR_NOT_FOUND;
+	}
+
+	errors += bio_ordering_test(dev, backing);
+	errors += bio_readback_test(dev, backing);
+	errors += bio_vector_test(backing);
+
+	bio_unregister_device(dev);
+	bio_close(dev);
+	free(backing);
+
+	printf("bio tests %s\n", errors ? "FAILED" : "passed");
+
+	return errors ? ERR_GENERIC : NO_ERROR;
+}
+
+#endif
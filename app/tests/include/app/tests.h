@@ -30,6 +30,9 @@ void printf_tests(void);
 void clock_tests(void);
 void benchmarks(void);
 int fibo(int argc, const cmd_args *argv);
+int bio_tests(void);
+int workpool_tests(void);
+int smp_tests(void);
 
 #endif
 
@@ -10,6 +10,9 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/printf_tests.c \
 	$(LOCAL_DIR)/clock_tests.c \
 	$(LOCAL_DIR)/benchmarks.c \
+	$(LOCAL_DIR)/bio_tests.c \
+	$(LOCAL_DIR)/workpool_tests.c \
+	$(LOCAL_DIR)/smp_tests.c \
 	$(LOCAL_DIR)/fibo.c
 
 MODULE_COMPILEFLAGS += -Wno-format
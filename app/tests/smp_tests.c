@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <stdio.h>
+#include <app/tests.h>
+#include <arch/mp.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+
+#if WITH_SMP
+
+#define SMP_TEST_YIELDS 100
+#define SMP_TEST_TIMEOUT 1000 /* ms */
+
+struct smp_test_cpu {
+	int cpu;
+	uint wrong_cpu;
+	uint runs;
+};
+
+/* Yields repeatedly and checks that the thread is never picked up by another cpu */
+static int smp_pinned_thread(void *arg)
+{
+	struct smp_test_cpu *c = arg;
+	int i;
+
+	for (i = 0; i < SMP_TEST_YIELDS; i++) {
+		if ((int)arch_curr_cpu_num() != c->cpu)
+			c->wrong_cpu++;
+		c->runs++;
+		thread_yield();
+	}
+
+	return 0;
+}
+
+/* Not on the stack, a thread that misses the join timeout may still write to its slot */
+static struct smp_test_cpu cpus[SMP_MAX_CPUS];
+
+int smp_tests(void)
+{
+	thread_t *threads[SMP_MAX_CPUS];
+	status_t err;
+	int ret = NO_ERROR;
+	int cpu;
+
+	printf("smp: %u of %d cpus online, mask 0x%x\n", mp_num_online_cpus(), SMP_MAX_CPUS,
+		   mp_get_online_mask());
+
+	for (cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+		threads[cpu] = NULL;
+		if (!mp_is_cpu_online(cpu))
+			continue;
+
+		cpus[cpu].cpu = cpu;
+		cpus[cpu].wrong_cpu = 0;
+		cpus[cpu].runs = 0;
+		threads[cpu] = thread_create_on_cpu("smp_test", &smp_pinned_thread, &cpus[cpu],
+											DEFAULT_PRIORITY, DEFAULT_STACK_SIZE, cpu);
+		if (threads[cpu] == NULL) {
+			printf("smp: failed to create the thread for cpu %d\n", cpu);
+			ret = ERR_GENERIC;
+			continue;
+		}
+		thread_resume(threads[cpu]);
+	}
+
+	for (cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+		if (threads[cpu] == NULL)
+			continue;
+
+		err = thread_join(threads[cpu], NULL, SMP_TEST_TIMEOUT);
+		if (err != NO_ERROR) {
+			printf("smp: cpu %d thread did not finish (%d)\n", cpu, err);
+			ret = ERR_GENERIC;
+			continue;
+		}
+
+		printf("smp: cpu %d ran %u times, %u on another cpu\n", cpu, cpus[cpu].runs,
+			   cpus[cpu].wrong_cpu);
+		if (cpus[cpu].runs != SMP_TEST_YIELDS || cpus[cpu].wrong_cpu != 0)
+			ret = ERR_GENERIC;
+	}
+
+	printf("smp: %s\n", (ret == NO_ERROR) ? "PASSED" : "FAILED");
+	return ret;
+}
+
+#endif
@@ -34,6 +34,15 @@ STATIC_COMMAND("thread_tests", "test the scheduler", (console_cmd)&thread_tests)
 STATIC_COMMAND("clock_tests", "test clocks", (console_cmd)&clock_tests)
 STATIC_COMMAND("bench", "miscellaneous benchmarks", (console_cmd)&benchmarks)
 STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
+#if WITH_LIB_BIO
+STATIC_COMMAND("bio_tests", "test async and vectored block io on a memory bdev", (console_cmd)&bio_tests)
+#endif
+#if WITH_LIB_WORKPOOL
+STATIC_COMMAND("workpool_tests", "workpool speedup per cpu count", (console_cmd)&workpool_tests)
+#endif
+#if WITH_SMP
+STATIC_COMMAND("smp_tests", "run a pinned thread on each online cpu", (console_cmd)&smp_tests)
+#endif
 STATIC_COMMAND_END(tests);
 
 #endif
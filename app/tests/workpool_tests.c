@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <app/tests.h>
+#include <platform.h>
+
+#if WITH_LIB_WORKPOOL
+#include <lib/workpool.h>
+
+#define WORKPOOL_BENCH_SIZE (16 * 1024 * 1024)
+#define WORKPOOL_BENCH_GRAIN (64 * 1024)
+#define WORKPOOL_BENCH_CHUNKS (WORKPOOL_BENCH_SIZE / WORKPOOL_BENCH_GRAIN)
+
+struct workpool_bench {
+	uint8_t *src;
+	uint8_t *dst;
+	uint32_t sums[WORKPOOL_BENCH_CHUNKS];
+};
+
+static void bench_copy_range(void *arg, size_t start, size_t end)
+{
+	struct workpool_bench *b = arg;
+
+	memcpy(b->dst + start, b->src + start, end - start);
+}
+
+/* FNV-1a of every chunk, stands in for compute bound work like hashing an image */
+static void bench_hash_range(void *arg, size_t start, size_t end)
+{
+	struct workpool_bench *b = arg;
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		hash ^= b->src[i];
+		hash *= 16777619U;
+	}
+	b->sums[start / WORKPOOL_BENCH_GRAIN] = hash;
+}
+
+static lk_bigtime_t bench_run(struct workpool_bench *b, workpool_range_fn fn, uint width)
+{
+	lk_bigtime_t t = current_time_hires();
+
+	workpool_parallel_for_etc(WORKPOOL_BENCH_SIZE, WORKPOOL_BENCH_GRAIN, fn, b, width);
+
+	return current_time_hires() - t;
+}
+
+static void bench_print(const char *what, lk_bigtime_t base, lk_bigtime_t t)
+{
+	uint speedup = t ? (uint)((base * 100) / t) : 0;
+
+	printf("  %s %llu us (%u.%02ux)", what, t, speedup / 100, speedup % 100);
+}
+
+int workpool_tests(void)
+{
+	static uint32_t ref_sums[WORKPOOL_BENCH_CHUNKS];
+	struct workpool_bench *b;
+	lk_bigtime_t copy_base = 0, hash_base = 0;
+	lk_bigtime_t t;
+	uint workers = workpool_num_workers();
+	int errors = 0;
+	uint width;
+	size_t i;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return ERR_NO_MEMORY;
+	b->src = malloc(WORKPOOL_BENCH_SIZE);
+	b->dst = malloc(WORKPOOL_BENCH_SIZE);
+	if (!b->src || !b->dst) {
+		free(b->dst);
+		free(b->src);
+		free(b);
+		return ERR_NO_MEMORY;
+	}
+
+	for (i = 0; i < WORKPOOL_BENCH_SIZE; i++)
+		b->src[i] = (uint8_t)(i * 7 + (i >> 12));
+
+	printf("workpool benchmark, %u workers, %u KB in %u KB chunks\n", workers,
+		   WORKPOOL_BENCH_SIZE / 1024, WORKPOOL_BENCH_GRAIN / 1024);
+
+	for (width = 1; width <= (workers ? workers : 1); width++) {
+		memset(b->dst, 0, WORKPOOL_BENCH_SIZE);
+		memset(b->sums, 0, sizeof(b->sums));
+
+		printf("%u cpus:", width);
+
+		t = bench_run(b, bench_copy_range, width);
+		if (width == 1)
+			copy_base = t;
+		bench_print("copy", copy_base, t);
+
+		t = bench_run(b, bench_hash_range, width);
+		if (width == 1)
+			hash_base = t;
+		bench_print("hash", hash_base, t);
+		printf("\n");
+
+		/* every width has to produce the same result */
+		if (memcmp(b->dst, b->src, WORKPOOL_BENCH_SIZE) != 0) {
+			printf("workpool_tests: copy mismatch with %u cpus\n", width);
+			errors++;
+		}
+		if (width == 1) {
+			memcpy(ref_sums, b->sums, sizeof(ref_sums));
+		} else if (memcmp(ref_sums, b->sums, sizeof(ref_sums)) != 0) {
+			printf("workpool_tests: hash mismatch with %u cpus\n", width);
+			errors++;
+		}
+	}
+
+	printf("workpool tests %s\n", errors ? "FAILED" : "passed");
+
+	free(b->dst);
+	free(b->src);
+	free(b);
+
+	return errors ? ERR_GENERIC : NO_ERROR;
+}
+
+#endif
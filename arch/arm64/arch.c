@@ -21,18 +21,22 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <debug.h>
+#include <assert.h>
 #include <arch.h>
 #include <arch/ops.h>
 #include <arch/arm64.h>
 #include <platform.h>
 #include <arch/mmu.h>
+#include <arch/mp.h>
+#include <kernel/thread.h>
 
 extern int _end_of_ram;
 void *_heap_end = &_end_of_ram;
 
 void print_cpuid(void);
 
-void arch_early_init(void)
+/* per cpu setup, shared by the boot and the secondary cpus */
+static void arm64_cpu_early_init(void)
 {
     /* set the vector base */
     ARM64_WRITE_TARGET_SYSREG(VBAR_ELx, (uint64_t)&arm64_exception_base);
@@ -49,24 +53,70 @@ void arch_early_init(void)
     }
 #endif
 
+#if ENABLE_CYCLE_COUNTER
+	/* enable all performance counters and count every cycle */
+	uint64_t pmcr = ARM64_READ_SYSREG(pmcr_el0);
+	pmcr &= ~(1UL << 3);
+	pmcr |= 1;
+	ARM64_WRITE_SYSREG(pmcr_el0, pmcr);
+
+	/* enable cycle counter */
+	ARM64_WRITE_SYSREG(pmcntenset_el0, (1UL << 31));
+#endif
+}
+
+void arch_early_init(void)
+{
+    arm64_cpu_early_init();
+
 #if WITH_MMU
+	uint32_t mmu_start = arch_cycle_count();
+
 	arm64_mmu_init();
 
 	platform_init_mmu_mappings();
+
+	arm64_mmu_setup_cycles = arch_cycle_count() - mmu_start;
 #endif
 }
 
 void arch_init(void)
 {
 	print_cpuid();
+#if WITH_MMU
+	dprintf(INFO, "MMU setup: %u cycles\n", arm64_mmu_setup_cycles);
+#endif
 }
 
 void arch_quiesce(void)
 {
+#if WITH_SMP
+    /* the secondaries would otherwise keep running cboot code after the kernel handoff */
+    arm64_mp_stop_secondaries();
+#endif
 }
 
 void arch_idle(void)
 {
+#if WITH_SMP
+    /* wfe also wakes up for interrupts, and for arch_mp_send_event() */
+    __asm__ volatile("wfe");
+    arm64_mp_idle_check_stop();
+#else
     __asm__ volatile("wfi");
+#endif
+}
+
+#if WITH_SMP
+/* called from arm64_secondary_entry with the MMU on and a stack set up */
+void arm64_secondary_main(uint cpu) __NO_RETURN __EXTERNALLY_VISIBLE;
+void arm64_secondary_main(uint cpu)
+{
+    arm64_cpu_early_init();
+
+    ASSERT(cpu == arch_curr_cpu_num());
+
+    thread_secondary_cpu_entry();
 }
+#endif
 
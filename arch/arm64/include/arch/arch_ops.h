@@ -220,6 +220,12 @@ static inline uint32_t arch_cycle_count(void)
         : "=r" (count)
         );
     return count;
+#elif ARM_ISA_ARMV8
+    uint64_t count;
+    __asm__ volatile("mrs %0, pmccntr_el0"
+        : "=r" (count)
+        );
+    return (uint32_t)count;
 #else
 //#warning no arch_cycle_count implementation
     return 0;
@@ -231,5 +237,31 @@ static inline void arch_memory_barrier(void)
 	__asm__ volatile("dmb sy" : : : "memory");
 }
 
+#if WITH_SMP
+/* the running thread is kept in the software thread id register of each cpu */
+struct thread;
+
+static inline struct thread *arch_get_current_thread(void)
+{
+    struct thread *t;
+
+#if ARM64_WITH_EL2
+    __asm__ volatile("mrs %0, tpidr_el2" : "=r" (t));
+#else
+    __asm__ volatile("mrs %0, tpidr_el1" : "=r" (t));
+#endif
+    return t;
+}
+
+static inline void arch_set_current_thread(struct thread *t)
+{
+#if ARM64_WITH_EL2
+    __asm__ volatile("msr tpidr_el2, %0" :: "r" (t) : "memory");
+#else
+    __asm__ volatile("msr tpidr_el1, %0" :: "r" (t) : "memory");
+#endif
+}
+#endif
+
 #endif // ASSEMBLY
 
@@ -126,5 +126,12 @@ extern void arm64_exception_base(void);
 void arm64_el3_to_el2(void);
 void arm64_el3_to_el1(void);
 
+#if WITH_SMP
+/* power off the secondary cpus with PSCI CPU_OFF, returns once they have left the online mask */
+void arm64_mp_stop_secondaries(void);
+/* called from the idle loop of a secondary cpu, powers it off once a stop was requested */
+void arm64_mp_idle_check_stop(void);
+#endif
+
 __END_CDECLS
 
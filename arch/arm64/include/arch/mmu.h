@@ -35,6 +35,21 @@ void arm64_mmu_init(void);
  */
 void arm64_mmu_map(addr_t paddr, addr_t vaddr, addr_t size, uint flags);
 
+/* Batches the arm64_mmu_map() calls made until arm64_mmu_map_commit()
+ *
+ * The descriptors are written right away but the touched translation table
+ * pages are only cleaned, and the TLB only invalidated, once on commit. The
+ * new mappings must not be accessed before the batch is committed. Runs with
+ * interrupts disabled until the commit.
+ */
+void arm64_mmu_map_begin(void);
+
+/* Makes the mappings of the current batch visible */
+void arm64_mmu_map_commit(void);
+
+/* Cycles spent setting up the MMU and the platform mappings during boot */
+extern uint32_t arm64_mmu_setup_cycles;
+
 __END_CDECLS
 
 #endif
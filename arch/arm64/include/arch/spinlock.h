@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <compiler.h>
+
+typedef unsigned long spin_lock_t;
+
+#define SPIN_LOCK_INITIAL_VALUE (0)
+
+static inline void arch_spin_lock_init(spin_lock_t *lock)
+{
+	*lock = SPIN_LOCK_INITIAL_VALUE;
+}
+
+static inline bool arch_spin_lock_held(spin_lock_t *lock)
+{
+	return *(volatile spin_lock_t *)lock != 0;
+}
+
+/* waiters sleep in wfe, the store-release in arch_spin_unlock() wakes them up */
+static inline void arch_spin_lock(spin_lock_t *lock)
+{
+	unsigned long tmp;
+
+	__asm__ volatile(
+		"	sevl\n"
+		"1:	wfe\n"
+		"2:	ldaxr	%0, [%1]\n"
+		"	cbnz	%0, 1b\n"
+		"	stxr	%w0, %2, [%1]\n"
+		"	cbnz	%w0, 2b\n"
+		: "=&r" (tmp)
+		: "r" (lock), "r" (1UL)
+		: "memory");
+}
+
+static inline int arch_spin_trylock(spin_lock_t *lock)
+{
+	unsigned long tmp;
+
+	__asm__ volatile(
+		"	ldaxr	%0, [%1]\n"
+		"	cbnz	%0, 1f\n"
+		"	stxr	%w0, %2, [%1]\n"
+		"1:\n"
+		: "=&r" (tmp)
+		: "r" (lock), "r" (1UL)
+		: "memory");
+
+	return (int)tmp;
+}
+
+static inline void arch_spin_unlock(spin_lock_t *lock)
+{
+	__asm__ volatile("stlr	xzr, [%0]" :: "r" (lock) : "memory");
+}
@@ -12,9 +12,12 @@
 #include <trace.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
 #include <compiler.h>
 #include <sys/types.h>
 #include <kernel/thread.h>
+#include <lk/init.h>
 #include <arch.h>
 #include <arch/mmu.h>
 #include <arch/arm64.h>
@@ -50,6 +53,9 @@
 #define LEVEL3_PAGE_SHIFT 12
 #define FIRST_LEVEL 1
 #define LAST_LEVEL 3
+/* Number of adjacent entries that make up a contiguous-hint run at L2 and L3 */
+#define LEVEL2_CONT_ENTRIES 16
+#define LEVEL3_CONT_ENTRIES 16
 
 #elif PAGE_SIZE == (16 * KB)
 
@@ -60,6 +66,8 @@
 #define LEVEL3_PAGE_SHIFT 14
 #define FIRST_LEVEL 1
 #define LAST_LEVEL 3
+#define LEVEL2_CONT_ENTRIES 32
+#define LEVEL3_CONT_ENTRIES 128
 
 #elif PAGE_SIZE == (64 * KB)
 
@@ -70,6 +78,8 @@
 #define LEVEL3_PAGE_SHIFT 16
 #define FIRST_LEVEL 2
 #define LAST_LEVEL 2
+#define LEVEL2_CONT_ENTRIES 0
+#define LEVEL3_CONT_ENTRIES 32
 
 #else
 #error "Unsupported PAGE_SIZE (only 4KB,16KB or 64KB page sizes are supported)"
@@ -91,17 +101,23 @@ extern int _end;
 static struct {
 	uint64_t size;
 	uint32_t shift;
+	uint32_t cont_entries;	/* 0 if the contiguous hint is not used at this level */
 } tt_level[] = {
-	{ LEVEL0_PAGE_SIZE, LEVEL0_PAGE_SHIFT },
-	{ LEVEL1_PAGE_SIZE, LEVEL1_PAGE_SHIFT },
-	{ LEVEL2_PAGE_SIZE, LEVEL2_PAGE_SHIFT },
-	{ LEVEL3_PAGE_SIZE, LEVEL3_PAGE_SHIFT },
+	{ LEVEL0_PAGE_SIZE, LEVEL0_PAGE_SHIFT, 0 },
+	{ LEVEL1_PAGE_SIZE, LEVEL1_PAGE_SHIFT, 0 },
+	{ LEVEL2_PAGE_SIZE, LEVEL2_PAGE_SHIFT, LEVEL2_CONT_ENTRIES },
+	{ LEVEL3_PAGE_SIZE, LEVEL3_PAGE_SHIFT, LEVEL3_CONT_ENTRIES },
 };
 
-/* The reserved space for the page-tables is NUM_PAGE_TABLE_PAGES * PAGE_SIZE */
+/* The reserved space for the boot page-tables is NUM_PAGE_TABLE_PAGES * PAGE_SIZE.
+ * Once the heap is up, more pages are taken from it TT_POOL_GROW_PAGES at a time, always outside
+ * the critical section the tables are written in. */
 #define NUM_PAGE_TABLE_PAGES		32
+#define TT_POOL_GROW_PAGES			8
+/* Free pages kept in the pool ahead of each map call or batch */
+#define TT_POOL_LOW_WATER			TT_POOL_GROW_PAGES
 
-#if NUM_PAGE_TABLE_PAGES > 64
+#if (NUM_PAGE_TABLE_PAGES > 64) || (TT_POOL_GROW_PAGES > 64)
 #error "Free page bitmap for translation tables is 64bit only"
 #endif
 
@@ -213,26 +229,162 @@ static uint8_t tt_base[PAGE_SIZE * NUM_PAGE_TABLE_PAGES] __ALIGNED(PAGE_SIZE)
 #define SCTLR_C				(0x1UL << 2)
 #define SCTLR_I				(0x1UL << 12)
 
-/* Free pages are marked as 1 */
-static uint64_t free_page_table_bitmap = ((1UL << NUM_PAGE_TABLE_PAGES) - 1);
+/* A run of pages the translation tables are allocated from. The first chunk is
+ * the static tt_base array, the following ones come from the heap and are kept
+ * for reuse once their tables are freed. */
+struct tt_pool_chunk {
+	uint8_t *base;
+	uint32_t num_pages;
+	uint64_t free_bitmap;	/* Free pages are marked as 1 */
+	uint64_t dirty_bitmap;	/* Pages written while a batch is open */
+	struct tt_pool_chunk *next;
+};
+
+static struct tt_pool_chunk tt_boot_chunk;
+static struct tt_pool_chunk *tt_pool = &tt_boot_chunk;
+static bool tt_pool_can_grow;
+
+static struct {
+	uint32_t pages_in_use;
+	uint32_t pages_peak;
+	uint32_t heap_pages;
+	uint32_t coalesced;
+} tt_pool_stats;
+
+/*
+ * While a batch is open (arm64_mmu_map_begin/commit) PTE writes are not cleaned or TLB invalidated
+ * one by one. Instead the TT pages they touch are marked here, cleaned once and followed by a single
+ * TLB invalidate on commit.
+ */
+#ifndef ARM64_MMU_MAP_BATCH
+#define ARM64_MMU_MAP_BATCH		1
+#endif
+static bool mmu_batch_active;
+
+/* Cycles spent in arm64_mmu_init() + platform_init_mmu_mappings(), see arch_early_init() */
+uint32_t arm64_mmu_setup_cycles;
+
+/* Returns the pool chunk the translation table page at addr belongs to */
+static struct tt_pool_chunk *tt_pool_find(const void *addr)
+{
+	struct tt_pool_chunk *chunk;
+	uintptr_t offset;
+
+	for (chunk = tt_pool; chunk != NULL; chunk = chunk->next) {
+		offset = (uintptr_t)addr - (uintptr_t)chunk->base;
+		if (((uintptr_t)addr >= (uintptr_t)chunk->base) &&
+			(offset < ((uintptr_t)chunk->num_pages * PAGE_SIZE)))
+			return chunk;
+	}
+	return NULL;
+}
+
+/* Makes a PTE update visible to the table walker, or defers it to arm64_mmu_map_commit() */
+static void sync_tt_entry(uint64_t *pte)
+{
+	struct tt_pool_chunk *chunk;
+	uint32_t index;
+
+	if (mmu_batch_active) {
+		chunk = tt_pool_find(pte);
+		if (chunk == NULL)
+			panic("%s: PTE %p is not in a TT page\n", __func__, pte);
+		index = (((uint64_t)pte - (uint64_t)chunk->base) >> LEVEL3_PAGE_SHIFT);
+		chunk->dirty_bitmap |= (1ULL << index);
+		return;
+	}
+
+	__asm__ volatile ("dc civac, %0\n" : : "r" (pte));
+}
+
+/* Takes TT_POOL_GROW_PAGES pages from the heap for the pool */
+static struct tt_pool_chunk *tt_pool_alloc_chunk(void)
+{
+	struct tt_pool_chunk *chunk;
+
+	chunk = malloc(sizeof(*chunk));
+	if (chunk == NULL)
+		return NULL;
+
+	/* The heap is mapped write-back cacheable, the same as the table walks */
+	chunk->base = memalign(PAGE_SIZE, TT_POOL_GROW_PAGES * PAGE_SIZE);
+	if (chunk->base == NULL) {
+		free(chunk);
+		return NULL;
+	}
+	chunk->num_pages = TT_POOL_GROW_PAGES;
+	chunk->free_bitmap = (~0ULL >> (64 - TT_POOL_GROW_PAGES));
+	chunk->dirty_bitmap = 0;
+	return chunk;
+}
+
+static uint32_t tt_pool_free_pages(void)
+{
+	struct tt_pool_chunk *chunk;
+	uint32_t count = 0;
+
+	for (chunk = tt_pool; chunk != NULL; chunk = chunk->next)
+		count += __builtin_popcountll(chunk->free_bitmap);
+	return count;
+}
+
+/*
+ * Tops the pool up to TT_POOL_LOW_WATER free pages. The heap takes a mutex, so this must run before
+ * the critical section of arm64_mmu_map() or of a batch is entered; allocate_tt_page() only hands
+ * out pages that are already in the pool.
+ */
+static void tt_pool_refill(void)
+{
+	struct tt_pool_chunk *chunk;
+	bool low;
+
+	if (!tt_pool_can_grow || in_critical_section())
+		return;
+
+	for (;;) {
+		enter_critical_section();
+		low = (tt_pool_free_pages() < TT_POOL_LOW_WATER);
+		exit_critical_section();
+		if (!low)
+			break;
+
+		chunk = tt_pool_alloc_chunk();
+		if (chunk == NULL)
+			break;
+
+		enter_critical_section();
+		chunk->next = tt_pool;
+		tt_pool = chunk;
+		tt_pool_stats.heap_pages += TT_POOL_GROW_PAGES;
+		exit_critical_section();
+
+		LTRACEF("TT pool grown by %u pages at %p\n", TT_POOL_GROW_PAGES, chunk->base);
+	}
+}
 
 /* Allocates a free page for translation tables (TT) */
 static uint64_t *allocate_tt_page(void)
 {
-	static uint64_t *result = NULL;
-	uint32_t i = 0;
-
-	while ((i < (sizeof(free_page_table_bitmap) * 8)) &&
-		   (i < NUM_PAGE_TABLE_PAGES)) {
-		if (free_page_table_bitmap & (1UL << i)) {
-			result = (uint64_t *)tt_base + (i * PTES_PER_PAGE);
-			memset(result, 0, PAGE_SIZE);
-			free_page_table_bitmap &= ~(1UL << i);
+	struct tt_pool_chunk *chunk;
+	uint64_t *result = NULL;
+	uint32_t i;
+
+	for (chunk = tt_pool; chunk != NULL; chunk = chunk->next) {
+		if (chunk->free_bitmap != 0)
 			break;
-		}
-		i++;
 	}
-	LTRACEF("free_page_table_bitmap: 0x%" PRIx64"\n", free_page_table_bitmap);
+
+	if (chunk != NULL) {
+		i = __builtin_ctzll(chunk->free_bitmap);
+		result = (uint64_t *)(chunk->base + (i * PAGE_SIZE));
+		memset(result, 0, PAGE_SIZE);
+		chunk->free_bitmap &= ~(1ULL << i);
+		LTRACEF("free_bitmap: 0x%" PRIx64"\n", chunk->free_bitmap);
+
+		tt_pool_stats.pages_in_use++;
+		if (tt_pool_stats.pages_in_use > tt_pool_stats.pages_peak)
+			tt_pool_stats.pages_peak = tt_pool_stats.pages_in_use;
+	}
 
 	if (result)
 		LTRACEF("next_tt: %p\n", result);
@@ -244,15 +396,92 @@ static uint64_t *allocate_tt_page(void)
 /* Frees up a translation table page */
 static void free_tt_page(uint64_t *tt)
 {
-	uint32_t index = (((uint64_t)tt - (uint64_t)tt_base) >> LEVEL3_PAGE_SHIFT);
+	struct tt_pool_chunk *chunk = tt_pool_find(tt);
+	uint32_t index;
 	LTRACEF("%s() called for tt=0x%p\n", __func__, tt);
 
-	if (((uint64_t)tt & (PAGE_SIZE - 1)) || (index >= NUM_PAGE_TABLE_PAGES)) {
+	if (((uint64_t)tt & (PAGE_SIZE - 1)) || (chunk == NULL)) {
 		panic("invalid tt: %p used in free_tt()\n", tt);
 	}
 
-	free_page_table_bitmap |= (1UL << index);
-	LTRACEF("free_page_table_bitmap: 0x%" PRIx64"\n", free_page_table_bitmap);
+	index = (((uint64_t)tt - (uint64_t)chunk->base) >> LEVEL3_PAGE_SHIFT);
+	chunk->free_bitmap |= (1ULL << index);
+	tt_pool_stats.pages_in_use--;
+	LTRACEF("free_bitmap: 0x%" PRIx64"\n", chunk->free_bitmap);
+}
+
+/* Frees a translation table together with all the tables below it */
+static void free_tt_tree(uint64_t *tt, uint32_t level)
+{
+	uint32_t i;
+
+	if (level < LAST_LEVEL) {
+		for (i = 0; i < PTES_PER_PAGE; i++) {
+			if ((tt[i] & PTE_VALID) && (tt[i] & PTE_TABLE))
+				free_tt_tree((uint64_t *)(tt[i] & PTE_NEXT_LEVEL_TABLE_ADDR_MASK),
+						level + 1);
+		}
+	}
+	free_tt_page(tt);
+}
+
+static void tt_pool_init_heap(uint level)
+{
+	tt_pool_can_grow = true;
+}
+
+LK_INIT_HOOK(arm64_tt_pool, &tt_pool_init_heap, LK_INIT_LEVEL_HEAP);
+
+/* Cleans [first, end) of a table, one operation per cache line */
+static void sync_tt_range(uint64_t *tt, uint32_t first, uint32_t end)
+{
+	uint32_t i;
+
+	for (i = ROUNDDOWN(first, CACHE_LINE / PTE_SIZE); i < end; i += CACHE_LINE / PTE_SIZE)
+		sync_tt_entry(tt + i);
+}
+
+/* Sets the contiguous hint on every aligned run of entries in [first, end).
+ * All the entries in the range must be leaves that map consecutive physical
+ * addresses with the same attributes, which is the case for the entries
+ * written by one arm64_mmu_map_level() call. */
+static void set_contiguous_hint(uint64_t *tt, uint32_t level, uint32_t first,
+		uint32_t end)
+{
+	uint32_t cont = tt_level[level].cont_entries;
+	uint64_t run_size;
+	uint32_t i, j;
+
+	if (cont == 0)
+		return;
+
+	run_size = cont * tt_level[level].size;
+	for (i = ROUNDUP(first, cont); (i + cont) <= end; i += cont) {
+		/* The output address must be aligned to the run size as well */
+		if ((tt[i] & PTE_OUTPUT_ADDR_MASK) & (run_size - 1))
+			continue;
+		for (j = i; j < (i + cont); j++)
+			tt[j] |= PTE_CONTIGUOUS;
+		sync_tt_range(tt, i, i + cont);
+		LTRACEF("(L%d) contiguous run at index %u\n", level, i);
+	}
+}
+
+/* An entry of a contiguous run is about to change, so the run no longer
+ * qualifies for the hint. Clears it from all the entries of the run. */
+static void clear_contiguous_hint(uint64_t *tt, uint32_t level, uint32_t index)
+{
+	uint32_t cont = tt_level[level].cont_entries;
+	uint32_t first;
+	uint32_t j;
+
+	if ((cont == 0) || !(tt[index] & PTE_CONTIGUOUS))
+		return;
+
+	first = ROUNDDOWN(index, cont);
+	for (j = first; j < (first + cont); j++)
+		tt[j] &= ~PTE_CONTIGUOUS;
+	sync_tt_range(tt, first, first + cont);
 }
 
 /* Initializes entire page table of particular level based on
@@ -266,6 +495,7 @@ static void fill_tt(uint64_t *tt, int level, uint64_t template_pte)
 
 	LTRACEF("%s: tt:%p, L%d, template_pte:0x%" PRIx64"\n", __func__,
 			tt, level, template_pte);
+	template_pte &= ~PTE_CONTIGUOUS;
 	for ( i = 0; i < PTES_PER_PAGE; i++) {
 		if (level < 3) {
 			tt[i] = (paddr & PTE_OUTPUT_ADDR_MASK) | \
@@ -280,7 +510,51 @@ static void fill_tt(uint64_t *tt, int level, uint64_t template_pte)
 				level, i, tt[i]);
 		paddr += tt_level[level].size;
 	}
-	tegrabl_arch_clean_dcache_range((addr_t)tt, PAGE_SIZE);
+	/* The split block maps a single range, keep it as TLB friendly as it was */
+	set_contiguous_hint(tt, level, 0, PTES_PER_PAGE);
+	if (mmu_batch_active) {
+		sync_tt_entry(tt);
+	} else {
+		tegrabl_arch_clean_dcache_range((addr_t)tt, PAGE_SIZE);
+	}
+}
+
+/* Replaces the table at tt[index] by a single block descriptor when all of its
+ * entries are leaves that map one aligned, physically contiguous range with the
+ * same attributes, e.g. once a range split by arch_map_uncached() is mapped
+ * cached again. Returns true if the table was freed. */
+static bool coalesce_tt(uint64_t *tt, uint32_t level, uint32_t index)
+{
+	uint64_t *next_tt;
+	uint64_t first_pte, attribs, leaf_type;
+	uint64_t next_size = tt_level[level + 1].size;
+	uint32_t i;
+
+	if ((tt_level[level].size > MAX_MAPPING_ALLOWED) ||
+		((tt[index] & PTE_PAGE) != (PTE_TABLE | PTE_VALID)))
+		return false;
+
+	next_tt = (uint64_t *)(tt[index] & PTE_NEXT_LEVEL_TABLE_ADDR_MASK);
+	first_pte = next_tt[0];
+	leaf_type = ((level + 1) < LAST_LEVEL) ? PTE_SECTION : PTE_PAGE;
+	if (((first_pte & PTE_PAGE) != leaf_type) ||
+		((first_pte & PTE_OUTPUT_ADDR_MASK) & (tt_level[level].size - 1)))
+		return false;
+
+	attribs = first_pte & ~(PTE_OUTPUT_ADDR_MASK | PTE_CONTIGUOUS);
+	for (i = 1; i < PTES_PER_PAGE; i++) {
+		if (((next_tt[i] & ~(PTE_OUTPUT_ADDR_MASK | PTE_CONTIGUOUS)) != attribs) ||
+			((next_tt[i] & PTE_OUTPUT_ADDR_MASK) !=
+			 ((first_pte & PTE_OUTPUT_ADDR_MASK) + (i * next_size))))
+			return false;
+	}
+
+	tt[index] = (first_pte & PTE_OUTPUT_ADDR_MASK) | (attribs & ~PTE_PAGE) | PTE_SECTION;
+	sync_tt_entry(tt + index);
+	free_tt_page(next_tt);
+	tt_pool_stats.coalesced++;
+	LTRACEF("(L%d) coalesced index %u: 0x%016" PRIx64"\n", level, index, tt[index]);
+	return true;
 }
 
 /* Returns the amount of memory actually mapped */
@@ -294,6 +568,7 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 	uint64_t attribs;
 	bool needs_flush;
 	uint64_t old_mem_attrib, new_mem_attrib;
+	int32_t leaf_run_start = -1;
 
 	index = (vaddr >> tt_level[level].shift) & ((1 << PAGE_INDEX_SIZE) - 1);
 
@@ -302,11 +577,17 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 
 	for (; (index < PTES_PER_PAGE) && (size > 0); index++) {
 		LTRACEF("(L%d) index = %u, size:0x%lx\n", level, index, size);
-		/* We cannot create a section mapping for > 1GB and if the vaddr
-		 * is aligned to this level's size. */
+		/* We cannot create a section mapping for > 1GB, and only if both vaddr
+		 * and paddr are aligned to this level's size. */
 		if (((tt_level[level].size > MAX_MAPPING_ALLOWED) ||
 			((vaddr & (tt_level[level].size - 1)) != 0) ||
+			((paddr & (tt_level[level].size - 1)) != 0) ||
 			(size < tt_level[level].size)) && (level < LAST_LEVEL)) {
+			if (leaf_run_start >= 0) {
+				set_contiguous_hint(tt, level, leaf_run_start, index);
+				leaf_run_start = -1;
+			}
+			clear_contiguous_hint(tt, level, index);
 			if (tt[index] & PTE_VALID) {
 				if (tt[index] & PTE_TABLE) {
 					LTRACEF("Using existing next-tt\n");
@@ -320,7 +601,7 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 					fill_tt(next_tt, level+1, tt[index]);
 					tt[index] = (((uint64_t) next_tt & PTE_NEXT_LEVEL_TABLE_ADDR_MASK) |
 							PTE_TABLE | PTE_VALID);
-					asm volatile ("dc civac, %0\n" : : "r" (tt + index));
+					sync_tt_entry(tt + index);
 					LTRACEF("NEW_ENTRY: 0x%016" PRIx64"\n", tt[index]);
 				}
 			} else {
@@ -329,13 +610,16 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 				assert(next_tt != NULL);
 				tt[index] = (((uint64_t)next_tt & PTE_NEXT_LEVEL_TABLE_ADDR_MASK) |
 					PTE_TABLE | PTE_VALID);
-				asm volatile ("dc civac, %0\n" : : "r" (tt + index));
+				sync_tt_entry(tt + index);
 				LTRACEF("NEW_ENTRY: 0x%016" PRIx64"\n", tt[index]);
 			}
 			map_size = (size < tt_level[level].size) ? size :
 					tt_level[level].size;
 			map_size = arm64_mmu_map_level(next_tt, level+1, vaddr, paddr,
 					map_size, flags);
+			/* The table is now a block that can start a contiguous run */
+			if (coalesce_tt(tt, level, index))
+				leaf_run_start = index;
 			vaddr += map_size;
 			paddr += map_size;
 			if (map_size > size)
@@ -345,8 +629,11 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 			total_size += map_size;
 		} else {
 			old_mem_attrib = 0x0;
+			if (leaf_run_start < 0)
+				leaf_run_start = index;
 			/* check if mapping exists */
 			LTRACEF("Creating/Updating page/section\n");
+			clear_contiguous_hint(tt, level, index);
 			if (tt[index] & PTE_VALID) {
 				LTRACEF("Overwriting PTE:0x%08" PRIx64" for VA:%08lx\n",
 						tt[index], vaddr);
@@ -356,7 +643,7 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 					/* Free the sub-table */
 					next_tt = (uint64_t *)(tt[index] &
 							PTE_NEXT_LEVEL_TABLE_ADDR_MASK);
-					free_tt_page(next_tt);
+					free_tt_tree(next_tt, level + 1);
 				}
 			}
 
@@ -407,15 +694,17 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 			else
 				tt[index] = (paddr & PTE_OUTPUT_ADDR_MASK) | attribs |
 					PTE_ACCESS_FLAG  | PTE_SH_OUTER | PTE_PAGE;
-			__asm__ volatile ("dc civac, %0\n" : : "r" (tt + index));
-			/* Invalidate TLB by MVA */
+			sync_tt_entry(tt + index);
+			if (!mmu_batch_active) {
+				/* Invalidate TLB by MVA */
 #if ARM64_WITH_EL2
-			__asm__ volatile ("tlbi vae2, %0\n" : : "r" (paddr >> 12));
+				__asm__ volatile ("tlbi vae2, %0\n" : : "r" (paddr >> 12));
 #else
-			__asm__ volatile ("tlbi vae1, %0\n" : : "r" (paddr >> 12));
+				__asm__ volatile ("tlbi vae1, %0\n" : : "r" (paddr >> 12));
 #endif
-			DSB;
-			ISB;
+				DSB;
+				ISB;
+			}
 
 			LTRACEF("NEW_ENTRY: 0x%016" PRIx64"\n", tt[index]);
 			if (tt_level[level].size > size)
@@ -428,6 +717,9 @@ static addr_t arm64_mmu_map_level(uint64_t *tt, uint32_t level, addr_t vaddr,
 		}
 	}
 
+	if (leaf_run_start >= 0)
+		set_contiguous_hint(tt, level, leaf_run_start, index);
+
 	return total_size;
 }
 
@@ -444,11 +736,49 @@ static void arm64_invalidate_tlb(void)
 
 void arm64_mmu_map(addr_t paddr, addr_t vaddr, addr_t size, uint32_t flags)
 {
+	tt_pool_refill();
 	enter_critical_section();
 	arm64_mmu_map_level((uint64_t *)tt_base, FIRST_LEVEL,
 			vaddr, paddr, size, flags);
+	if (!mmu_batch_active)
+		arm64_invalidate_tlb();
+	exit_critical_section();
+}
+
+void arm64_mmu_map_begin(void)
+{
+#if ARM64_MMU_MAP_BATCH
+	tt_pool_refill();
+	enter_critical_section();
+	assert(!mmu_batch_active);
+	mmu_batch_active = true;
+#endif
+}
+
+void arm64_mmu_map_commit(void)
+{
+#if ARM64_MMU_MAP_BATCH
+	struct tt_pool_chunk *chunk;
+	uint32_t i;
+
+	assert(mmu_batch_active);
+	mmu_batch_active = false;
+
+	for (chunk = tt_pool; chunk != NULL; chunk = chunk->next) {
+		LTRACEF("batch dirty TT pages at %p: 0x%" PRIx64"\n", chunk->base,
+				chunk->dirty_bitmap);
+		for (i = 0; i < chunk->num_pages; i++) {
+			if (chunk->dirty_bitmap & (1ULL << i)) {
+				tegrabl_arch_clean_dcache_range((addr_t)(chunk->base + (i * PAGE_SIZE)),
+						PAGE_SIZE);
+			}
+		}
+		chunk->dirty_bitmap = 0;
+	}
+
 	arm64_invalidate_tlb();
 	exit_critical_section();
+#endif
 }
 
 void arch_map_uncached(addr_t vaddr, addr_t size)
@@ -508,11 +838,14 @@ void arm64_mmu_init(void)
 	dprintf(SPEW, "TCR: 0x%" PRIx64"\n", reg);
 	ARM64_WRITE_TARGET_SYSREG(TCR_ELx, reg);
 
-	LTRACEF("free_page_table_bitmap: 0x%" PRIx64"\n", free_page_table_bitmap);
+	tt_boot_chunk.base = tt_base;
+	tt_boot_chunk.num_pages = NUM_PAGE_TABLE_PAGES;
 	/* Marked the first page as allocated for TT-base */
-	free_page_table_bitmap &= ~1UL;
+	tt_boot_chunk.free_bitmap = (~0ULL >> (64 - NUM_PAGE_TABLE_PAGES)) & ~1ULL;
+	tt_pool_stats.pages_in_use = 1;
+	tt_pool_stats.pages_peak = 1;
 	memset(tt_base, 0, PAGE_SIZE);
-	LTRACEF("free_page_table_bitmap: 0x%" PRIx64"\n", free_page_table_bitmap);
+	LTRACEF("free_bitmap: 0x%" PRIx64"\n", tt_boot_chunk.free_bitmap);
 	dprintf(SPEW, "Translation Table Base: %p\n", tt_base);
 	/* set up the translation table base */
 	ARM64_WRITE_TARGET_SYSREG(TTBR0_ELx, (uint64_t)tt_base);
@@ -558,9 +891,37 @@ void arch_disable_mmu(void)
 
 #include <lib/console.h>
 
+struct mmu_mapping_counts {
+	uint32_t leaves[LAST_LEVEL + 1];
+	uint32_t cont[LAST_LEVEL + 1];
+	uint32_t tables;
+};
+
+static void mmu_count_mappings(uint64_t *tt, uint32_t level,
+		struct mmu_mapping_counts *counts)
+{
+	uint32_t i;
+
+	for (i = 0; i < PTES_PER_PAGE; i++) {
+		if (!(tt[i] & PTE_VALID))
+			continue;
+		if ((level < LAST_LEVEL) && (tt[i] & PTE_TABLE)) {
+			counts->tables++;
+			mmu_count_mappings((uint64_t *)(tt[i] & PTE_NEXT_LEVEL_TABLE_ADDR_MASK),
+					level + 1, counts);
+		} else {
+			counts->leaves[level]++;
+			if (tt[i] & PTE_CONTIGUOUS)
+				counts->cont[level]++;
+		}
+	}
+}
+
 static int mmu_info(int argc, const cmd_args *argv)
 {
 	uint64_t reg;
+	struct mmu_mapping_counts counts;
+	uint32_t level;
 
 	reg =  ARM64_READ_SYSREG(ID_AA64MMFR0_EL1);
 	dprintf(INFO, "ID_AA64MMFR0_EL1: 0x%08" PRIx64"\n", reg);
@@ -583,7 +944,23 @@ static int mmu_info(int argc, const cmd_args *argv)
 	else
 		dprintf(INFO, "disabled)\n");
 
-	dprintf(INFO, "Free-page bitmap for TT: 0x%" PRIx64"\n", free_page_table_bitmap);
+	dprintf(INFO, "Free-page bitmap for TT: 0x%" PRIx64"\n", tt_boot_chunk.free_bitmap);
+	dprintf(INFO, "TT pages: %u in use, %u peak, %u from heap, %u tables coalesced\n",
+			tt_pool_stats.pages_in_use, tt_pool_stats.pages_peak,
+			tt_pool_stats.heap_pages, tt_pool_stats.coalesced);
+
+	dprintf(INFO, "MMU setup: %u cycles\n", arm64_mmu_setup_cycles);
+
+	memset(&counts, 0, sizeof(counts));
+	enter_critical_section();
+	mmu_count_mappings((uint64_t *)tt_base, FIRST_LEVEL, &counts);
+	exit_critical_section();
+	for (level = FIRST_LEVEL; level <= LAST_LEVEL; level++) {
+		dprintf(INFO, "L%u %" PRIu64" KB mappings: %u (contiguous hint: %u)\n",
+				level, tt_level[level].size >> 10, counts.leaves[level],
+				counts.cont[level]);
+	}
+	dprintf(INFO, "Next-level tables: %u\n", counts.tables);
 
 	return 0;
 }
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <assert.h>
+#include <compiler.h>
+#include <sys/types.h>
+#include <arch/ops.h>
+#include <arch/arm64.h>
+#include <arch/defines.h>
+#include <arch/mp.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+#include <tegrabl_cache.h>
+
+#define PSCI_CPU_OFF			0x84000002
+#define PSCI_CPU_ON_AARCH64		0xC4000003
+#define PSCI_SUCCESS			0
+
+/* how long to wait for the secondaries to reach the scheduler */
+#define SECONDARY_BOOT_TIMEOUT	100 /* ms */
+/* how long to wait for the secondaries to power off, they may first have to finish a thread */
+#define SECONDARY_STOP_TIMEOUT	100 /* ms */
+
+#define ARM64_NUM_CPUS			(MAX_CPU_CLUSTERS * MAX_CPUS_PER_CLUSTER)
+
+STATIC_ASSERT(ARM64_NUM_CPUS <= SMP_MAX_CPUS);
+
+/* x0..x6 in, x0..x3 out, see arm64_send_smc() */
+struct arm64_smc_regs {
+	uint64_t x[7];
+};
+
+void arm64_send_smc(struct arm64_smc_regs *regs);
+
+/* translation regime of the boot cpu, picked up by arm64_secondary_entry */
+struct arm64_secondary_mmu {
+	uint64_t mair;
+	uint64_t tcr;
+	uint64_t ttbr0;
+	uint64_t sctlr;
+} arm64_secondary_mmu __ALIGNED(CACHE_LINE);
+
+extern void arm64_secondary_entry(void);
+
+static uint arm64_boot_cpu;
+static volatile bool arm64_secondaries_stop;
+
+uint arch_curr_cpu_num(void)
+{
+	return arm64_get_cpu_idx();
+}
+
+void arch_mp_send_event(void)
+{
+	__asm__ volatile("dsb ishst; sev" ::: "memory");
+}
+
+static uint64_t arm64_cpu_to_mpidr(uint cpu)
+{
+	return ((uint64_t)(cpu / MAX_CPUS_PER_CLUSTER) << 8) | (cpu % MAX_CPUS_PER_CLUSTER);
+}
+
+static int64_t psci_cpu_on(uint64_t mpidr, uint64_t entry, uint64_t context_id)
+{
+	struct arm64_smc_regs regs = {
+		.x = { PSCI_CPU_ON_AARCH64, mpidr, entry, context_id },
+	};
+
+	arm64_send_smc(&regs);
+
+	return (int64_t)regs.x[0];
+}
+
+static int64_t psci_cpu_off(void)
+{
+	struct arm64_smc_regs regs = {
+		.x = { PSCI_CPU_OFF },
+	};
+
+	arm64_send_smc(&regs);
+
+	/* only returns on failure */
+	return (int64_t)regs.x[0];
+}
+
+void arm64_mp_idle_check_stop(void)
+{
+	int64_t ret;
+
+	if (!arm64_secondaries_stop || (arch_curr_cpu_num() == arm64_boot_cpu))
+		return;
+
+	/* PSCI cleans this cpu's caches on the way down, the online mask is coherent memory */
+	arch_disable_ints();
+	mp_set_curr_cpu_online(false);
+	ret = psci_cpu_off();
+
+	/* still running, stay visible so that arm64_mp_stop_secondaries() reports it */
+	mp_set_curr_cpu_online(true);
+	arch_enable_ints();
+	dprintf(CRITICAL, "cpu %u: CPU_OFF failed (%lld)\n", arch_curr_cpu_num(), (long long)ret);
+}
+
+void arm64_mp_stop_secondaries(void)
+{
+	mp_cpu_mask_t boot_mask = 1U << arm64_boot_cpu;
+	lk_time_t start;
+
+	DEBUG_ASSERT(arch_curr_cpu_num() == arm64_boot_cpu);
+
+	arm64_secondaries_stop = true;
+	arch_mp_send_event();
+
+	/* a secondary powers itself off the next time it is idle */
+	start = current_time();
+	while ((mp_get_online_mask() & ~boot_mask) != 0) {
+		if (current_time() - start > SECONDARY_STOP_TIMEOUT) {
+			dprintf(CRITICAL, "cpus 0x%x did not power off\n", mp_get_online_mask() & ~boot_mask);
+			break;
+		}
+		thread_yield();
+	}
+}
+
+void arch_mp_init(void)
+{
+	uint boot_cpu = arch_curr_cpu_num();
+	mp_cpu_mask_t started = 1U << boot_cpu;
+	lk_time_t start;
+	int64_t ret;
+	uint cpu;
+
+	arm64_boot_cpu = boot_cpu;
+	arm64_secondary_mmu.mair = ARM64_READ_TARGET_SYSREG(MAIR_ELx);
+	arm64_secondary_mmu.tcr = ARM64_READ_TARGET_SYSREG(TCR_ELx);
+	arm64_secondary_mmu.ttbr0 = ARM64_READ_TARGET_SYSREG(TTBR0_ELx);
+	arm64_secondary_mmu.sctlr = ARM64_READ_TARGET_SYSREG(SCTLR_ELx);
+
+	/* the secondaries read it with their MMU and caches still off */
+	tegrabl_arch_clean_dcache_range((addr_t)&arm64_secondary_mmu, sizeof(arm64_secondary_mmu));
+
+	/* cboot is identity mapped, so the entry point is also its physical address */
+	for (cpu = 0; cpu < ARM64_NUM_CPUS; cpu++) {
+		if (cpu == boot_cpu)
+			continue;
+
+		ret = psci_cpu_on(arm64_cpu_to_mpidr(cpu), (uint64_t)(uintptr_t)&arm64_secondary_entry, cpu);
+		if (ret != PSCI_SUCCESS) {
+			/* cores that are fused off or absent on this SKU are refused */
+			dprintf(SPEW, "cpu %u: CPU_ON failed (%lld)\n", cpu, (long long)ret);
+			continue;
+		}
+		started |= 1U << cpu;
+	}
+
+	start = current_time();
+	while ((mp_get_online_mask() & started) != started) {
+		if (current_time() - start > SECONDARY_BOOT_TIMEOUT) {
+			dprintf(CRITICAL, "cpus 0x%x started but not online\n", started & ~mp_get_online_mask());
+			break;
+		}
+		thread_yield();
+	}
+}
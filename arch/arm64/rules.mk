@@ -40,6 +40,18 @@ MODULE_SRCS += \
 GLOBAL_DEFINES += \
 	ARCH_DEFAULT_STACK_SIZE=8192
 
+# secondary cpus are brought up with PSCI when a project sets WITH_SMP := 1
+ifeq ($(WITH_SMP),1)
+SMP_MAX_CPUS ?= 8
+
+GLOBAL_DEFINES += \
+	WITH_SMP=1 \
+	SMP_MAX_CPUS=$(SMP_MAX_CPUS)
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/mp.c
+endif
+
 # try to find the toolchain
 ifndef TOOLCHAIN_PREFIX
 TOOLCHAIN_PREFIX := aarch64-elf-
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#ifndef __ARCH_MP_H
+#define __ARCH_MP_H
+
+#include <sys/types.h>
+
+#if WITH_SMP
+
+/* index of the calling cpu, below SMP_MAX_CPUS */
+uint arch_curr_cpu_num(void);
+
+/* power on every secondary cpu, each one ends up in thread_secondary_cpu_entry() */
+void arch_mp_init(void);
+
+/* wake up cpus waiting in arch_idle() so they look at their run queue again */
+void arch_mp_send_event(void);
+
+#else
+
+static inline uint arch_curr_cpu_num(void)
+{
+	return 0;
+}
+
+#endif
+
+#endif
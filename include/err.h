@@ -65,6 +65,7 @@
 #define ERR_THREAD_DETACHED -26
 #define ERR_NOT_CONFIGURED -27
 #define ERR_DEPENDENCY_FAIL -28
+#define ERR_CANCELLED -29
 
 #define GOTO_FAIL_ERROR(expr)										\
 	do {																\
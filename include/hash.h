@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#ifndef __HASH_H
+#define __HASH_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <compiler.h>
+
+/* FNV-1a over at most len chars of a string, for name lookup tables */
+static inline uint32_t hash_strn(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261U;
+
+	while (len-- && *str) {
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static inline uint32_t hash_str(const char *str)
+{
+	return hash_strn(str, (size_t)-1);
+}
+
+/* bucket for str in a table of buckets entries, buckets must be a power of 2 */
+static inline __ALWAYS_INLINE uint hash_str_bucket(const char *str, uint buckets)
+{
+	return hash_str(str) & (buckets - 1);
+}
+
+#endif
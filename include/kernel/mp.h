@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#ifndef __KERNEL_MP_H
+#define __KERNEL_MP_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <arch/mp.h>
+
+#ifndef SMP_MAX_CPUS
+#define SMP_MAX_CPUS 1
+#endif
+
+typedef uint32_t mp_cpu_mask_t;
+
+/* bring up the secondary cpus, the boot cpu is online from the start */
+void mp_init(void);
+
+void mp_set_curr_cpu_online(bool online);
+mp_cpu_mask_t mp_get_online_mask(void);
+uint mp_num_online_cpus(void);
+
+static inline bool mp_is_cpu_online(uint cpu)
+{
+	return cpu < SMP_MAX_CPUS && (mp_get_online_mask() & (1U << cpu));
+}
+
+#endif
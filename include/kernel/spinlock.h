@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#ifndef __KERNEL_SPINLOCK_H
+#define __KERNEL_SPINLOCK_H
+
+#if WITH_SMP
+
+#include <arch/spinlock.h>
+
+/*
+ * Spinlocks only exclude other cpus. They don't touch the interrupt state, so
+ * anything also taken from interrupt context has to be locked with interrupts
+ * disabled. Most code wants enter_critical_section() instead.
+ */
+static inline void spin_lock_init(spin_lock_t *lock)
+{
+	arch_spin_lock_init(lock);
+}
+
+static inline void spin_lock(spin_lock_t *lock)
+{
+	arch_spin_lock(lock);
+}
+
+/* returns 0 if the lock was taken */
+static inline int spin_trylock(spin_lock_t *lock)
+{
+	return arch_spin_trylock(lock);
+}
+
+static inline void spin_unlock(spin_lock_t *lock)
+{
+	arch_spin_unlock(lock);
+}
+
+static inline bool spin_lock_held(spin_lock_t *lock)
+{
+	return arch_spin_lock_held(lock);
+}
+
+#endif
+
+#endif
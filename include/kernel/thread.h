@@ -30,6 +30,8 @@
 #include <arch/ops.h>
 #include <arch/thread.h>
 #include <kernel/wait.h>
+#include <kernel/mp.h>
+#include <kernel/spinlock.h>
 #include <debug.h>
 
 enum thread_state {
@@ -66,6 +68,11 @@ typedef struct thread {
 	int remaining_quantum;
 	unsigned int flags;
 
+	/* cpu the thread is restricted to (the boot cpu by default), -1 if it may run anywhere */
+	int pinned_cpu;
+	/* cpu the thread last ran or was queued on */
+	int curr_cpu;
+
 	/* if blocked, a pointer to the wait queue */
 	struct wait_queue *blocking_wait_queue;
 	status_t wait_queue_block_ret;
@@ -116,6 +123,8 @@ void thread_set_name(const char *name);
 void thread_set_priority(int priority);
 thread_t *thread_create(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size);
 thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine entry, void *arg, int priority, void *stack, size_t stack_size);
+thread_t *thread_create_on_cpu(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size, int cpu);
+status_t thread_set_pinned_cpu(thread_t *t, int cpu);
 status_t thread_resume(thread_t *);
 void thread_exit(int retcode) __NO_RETURN;
 void thread_sleep(lk_time_t delay);
@@ -123,6 +132,11 @@ status_t thread_detach(thread_t *t);
 status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout);
 status_t thread_detach_and_resume(thread_t *t);
 
+#if WITH_SMP
+/* called by the arch code on every secondary cpu once it can run C code */
+void thread_secondary_cpu_entry(void) __NO_RETURN;
+#endif
+
 void dump_thread(thread_t *t);
 void dump_all_threads(void);
 
@@ -134,20 +148,42 @@ void thread_block(void); /* block on something and reschedule */
 /* called on every timer tick for the scheduler to do quantum expiration */
 enum handler_return thread_timer_tick(void);
 
+#if WITH_SMP
+/*
+ * The current thread comes from a per-cpu arch register, and the critical
+ * section count travels with the thread. A thread inside a critical section
+ * holds thread_lock, which serializes the scheduler, wait queues and timers
+ * across cpus; it is handed over along with the cpu on a context switch.
+ */
+static inline thread_t *get_current_thread(void)
+{
+	return arch_get_current_thread();
+}
+
+#define current_thread get_current_thread()
+#define critical_section_count (current_thread->saved_critical_section_count)
+
+extern spin_lock_t thread_lock;
+#else
 /* the current thread */
 extern thread_t *current_thread;
 
-/* the idle thread */
-extern thread_t *idle_thread;
-
 /* critical sections */
 extern int critical_section_count;
+#endif
+
+/* the idle thread of the boot cpu */
+extern thread_t *idle_thread;
 
 static inline __ALWAYS_INLINE void enter_critical_section(void)
 {
 	CF;
-	if (critical_section_count == 0)
+	if (critical_section_count == 0) {
 		arch_disable_ints();
+#if WITH_SMP
+		spin_lock(&thread_lock);
+#endif
+	}
 	critical_section_count++;
 	CF;
 }
@@ -156,8 +192,12 @@ static inline __ALWAYS_INLINE void exit_critical_section(void)
 {
 	CF;
 	critical_section_count--;
-	if (critical_section_count == 0)
+	if (critical_section_count == 0) {
+#if WITH_SMP
+		spin_unlock(&thread_lock);
+#endif
 		arch_enable_ints();
+	}
 	CF;
 }
 
@@ -168,8 +208,22 @@ static inline __ALWAYS_INLINE bool in_critical_section(void)
 }
 
 /* only used by interrupt glue */
+#if WITH_SMP
+static inline void inc_critical_section(void)
+{
+	if (critical_section_count++ == 0)
+		spin_lock(&thread_lock);
+}
+
+static inline void dec_critical_section(void)
+{
+	if (--critical_section_count == 0)
+		spin_unlock(&thread_lock);
+}
+#else
 static inline void inc_critical_section(void) { critical_section_count++; }
 static inline void dec_critical_section(void) { critical_section_count--; }
+#endif
 
 /* thread local storage */
 static inline __ALWAYS_INLINE uint32_t tls_get(uint entry)
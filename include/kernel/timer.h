@@ -23,7 +23,7 @@
 #ifndef __KERNEL_TIMER_H
 #define __KERNEL_TIMER_H
 
-#include <list.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 void timer_init(void);
@@ -35,10 +35,16 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
 	int magic;
-	struct list_node node;
 
-	lk_time_t scheduled_time;
-	lk_time_t periodic_time;
+	/* pairing heap links, prev is the parent for a first child */
+	struct timer *child;
+	struct timer *sibling;
+	struct timer *prev;
+	bool queued;
+
+	/* in us */
+	lk_bigtime_t scheduled_time;
+	lk_bigtime_t periodic_time;
 
 	timer_callback callback;
 	void *arg;
@@ -47,7 +53,10 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
 	.magic = TIMER_MAGIC, \
-	.node = LIST_INITIAL_CLEARED_VALUE, \
+	.child = NULL, \
+	.sibling = NULL, \
+	.prev = NULL, \
+	.queued = false, \
 	.scheduled_time = 0, \
 	.periodic_time = 0, \
 	.callback = NULL, \
@@ -58,11 +67,16 @@ typedef struct timer {
  * - Timer callbacks occur from interrupt context
  * - Timers may be programmed or canceled from interrupt or thread context
  * - Timers may be canceled or reprogrammed from within their callback
- * - Timers currently are dispatched from a 10ms periodic tick
+ * - With PLATFORM_HAS_DYNAMIC_TIMER the hardware timer is programmed one-shot
+ *   for the earliest pending timer and doesn't interrupt otherwise; this is
+ *   exact to the us with PLATFORM_HAS_HIRES_TIMER and to the ms without
+ * - Other platforms dispatch timers from a 10ms periodic tick
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t delay, timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
+void timer_set_oneshot_hires(timer_t *, lk_bigtime_t delay, timer_callback, void *arg);
+void timer_set_periodic_hires(timer_t *, lk_bigtime_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
 #endif
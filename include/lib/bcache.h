@@ -27,14 +27,32 @@
 
 typedef void * bcache_t;
 
+/* bytes of cached data when bcache_create() is given no block count */
+#ifndef BCACHE_DEFAULT_SIZE
+#define BCACHE_DEFAULT_SIZE (2 * 1024 * 1024)
+#endif
+
+// block_count <= 0 sizes the cache to BCACHE_DEFAULT_SIZE bytes, returns NULL on failure
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count);
 void bcache_destroy(bcache_t);
 
 int bcache_read_block(bcache_t, void *, uint block);
 
-// get and put a pointer directly to the block
+// get and put a pointer directly to the block, it is not evicted until the last put
 int bcache_get_block(bcache_t, void **, uint block);
 int bcache_put_block(bcache_t, uint block);
 
+int bcache_mark_block_dirty(bcache_t, uint block);
+int bcache_zero_block(bcache_t, uint block);
+int bcache_flush(bcache_t);
+
+// write dirty blocks back from a thread once dirty_ratio percent of the cache is dirty,
+// and at least every BCACHE_FLUSH_INTERVAL msecs; blocks still pinned are left alone
+int bcache_start_flusher(bcache_t, uint dirty_ratio);
+
+// print the hit/miss/eviction stats of one or all caches
+void bcache_dump(bcache_t, const char *name);
+void bcache_dump_all(void);
+
 #endif
 
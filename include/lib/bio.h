@@ -37,17 +37,101 @@
 #include <sys/types.h>
 #include <list.h>
 #include <kernel/mutex.h>
+#include <kernel/event.h>
 
 typedef long long off_t;
 typedef uint32_t bnum_t;
 
+struct bdev;
+struct bio_queue;
+struct bio_request;
+
+/* one segment of a vectored transfer */
+typedef struct bio_iovec {
+	void *base;
+	size_t len;
+} bio_iovec_t;
+
+/* most segments a single bio_readv()/bio_writev() takes */
+#define BIO_IOV_MAX 16
+
+/* per device io statistics, histogram bucket i counts values in [2^i, 2^(i+1)) */
+#define BIO_STAT_LAT_BUCKETS 24 // microseconds, the last bucket takes everything past ~8s
+#define BIO_STAT_SIZE_BUCKETS 16 // bytes from 512, the last bucket takes 16MB and up
+#define BIO_STAT_QD_BUCKETS 8 // requests in flight, sampled on each bio_submit()
+
+enum {
+	BIO_STAT_READ,
+	BIO_STAT_WRITE,
+	BIO_STAT_ERASE,
+	BIO_STAT_OPS,
+};
+
+struct bio_op_stats {
+	uint32_t count;
+	uint32_t errors;
+	uint64_t bytes;
+	uint64_t total_us;
+	uint32_t max_us;
+	uint32_t latency[BIO_STAT_LAT_BUCKETS];
+	uint32_t size[BIO_STAT_SIZE_BUCKETS];
+};
+
+struct bio_stats {
+	struct bio_op_stats op[BIO_STAT_OPS];
+	uint32_t queue_depth[BIO_STAT_QD_BUCKETS];
+	volatile int inflight;
+};
+
+typedef enum {
+	BIO_OP_READ,
+	BIO_OP_WRITE,
+} bio_op_t;
+
+typedef enum {
+	BIO_REQ_IDLE,
+	BIO_REQ_QUEUED,
+	BIO_REQ_ACTIVE,
+	BIO_REQ_DONE,
+} bio_req_state_t;
+
+/* called once the request is done, from the device's worker thread or the driver's completion path */
+typedef void (*bio_complete_t)(struct bio_request *req, void *arg);
+
+/*
+ * asynchronous request, owned by the caller and untouched by it from
+ * bio_submit() until completion
+ */
+typedef struct bio_request {
+	struct list_node node;
+
+	/* set up by the caller, see bio_request_init() */
+	bio_op_t op;
+	void *buf;
+	off_t offset;
+	size_t len;
+	bio_complete_t callback;
+	void *callback_arg;
+
+	/* owned by bio */
+	struct bdev *dev;
+	volatile bio_req_state_t state;
+	ssize_t result; // bytes transferred or error, valid once done is signaled
+	event_t done;
+} bio_request_t;
+
+/* name lookup buckets for open, must be a power of 2 */
+#define BIO_NAME_HASH_SIZE 32
+
 struct bdev_struct {
 	struct list_node list;
+	struct list_node hash[BIO_NAME_HASH_SIZE];
 	mutex_t lock;
 };
 
 typedef struct bdev {
 	struct list_node node;
+	struct list_node hash_node;
 	volatile int ref;
 	bool published;
 
@@ -65,18 +149,29 @@ typedef struct bdev {
 	lk_time_t total_write_time;
 	ssize_t total_read_size;
 	ssize_t total_write_size;
+	struct bio_stats stats;
 
 	/* driver specific private data */
 	void *priv_data;
 
+	/* request queue and worker thread, created on the first bio_submit() */
+	struct bio_queue *queue;
+
 	/* function pointers */
 	ssize_t (*read)(struct bdev *, void *buf, off_t offset, size_t len);
 	ssize_t (*read_block)(struct bdev *, void *buf, bnum_t block, uint count);
 	ssize_t (*write)(struct bdev *, const void *buf, off_t offset, size_t len);
 	ssize_t (*write_block)(struct bdev *, const void *buf, bnum_t block, uint count);
 	ssize_t (*erase)(struct bdev *, bnum_t block, uint count);
+	ssize_t (*readv)(struct bdev *, const bio_iovec_t *iov, uint iovcnt, off_t offset);
+	ssize_t (*writev)(struct bdev *, const bio_iovec_t *iov, uint iovcnt, off_t offset);
+	/* optional, whole blocks spread over the segments as one scatter-gather transfer */
+	ssize_t (*read_block_sg)(struct bdev *, const bio_iovec_t *iov, uint iovcnt, bnum_t block);
+	ssize_t (*write_block_sg)(struct bdev *, const bio_iovec_t *iov, uint iovcnt, bnum_t block);
 	int (*ioctl)(struct bdev *, int request, void *argp);
 	void (*close)(struct bdev *);
+	/* optional, drivers that can queue natively finish with bio_request_complete() */
+	status_t (*submit)(struct bdev *, bio_request_t *req);
 } bdev_t;
 
 /* user api */
@@ -86,10 +181,24 @@ ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len);
 ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count);
 ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len);
 ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count);
+ssize_t bio_readv(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset);
+ssize_t bio_writev(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset);
 ssize_t bio_erase(bdev_t *dev, bnum_t block, uint count);
 ssize_t bio_erase_all(bdev_t *dev);
 int bio_ioctl(bdev_t *dev, int request, void *argp);
 void bio_list_kpi(void);
+void bio_dump_stats(const char *name, bool kv); // NULL for all devices, kv for key=value lines
+void bio_reset_stats(const char *name);
+
+/* asynchronous api, without a submit hook a device runs its requests one at a time in submission order */
+void bio_request_init(bio_request_t *req, bio_op_t op, void *buf, off_t offset, size_t len,
+                      bio_complete_t callback, void *callback_arg);
+status_t bio_submit(bdev_t *dev, bio_request_t *req);
+status_t bio_cancel(bio_request_t *req);
+ssize_t bio_wait(bio_request_t *req, lk_time_t timeout);
+
+/* for drivers implementing the submit hook */
+void bio_request_complete(bio_request_t *req, ssize_t result);
 
 /* register a block device */
 status_t bio_register_device(bdev_t *dev);
@@ -1,8 +1,26 @@
 #ifndef __CKSUM_H
 #define __CKSUM_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 unsigned long crc32(unsigned long crc, const unsigned char *buf, unsigned int len);
 unsigned long adler32(unsigned long adler, const unsigned char *buf, unsigned int len);
 
+#define SHA256_BLOCK_LEN	64
+#define SHA256_DIGEST_LEN	32
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint64_t count;
+	uint8_t buf[SHA256_BLOCK_LEN];
+};
+
+/* Incremental SHA-256: init once, update with the data in any number of chunks, then final */
+void cksum_sha256_init(struct sha256_ctx *ctx);
+void cksum_sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+void cksum_sha256_final(struct sha256_ctx *ctx, uint8_t *digest);
+void cksum_sha256(const void *data, size_t len, uint8_t *digest);
+
 #endif
 
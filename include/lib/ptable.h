@@ -35,17 +35,20 @@
  */
 #define MAX_PTENTRY_NAME    16
 #define MAX_PTABLE_PARTS    16
+#define PTABLE_HASH_SIZE    16 /* power of 2 */
 
 struct ptentry {
 	char name[MAX_PTENTRY_NAME];
 	unsigned start;
 	unsigned length;
 	unsigned flags;
+	unsigned char hash_next; /* index + 1 of the next entry in the bucket, 0 ends it */
 };
 
 struct ptable {
 	struct ptentry parts[MAX_PTABLE_PARTS];
 	int count;
+	unsigned char hash[PTABLE_HASH_SIZE]; /* index + 1 of the first entry, 0 if empty */
 };
 
 /* tools to populate and query the partition table */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+#ifndef __LIB_WORKPOOL_H
+#define __LIB_WORKPOOL_H
+
+#include <list.h>
+#include <sys/types.h>
+#include <kernel/event.h>
+
+/*
+ * A fixed pool of worker threads, one pinned to each online cpu. Every worker
+ * has its own deque of tasks; a worker that runs out of work steals the
+ * oldest task of the busiest other worker.
+ */
+
+typedef void (*workpool_fn)(void *arg);
+
+enum workpool_task_state {
+	WORKPOOL_TASK_IDLE = 0,
+	WORKPOOL_TASK_QUEUED,
+	WORKPOOL_TASK_RUNNING,
+	WORKPOOL_TASK_DONE,
+};
+
+/* a unit of work, doubling as the future the submitter joins on */
+typedef struct workpool_task {
+	struct list_node node;
+	workpool_fn fn;
+	void *arg;
+	enum workpool_task_state state;
+	int worker;
+	event_t done;
+} workpool_task_t;
+
+void workpool_task_init(workpool_task_t *task, workpool_fn fn, void *arg);
+
+/* queue a task, tasks submitted from a worker go to that worker's own deque */
+status_t workpool_submit(workpool_task_t *task);
+
+/*
+ * Wait for a submitted task to finish. A task no worker has picked up yet is
+ * run by the caller instead, so joining from inside a task can't deadlock.
+ */
+status_t workpool_join(workpool_task_t *task, lk_time_t timeout);
+
+/* number of worker threads, 0 before the pool is started */
+uint workpool_num_workers(void);
+
+typedef void (*workpool_range_fn)(void *arg, size_t start, size_t end);
+
+/*
+ * Call fn on [start, end) chunks of [0, count), at most grain elements at a
+ * time, spread over up to width threads including the caller. A width of 0
+ * uses every worker. Returns once all chunks are done.
+ */
+status_t workpool_parallel_for_etc(size_t count, size_t grain, workpool_range_fn fn, void *arg, uint width);
+
+static inline status_t workpool_parallel_for(size_t count, size_t grain, workpool_range_fn fn, void *arg)
+{
+	return workpool_parallel_for_etc(count, grain, fn, arg, 0);
+}
+
+/* memcpy() of non overlapping buffers, split across the pool when large */
+void workpool_memcpy(void *dst, const void *src, size_t len);
+
+#endif
@@ -31,6 +31,10 @@ status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t interval);
+#if PLATFORM_HAS_HIRES_TIMER
+/* same with the interval in us */
+status_t platform_set_oneshot_timer_hires(platform_timer_callback callback, void *arg, lk_bigtime_t interval);
+#endif
 void     platform_stop_timer(void);
 #endif
 
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <lk/init.h>
+
+static volatile int mp_online_mask;
+
+void mp_set_curr_cpu_online(bool online)
+{
+	uint cpu = arch_curr_cpu_num();
+
+	if (online)
+		atomic_or(&mp_online_mask, 1 << cpu);
+	else
+		atomic_and(&mp_online_mask, ~(1 << cpu));
+}
+
+mp_cpu_mask_t mp_get_online_mask(void)
+{
+	return (mp_cpu_mask_t)mp_online_mask;
+}
+
+uint mp_num_online_cpus(void)
+{
+	return __builtin_popcount(mp_get_online_mask());
+}
+
+void mp_init(void)
+{
+#if WITH_SMP
+	arch_mp_init();
+	dprintf(INFO, "%u of %u cpus online, mask 0x%x\n", mp_num_online_cpus(), SMP_MAX_CPUS,
+			mp_get_online_mask());
+#endif
+}
+
+static void mp_init_hook(uint level)
+{
+	mp_init();
+}
+
+LK_INIT_HOOK(mp, mp_init_hook, LK_INIT_LEVEL_THREADING);
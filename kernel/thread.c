@@ -42,12 +42,14 @@
 #include <assert.h>
 #include <list.h>
 #include <malloc.h>
+#include <stdio.h>
 #include <string.h>
 #include <err.h>
 #include <lib/dpc.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/debug.h>
+#include <kernel/mp.h>
 #include <platform.h>
 #include <target.h>
 #include <lib/heap.h>
@@ -63,20 +65,34 @@ struct thread_stats thread_stats;
 /* global thread list */
 static struct list_node thread_list;
 
+#if WITH_SMP
+/* held by whichever cpu is inside a critical section */
+spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
+
+/* the idle threads of the secondary cpus run on their boot stacks */
+static thread_t secondary_idle_threads[SMP_MAX_CPUS];
+#else
 /* the current thread */
 thread_t *current_thread;
 
 /* the global critical section count */
 int critical_section_count;
+#endif
+
+/* the run queues, one set per cpu */
+struct thread_percpu {
+	struct list_node run_queue[NUM_PRIORITIES];
+	uint32_t run_queue_bitmap;
+	thread_t *curr_thread;
+	thread_t *idle_thread;
+};
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+static struct thread_percpu thread_percpu[SMP_MAX_CPUS];
 
 /* the bootstrap thread (statically allocated) */
 static thread_t bootstrap_thread;
 
-/* the idle thread */
+/* the idle thread of the boot cpu */
 thread_t *idle_thread;
 
 /* local routines */
@@ -84,9 +100,64 @@ static void thread_resched(void);
 static void idle_thread_routine(void) __NO_RETURN;
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-/* preemption timer */
+/* length of a quantum unit, a fresh quantum is 5 of them */
+#define QUANTUM_TICK_MS 10
+
+/* preemption timer, one-shot for the end of the running thread's quantum */
 static timer_t preempt_timer;
+static lk_bigtime_t quantum_deadline;
+#endif
+
+static inline void set_current_thread(thread_t *t)
+{
+#if WITH_SMP
+	arch_set_current_thread(t);
+#else
+	current_thread = t;
 #endif
+}
+
+#if WITH_SMP
+/* an idle cpu is running its idle thread and has nothing else queued */
+static bool cpu_is_idle(uint cpu)
+{
+	struct thread_percpu *c = &thread_percpu[cpu];
+
+	return c->curr_thread == c->idle_thread &&
+		   (c->run_queue_bitmap & ~(1U << IDLE_PRIORITY)) == 0;
+}
+#endif
+
+/* pick the run queue for a thread that is becoming ready */
+static struct thread_percpu *run_queue_target(thread_t *t)
+{
+	uint cpu = arch_curr_cpu_num();
+	uint target = cpu;
+
+#if WITH_SMP
+	if (t->pinned_cpu >= 0) {
+		target = t->pinned_cpu;
+	} else if (t != current_thread && !cpu_is_idle(cpu)) {
+		/* a wakeup goes to an idle cpu if there is one, so it runs alongside us */
+		mp_cpu_mask_t online = mp_get_online_mask();
+		uint i;
+
+		for (i = 0; i < SMP_MAX_CPUS; i++) {
+			if ((online & (1U << i)) && cpu_is_idle(i)) {
+				target = i;
+				break;
+			}
+		}
+	}
+
+	/* the other cpu picks it up once we drop thread_lock */
+	if (target != cpu)
+		arch_mp_send_event();
+#endif
+
+	t->curr_cpu = target;
+	return &thread_percpu[target];
+}
 
 /* run queue manipulation */
 static void insert_in_run_queue_head(thread_t *t)
@@ -98,8 +169,10 @@ static void insert_in_run_queue_head(thread_t *t)
 	ASSERT(in_critical_section());
 #endif
 
-	list_add_head(&run_queue[t->priority], &t->queue_node);
-	run_queue_bitmap |= (1<<t->priority);
+	struct thread_percpu *c = run_queue_target(t);
+
+	list_add_head(&c->run_queue[t->priority], &t->queue_node);
+	c->run_queue_bitmap |= (1<<t->priority);
 }
 
 static void insert_in_run_queue_tail(thread_t *t)
@@ -111,14 +184,89 @@ static void insert_in_run_queue_tail(thread_t *t)
 	ASSERT(in_critical_section());
 #endif
 
-	list_add_tail(&run_queue[t->priority], &t->queue_node);
-	run_queue_bitmap |= (1<<t->priority);
+	struct thread_percpu *c = run_queue_target(t);
+
+	list_add_tail(&c->run_queue[t->priority], &t->queue_node);
+	c->run_queue_bitmap |= (1<<t->priority);
+}
+
+static void remove_from_run_queue(thread_t *t)
+{
+	struct thread_percpu *c = &thread_percpu[t->curr_cpu];
+
+#if THREAD_CHECKS
+	ASSERT(t->state == THREAD_READY);
+	ASSERT(list_in_list(&t->queue_node));
+	ASSERT(in_critical_section());
+#endif
+
+	list_delete(&t->queue_node);
+	if (list_is_empty(&c->run_queue[t->priority]))
+		c->run_queue_bitmap &= ~(1<<t->priority);
 }
 
+#if WITH_SMP
+/*
+ * Take the best unpinned thread of a higher priority than local_priority off
+ * another cpu's run queue. Threads are pinned to the boot cpu by default, so
+ * only the ones that opted in can be taken. A thread queued by a cpu that is still switching
+ * away from it can't be seen here, that cpu holds thread_lock until the
+ * switch is done.
+ */
+static thread_t *steal_ready_thread(uint cpu, int local_priority)
+{
+	mp_cpu_mask_t online = mp_get_online_mask();
+	uint32_t remote = 0;
+	thread_t *t;
+	uint i;
+
+	for (i = 0; i < SMP_MAX_CPUS; i++) {
+		if (i != cpu && (online & (1U << i)))
+			remote |= thread_percpu[i].run_queue_bitmap;
+	}
+	remote &= ~((2U << local_priority) - 1);
+
+	while (remote) {
+		int priority = HIGHEST_PRIORITY - __builtin_clz(remote) - (32 - NUM_PRIORITIES);
+
+		for (i = 0; i < SMP_MAX_CPUS; i++) {
+			struct thread_percpu *c = &thread_percpu[i];
+
+			if (i == cpu || !(online & (1U << i)) || !(c->run_queue_bitmap & (1U << priority)))
+				continue;
+			list_for_every_entry(&c->run_queue[priority], t, thread_t, queue_node) {
+				if (t->pinned_cpu < 0) {
+					remove_from_run_queue(t);
+					return t;
+				}
+			}
+		}
+		remote &= ~(1U << priority);
+	}
+
+	return NULL;
+}
+#endif
+
+#if WITH_SMP
+/*
+ * Only the boot cpu has its interrupt controller and timer set up, and the
+ * drivers expect to run there. Threads stay on it unless they opt in to
+ * migration with thread_create_on_cpu() or thread_set_pinned_cpu().
+ */
+static int boot_cpu;
+#endif
+
 static void init_thread_struct(thread_t *t, const char *name)
 {
 	memset(t, 0, sizeof(thread_t));
 	t->magic = THREAD_MAGIC;
+#if WITH_SMP
+	t->pinned_cpu = boot_cpu;
+#else
+	t->pinned_cpu = -1;
+#endif
+	t->curr_cpu = -1;
 	strlcpy(t->name, name, sizeof(t->name));
 }
 
@@ -210,6 +358,60 @@ thread_t *thread_create(const char *name, thread_start_routine entry, void *arg,
 	return thread_create_etc(NULL, name, entry, arg, priority, NULL, stack_size);
 }
 
+/**
+ * @brief  Create a new thread that only runs on one cpu
+ *
+ * Same as thread_create(), with the thread pinned to @cpu. A @cpu of -1
+ * lets the thread run on, and be stolen by, any cpu. If @cpu isn't online
+ * the thread stays on the boot cpu like any other thread, so callers don't
+ * have to care how many cpus came up.
+ */
+thread_t *thread_create_on_cpu(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size, int cpu)
+{
+	thread_t *t = thread_create(name, entry, arg, priority, stack_size);
+
+	if (t && (cpu < 0 || mp_is_cpu_online(cpu)))
+		t->pinned_cpu = cpu;
+
+	return t;
+}
+
+/**
+ * @brief  Restrict a thread to one cpu
+ *
+ * A ready thread is moved to the run queue of @cpu right away, the calling
+ * thread yields so that it continues over there. A thread running on
+ * another cpu moves the next time it is rescheduled.
+ *
+ * @param t    Thread to pin
+ * @param cpu  cpu to run on, or -1 to let the thread run anywhere
+ *
+ * @return ERR_INVALID_ARGS if @cpu is not online.
+ */
+status_t thread_set_pinned_cpu(thread_t *t, int cpu)
+{
+#if THREAD_CHECKS
+	ASSERT(t->magic == THREAD_MAGIC);
+#endif
+
+	if (cpu >= 0 && !mp_is_cpu_online(cpu))
+		return ERR_INVALID_ARGS;
+
+	enter_critical_section();
+	t->pinned_cpu = cpu;
+	if (cpu >= 0 && t->curr_cpu != cpu) {
+		if (t == current_thread) {
+			thread_yield();
+		} else if (t->state == THREAD_READY) {
+			remove_from_run_queue(t);
+			insert_in_run_queue_tail(t);
+		}
+	}
+	exit_critical_section();
+
+	return NO_ERROR;
+}
+
 /**
  * @brief  Make a suspended thread executable.
  *
@@ -372,9 +574,50 @@ void thread_exit(int retcode)
 
 static void idle_thread_routine(void)
 {
-	for (;;)
+	for (;;) {
 		arch_idle();
+#if WITH_SMP
+		/* woken up because work was queued here, or may be stolen from a busy cpu */
+		thread_yield();
+#endif
+	}
+}
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+static enum handler_return thread_quantum_expired(timer_t *t, lk_time_t now, void *arg)
+{
+	if (current_thread == idle_thread)
+		return INT_NO_RESCHEDULE;
+
+	current_thread->remaining_quantum = 0;
+	return INT_RESCHEDULE;
+}
+
+/*
+ * Tickless preemption: instead of a periodic tick counting the quantum down,
+ * a one-shot timer fires when the running thread has used it up. An idle cpu
+ * takes no timer interrupts at all unless some timer is pending.
+ */
+static void thread_switch_preempt_timer(thread_t *oldthread, thread_t *newthread)
+{
+	lk_bigtime_t now = current_time_hires();
+	lk_bigtime_t left;
+
+	timer_cancel(&preempt_timer);
+
+	/* a thread switched out early keeps what is left of its quantum */
+	if (oldthread != newthread && oldthread != idle_thread && oldthread->remaining_quantum > 0) {
+		left = quantum_deadline > now ? quantum_deadline - now : 0;
+		oldthread->remaining_quantum = (left + QUANTUM_TICK_MS * 1000 - 1) / (QUANTUM_TICK_MS * 1000);
+	}
+
+	if (newthread != idle_thread) {
+		left = (lk_bigtime_t)newthread->remaining_quantum * QUANTUM_TICK_MS * 1000;
+		quantum_deadline = now + left;
+		timer_set_oneshot_hires(&preempt_timer, left, thread_quantum_expired, NULL);
+	}
 }
+#endif
 
 /**
  * @brief  Cause another thread to be executed.
@@ -389,7 +632,9 @@ static void idle_thread_routine(void)
 void thread_resched(void)
 {
 	thread_t *oldthread;
-	thread_t *newthread;
+	thread_t *newthread = NULL;
+	uint cpu = arch_curr_cpu_num();
+	struct thread_percpu *c = &thread_percpu[cpu];
 
 //	printf("thread_resched: current %p: ", current_thread);
 //	dump_thread(current_thread);
@@ -407,16 +652,22 @@ void thread_resched(void)
 
 	// should at least find the idle thread
 #if THREAD_CHECKS
-	ASSERT(run_queue_bitmap != 0);
+	ASSERT(c->run_queue_bitmap != 0);
 #endif
 
-	int next_queue = HIGHEST_PRIORITY - __builtin_clz(run_queue_bitmap) - (32 - NUM_PRIORITIES);
-	//dprintf(SPEW, "bitmap 0x%x, next %d\n", run_queue_bitmap, next_queue);
+	int next_queue = HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) - (32 - NUM_PRIORITIES);
+	//dprintf(SPEW, "bitmap 0x%x, next %d\n", c->run_queue_bitmap, next_queue);
 
-	newthread = list_remove_head_type(&run_queue[next_queue], thread_t, queue_node);
+#if WITH_SMP
+	/* migrate a more important thread over if another cpu is too busy to run it */
+	newthread = steal_ready_thread(cpu, next_queue);
+#endif
+	if (!newthread) {
+		newthread = list_remove_head_type(&c->run_queue[next_queue], thread_t, queue_node);
 
-	if (list_is_empty(&run_queue[next_queue]))
-		run_queue_bitmap &= ~(1<<next_queue);
+		if (list_is_empty(&c->run_queue[next_queue]))
+			c->run_queue_bitmap &= ~(1<<next_queue);
+	}
 
 #if THREAD_CHECKS
 	ASSERT(newthread);
@@ -426,9 +677,18 @@ void thread_resched(void)
 //	dump_thread(newthread);
 
 	newthread->state = THREAD_RUNNING;
+	newthread->curr_cpu = cpu;
 
-	if (newthread == oldthread)
+	if (newthread == oldthread) {
+#if PLATFORM_HAS_DYNAMIC_TIMER
+		/* the quantum ran out with nobody else to run, start another one */
+		if (cpu == 0 && newthread != idle_thread && newthread->remaining_quantum <= 0) {
+			newthread->remaining_quantum = 5;
+			thread_switch_preempt_timer(oldthread, newthread);
+		}
+#endif
 		return;
+	}
 
 	/* set up quantum for the new thread if it was consumed */
 	if (newthread->remaining_quantum <= 0) {
@@ -455,23 +715,23 @@ void thread_resched(void)
 #endif
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	/* if we're switching from idle to a real thread, set up a periodic
-	 * timer to run our preemption tick.
-	 */
-	if (oldthread == idle_thread) {
-		timer_set_periodic(&preempt_timer, 10, (timer_callback)thread_timer_tick, NULL);
-	} else if (newthread == idle_thread) {
-		timer_cancel(&preempt_timer);
-	}
+	/* the timer interrupt only reaches the boot cpu */
+	if (cpu == 0)
+		thread_switch_preempt_timer(oldthread, newthread);
 #endif
 
 	/* set some optional target debug leds */
 	target_set_debug_led(0, newthread != idle_thread);
 
-	/* do the switch */
+	/* do the switch, with SMP thread_lock stays held and is dropped by newthread */
+	c->curr_thread = newthread;
+#if WITH_SMP
+	set_current_thread(newthread);
+#else
 	oldthread->saved_critical_section_count = critical_section_count;
-	current_thread = newthread;
+	set_current_thread(newthread);
 	critical_section_count = newthread->saved_critical_section_count;
+#endif
 	arch_context_switch(oldthread, newthread);
 }
 
@@ -634,11 +894,17 @@ void thread_sleep(lk_time_t delay)
  */
 void thread_init_early(void)
 {
-	int i;
+	uint cpu = arch_curr_cpu_num();
+	int i, j;
+
+#if WITH_SMP
+	boot_cpu = cpu;
+#endif
 
 	/* initialize the run queues */
-	for (i=0; i < NUM_PRIORITIES; i++)
-		list_initialize(&run_queue[i]);
+	for (j=0; j < SMP_MAX_CPUS; j++)
+		for (i=0; i < NUM_PRIORITIES; i++)
+			list_initialize(&thread_percpu[j].run_queue[i]);
 
 	/* initialize the thread list */
 	list_initialize(&thread_list);
@@ -652,9 +918,18 @@ void thread_init_early(void)
 	t->state = THREAD_RUNNING;
 	t->saved_critical_section_count = 1;
 	t->flags = THREAD_FLAG_DETACHED;
+	t->curr_cpu = cpu;
 	wait_queue_init(&t->retcode_wait_queue);
 	list_add_head(&thread_list, &t->thread_list_node);
-	current_thread = t;
+	set_current_thread(t);
+	thread_percpu[cpu].curr_thread = t;
+
+#if WITH_SMP
+	/* the count of 1 above is the boot critical section, which owns thread_lock */
+	spin_lock(&thread_lock);
+#endif
+
+	mp_set_curr_cpu_online(true);
 }
 
 /**
@@ -704,6 +979,12 @@ void thread_become_idle(void)
 	thread_set_priority(IDLE_PRIORITY);
 	idle_thread = current_thread;
 
+	/* the idle thread never leaves its cpu */
+	enter_critical_section();
+	current_thread->pinned_cpu = current_thread->curr_cpu;
+	thread_percpu[current_thread->curr_cpu].idle_thread = current_thread;
+	exit_critical_section();
+
 	/* release the implicit boot critical section and yield to the scheduler */
 	exit_critical_section();
 	thread_yield();
@@ -711,6 +992,46 @@ void thread_become_idle(void)
 	idle_thread_routine();
 }
 
+#if WITH_SMP
+/**
+ * @brief  Turn the boot stack of a secondary cpu into its idle thread
+ *
+ * Called by the arch code with interrupts disabled and the MMU on. This
+ * function does not return.
+ */
+void thread_secondary_cpu_entry(void)
+{
+	uint cpu = arch_curr_cpu_num();
+	thread_t *t = &secondary_idle_threads[cpu];
+	char name[sizeof(t->name)];
+
+	snprintf(name, sizeof(name), "idle %u", cpu);
+	init_thread_struct(t, name);
+
+	/* half construct this thread, like the bootstrap thread */
+	t->priority = IDLE_PRIORITY;
+	t->state = THREAD_RUNNING;
+	t->flags = THREAD_FLAG_DETACHED;
+	t->pinned_cpu = cpu;
+	t->curr_cpu = cpu;
+	wait_queue_init(&t->retcode_wait_queue);
+	set_current_thread(t);
+
+	enter_critical_section();
+	list_add_head(&thread_list, &t->thread_list_node);
+	thread_percpu[cpu].curr_thread = t;
+	thread_percpu[cpu].idle_thread = t;
+	mp_set_curr_cpu_online(true);
+	exit_critical_section();
+
+	dprintf(SPEW, "cpu %u online\n", cpu);
+
+	thread_yield();
+
+	idle_thread_routine();
+}
+#endif
+
 static const char *thread_state_to_str(enum thread_state state)
 {
 	switch (state) {
@@ -734,6 +1055,9 @@ void dump_thread(thread_t *t)
 				  thread_state_to_str(t->state), t->priority, t->remaining_quantum,
 				  t->saved_critical_section_count);
 	dprintf(INFO, "\tstack %p, stack_size %zd\n", t->stack, t->stack_size);
+#if WITH_SMP
+	dprintf(INFO, "\tcpu %d, pinned cpu %d\n", t->curr_cpu, t->pinned_cpu);
+#endif
 	dprintf(INFO, "\tentry %p, arg %p, flags 0x%x\n", t->entry, t->arg, t->flags);
 	dprintf(INFO, "\twait queue %p, wait queue ret %d\n", t->blocking_wait_queue, t->wait_queue_block_ret);
 	dprintf(INFO, "\ttls:");
@@ -37,7 +37,6 @@
 #include <debug.h>
 #include <trace.h>
 #include <assert.h>
-#include <list.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/debug.h>
@@ -46,7 +45,12 @@
 
 #define LOCAL_TRACE 0
 
-static struct list_node timer_queue;
+/*
+ * Pending timers are kept in a pairing heap ordered by scheduled time. The
+ * links live in the timer itself, so queueing never allocates, inserting is
+ * O(1) and removing the head or any other timer is O(log n) amortized.
+ */
+static timer_t *timer_heap;
 
 static enum handler_return timer_tick(void *arg, lk_time_t now);
 
@@ -58,52 +62,154 @@ void timer_initialize(timer_t *timer)
 	*timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
+/* make the later of two detached heaps the first child of the earlier one */
+static timer_t *timer_heap_meld(timer_t *a, timer_t *b)
+{
+	timer_t *tmp;
+
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (b->scheduled_time < a->scheduled_time) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	b->prev = a;
+	b->sibling = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	a->prev = NULL;
+	a->sibling = NULL;
+
+	return a;
+}
+
+/* the usual two pass pairing of a list of siblings into a single heap */
+static timer_t *timer_heap_merge_pairs(timer_t *first)
+{
+	timer_t *pairs = NULL;
+	timer_t *heap = NULL;
+	timer_t *a, *b, *next;
+
+	/* meld them two by two from the left, stacking the results */
+	while (first) {
+		a = first;
+		b = a->sibling;
+		next = b ? b->sibling : NULL;
+
+		a->prev = a->sibling = NULL;
+		if (b)
+			b->prev = b->sibling = NULL;
+
+		a = timer_heap_meld(a, b);
+		a->sibling = pairs;
+		pairs = a;
+
+		first = next;
+	}
+
+	/* then fold the stack, i.e. from the right */
+	while (pairs) {
+		next = pairs->sibling;
+		pairs->sibling = NULL;
+		heap = timer_heap_meld(heap, pairs);
+		pairs = next;
+	}
+
+	return heap;
+}
+
 static void insert_timer_in_queue(timer_t *timer)
 {
-	timer_t *entry;
+	LTRACEF("timer %p, scheduled %llu, periodic %llu\n", timer, timer->scheduled_time, timer->periodic_time);
 
-	LTRACEF("timer %p, scheduled %lu, periodic %lu\n", timer, timer->scheduled_time, timer->periodic_time);
+	timer->child = timer->sibling = timer->prev = NULL;
+	timer_heap = timer_heap_meld(timer_heap, timer);
+	timer->queued = true;
+}
 
-	list_for_every_entry(&timer_queue, entry, timer_t, node) {
-		if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-			list_add_before(&entry->node, &timer->node);
-			return;
-		}
+static void remove_timer_from_queue(timer_t *timer)
+{
+	timer_t *children = timer->child;
+
+	if (timer == timer_heap) {
+		timer_heap = timer_heap_merge_pairs(children);
+	} else {
+		/* prev is the parent if we are its first child, the left sibling otherwise */
+		if (timer->prev->child == timer)
+			timer->prev->child = timer->sibling;
+		else
+			timer->prev->sibling = timer->sibling;
+		if (timer->sibling)
+			timer->sibling->prev = timer->prev;
+
+		timer_heap = timer_heap_meld(timer_heap, timer_heap_merge_pairs(children));
+	}
+
+	timer->child = timer->sibling = timer->prev = NULL;
+	timer->queued = false;
+}
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* program the hardware for the head of the queue, called in a critical section */
+static void timer_program(lk_bigtime_t now)
+{
+	lk_bigtime_t delay;
+
+	if (!timer_heap) {
+		LTRACEF("clearing old hw timer, nothing in the queue\n");
+		platform_stop_timer();
+		return;
 	}
 
-	/* walked off the end of the list */
-	list_add_tail(&timer_queue, &timer->node);
+	if (timer_heap->scheduled_time > now)
+		delay = timer_heap->scheduled_time - now;
+	else
+		delay = 0;
+
+	LTRACEF("setting new timer for %llu usecs for event %p\n", delay, timer_heap);
+#if PLATFORM_HAS_HIRES_TIMER
+	platform_set_oneshot_timer_hires(timer_tick, NULL, delay);
+#else
+	platform_set_oneshot_timer(timer_tick, NULL, (lk_time_t)((delay + 999) / 1000));
+#endif
 }
+#endif
 
-static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_callback callback, void *arg)
+static void timer_set(timer_t *timer, lk_bigtime_t delay, lk_bigtime_t period, timer_callback callback, void *arg)
 {
-	lk_time_t now;
+	lk_bigtime_t now;
 
-	LTRACEF("timer %p, delay %lu, period %lu, callback %p, arg %p, now %lu\n", timer, delay, period, callback, arg, now);
+	LTRACEF("timer %p, delay %llu, period %llu, callback %p, arg %p\n", timer, delay, period, callback, arg);
 
 	DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-	if (list_in_list(&timer->node)) {
+	if (timer->queued) {
 		panic("timer %p already in list\n", timer);
 	}
 
-	now = current_time();
+	now = current_time_hires();
 	timer->scheduled_time = now + delay;
 	timer->periodic_time = period;
 	timer->callback = callback;
 	timer->arg = arg;
 
-	LTRACEF("scheduled time %lu\n", timer->scheduled_time);
+	LTRACEF("scheduled time %llu\n", timer->scheduled_time);
 
 	enter_critical_section();
 
 	insert_timer_in_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	if (list_peek_head_type(&timer_queue, timer_t, node) == timer) {
+	if (timer_heap == timer) {
 		/* we just modified the head of the timer queue */
-		LTRACEF("setting new timer for %u msecs\n", (uint)delay);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
+		timer_program(now);
 	}
 #endif
 
@@ -125,6 +231,19 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
  *   enum handler_return callback(struct timer *, lk_time_t now, void *arg) { ... }
  */
 void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback, void *arg)
+{
+	if (delay == 0)
+		delay = 1;
+	timer_set(timer, delay * 1000ULL, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, with a delay in us
+ *
+ * Same as timer_set_oneshot(). How close to the delay the callback runs
+ * depends on the platform timer, see the rules in kernel/timer.h.
+ */
+void timer_set_oneshot_hires(timer_t *timer, lk_bigtime_t delay, timer_callback callback, void *arg)
 {
 	if (delay == 0)
 		delay = 1;
@@ -146,6 +265,16 @@ void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback,
  *   enum handler_return callback(struct timer *, lk_time_t now, void *arg) { ... }
  */
 void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callback, void *arg)
+{
+	if (period == 0)
+		period = 1;
+	timer_set(timer, period * 1000ULL, period * 1000ULL, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes repeatedly, with a period in us
+ */
+void timer_set_periodic_hires(timer_t *timer, lk_bigtime_t period, timer_callback callback, void *arg)
 {
 	if (period == 0)
 		period = 1;
@@ -162,11 +291,11 @@ void timer_cancel(timer_t *timer)
 	enter_critical_section();
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	timer_t *oldhead = list_peek_head_type(&timer_queue, timer_t, node);
+	timer_t *oldhead = timer_heap;
 #endif
 
-	if (list_in_list(&timer->node))
-		list_delete(&timer->node);
+	if (timer->queued)
+		remove_timer_from_queue(timer);
 
 	/* to keep it from being reinserted into the queue if called from
 	 * periodic timer callback.
@@ -177,22 +306,8 @@ void timer_cancel(timer_t *timer)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
 	/* see if we've just modified the head of the timer queue */
-	timer_t *newhead = list_peek_head_type(&timer_queue, timer_t, node);
-	if (newhead == NULL) {
-		LTRACEF("clearing old hw timer, nothing in the queue\n");
-		platform_stop_timer();
-	} else if (newhead != oldhead) {
-		lk_time_t delay;
-		lk_time_t now = current_time();
-
-		if (TIME_LT(newhead->scheduled_time, now))
-			delay = 0;
-		else
-			delay = newhead->scheduled_time - now;
-
-		LTRACEF("setting new timer to %u\n", (uint) delay);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
-	}
+	if (timer_heap != oldhead)
+		timer_program(current_time_hires());
 #endif
 
 	exit_critical_section();
@@ -202,6 +317,7 @@ void timer_cancel(timer_t *timer)
 static enum handler_return timer_tick(void *arg, lk_time_t now)
 {
 	timer_t *timer;
+	lk_bigtime_t now_hires = current_time_hires();
 	enum handler_return ret = INT_NO_RESCHEDULE;
 
 	THREAD_STATS_INC(timer_ints);
@@ -211,19 +327,19 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 	for (;;) {
 		/* see if there's an event to process */
-		timer = list_peek_head_type(&timer_queue, timer_t, node);
+		timer = timer_heap;
 		if (likely(timer == 0))
 			break;
-		LTRACEF("next item on timer queue %p at %lu now %lu (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
-		if (likely(TIME_LT(now, timer->scheduled_time)))
+		LTRACEF("next item on timer queue %p at %llu now %llu (%p, arg %p)\n", timer, timer->scheduled_time, now_hires, timer->callback, timer->arg);
+		if (likely(now_hires < timer->scheduled_time))
 			break;
 
 		/* process it */
 		LTRACEF("timer %p\n", timer);
 		DEBUG_ASSERT(timer && timer->magic == TIMER_MAGIC);
-		list_delete(&timer->node);
+		remove_timer_from_queue(timer);
 
-		LTRACEF("dequeued timer %p, scheduled %lu periodic %lu\n", timer, timer->scheduled_time, timer->periodic_time);
+		LTRACEF("dequeued timer %p, scheduled %llu periodic %llu\n", timer, timer->scheduled_time, timer->periodic_time);
 
 		THREAD_STATS_INC(timers);
 
@@ -237,28 +353,19 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 		/* if it was a periodic timer and it hasn't been requeued
 		 * by the callback put it back in the list
 		 */
-		if (periodic && !list_in_list(&timer->node) && timer->periodic_time > 0) {
-			LTRACEF("periodic timer, period %u\n", (uint)timer->periodic_time);
-			timer->scheduled_time = now + timer->periodic_time;
+		if (periodic && !timer->queued && timer->periodic_time > 0) {
+			LTRACEF("periodic timer, period %llu\n", timer->periodic_time);
+			timer->scheduled_time = now_hires + timer->periodic_time;
 			insert_timer_in_queue(timer);
 		}
 	}
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-	/* reset the timer to the next event */
-	timer = list_peek_head_type(&timer_queue, timer_t, node);
-	if (timer) {
-		/* has to be the case or it would have fired already */
-		DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
-
-		lk_time_t delay = timer->scheduled_time - now;
-
-		LTRACEF("setting new timer for %u msecs for event %p\n", (uint)delay, timer);
-		platform_set_oneshot_timer(timer_tick, NULL, delay);
-	}
+	/* reset the timer to the next event, or stop it if there is none */
+	timer_program(now_hires);
 #else
 	/* let the scheduler have a shot to do quantum expiration, etc */
-	/* in case of dynamic timer, the scheduler will set up a periodic timer */
+	/* in case of dynamic timer, the scheduler will set up a one-shot timer */
 	if (thread_timer_tick() == INT_RESCHEDULE)
 		ret = INT_RESCHEDULE;
 #endif
@@ -269,7 +376,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 void timer_init(void)
 {
-	list_initialize(&timer_queue);
+	timer_heap = NULL;
 
 #if !PLATFORM_HAS_DYNAMIC_TIMER
 	/* register for a periodic timer tick */
@@ -21,22 +21,56 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <list.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <sys/types.h>
 #include <debug.h>
 #include <trace.h>
+#include <kernel/mutex.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
 #include <lib/bcache.h>
 #include <lib/bio.h>
 
 #define LOCAL_TRACE 0
 
+/*
+ * Sequential read-ahead: once bcache_read_block() sees a stream of ascending
+ * blocks, a miss fills the cache with one large read instead of a single block.
+ * The window starts at BCACHE_RA_MIN_SIZE bytes and doubles on every miss of the
+ * stream up to BCACHE_RA_MAX_SIZE, or half the cache. A gap of up to
+ * BCACHE_RA_MAX_GAP blocks, e.g. an ext2 indirect block, still counts as sequential.
+ */
+#ifndef BCACHE_RA_MIN_SIZE
+#define BCACHE_RA_MIN_SIZE (128 * 1024)
+#endif
+#ifndef BCACHE_RA_MAX_SIZE
+#define BCACHE_RA_MAX_SIZE (1024 * 1024)
+#endif
+#define BCACHE_RA_MAX_GAP 2
+
+/*
+ * Write-back: dirty blocks are written sorted by block number, with each run of
+ * consecutive blocks, up to BCACHE_WB_MAX_SIZE bytes, staged and sent as one
+ * write. The optional flusher thread does this in the background once the dirty
+ * share of the cache reaches its threshold, or every BCACHE_FLUSH_INTERVAL msecs.
+ */
+#ifndef BCACHE_WB_MAX_SIZE
+#define BCACHE_WB_MAX_SIZE (128 * 1024)
+#endif
+#ifndef BCACHE_FLUSH_INTERVAL
+#define BCACHE_FLUSH_INTERVAL 1000
+#endif
+
 struct bcache_block {
-	struct list_node node;
+	struct list_node node;			/* on the lru list while unpinned, or the free list */
+	struct bcache_block *hash_next;
 	bnum_t blocknum;
 	int ref_count;
 	bool is_dirty;
+	bool is_readahead;		/* read ahead and not used yet */
 	void *ptr;
 };
 
@@ -44,64 +78,321 @@ struct bcache_stats {
 	uint32_t hits;
 	uint32_t depth;
 	uint32_t misses;
+	uint32_t evictions;
 	uint32_t reads;
 	uint32_t writes;
+	uint32_t ra_reads;
+	uint32_t ra_blocks;
+	uint32_t ra_hits;
+	uint32_t flushes;
+	uint32_t flush_runs;
 };
 
 struct bcache {
+	struct list_node node;
 	bdev_t *dev;
 	size_t block_size;
 	int count;
 	struct bcache_stats stats;
 
 	struct list_node free_list;
+	/* unpinned blocks, least recently used at the head */
 	struct list_node lru_list;
 
+	uint32_t hash_shift;
+	struct bcache_block **hash;
+
 	struct bcache_block *blocks;
+	void *data;
+
+	/* read-ahead state, the window is 0 while the accesses are random */
+	bnum_t ra_last;
+	uint32_t ra_window;
+	uint32_t ra_min;
+	uint32_t ra_max;
+	void *ra_buf;
+
+	/* write-back state, the lock is only needed once there is a flusher */
+	mutex_t lock;
+	int dirty_count;
+	struct bcache_block **dirty;	/* scratch for sorting the dirty blocks */
+	uint32_t wb_max;
+	void *wb_buf;
+	thread_t *flusher;
+	event_t flush_event;
+	uint32_t flush_ratio;		/* percent of the blocks */
+	bool flusher_exit;
 };
 
+/* all the caches, for bcache_dump_all() */
+static struct list_node bcache_list = LIST_INITIAL_VALUE(bcache_list);
+static mutex_t bcache_list_lock = MUTEX_INITIAL_VALUE(bcache_list_lock);
+
+static inline uint32_t hash_bucket(struct bcache *cache, bnum_t blocknum)
+{
+	/* multiplicative hash, spreads runs of consecutive blocks over the buckets */
+	return (uint32_t)(blocknum * 0x9E3779B1U) >> (32 - cache->hash_shift);
+}
+
+static void hash_insert(struct bcache *cache, struct bcache_block *block)
+{
+	uint32_t bucket = hash_bucket(cache, block->blocknum);
+
+	block->hash_next = cache->hash[bucket];
+	cache->hash[bucket] = block;
+}
+
+static void hash_remove(struct bcache *cache, struct bcache_block *block)
+{
+	struct bcache_block **link = &cache->hash[hash_bucket(cache, block->blocknum)];
+
+	while (*link != NULL) {
+		if (*link == block) {
+			*link = block->hash_next;
+			block->hash_next = NULL;
+			return;
+		}
+		link = &(*link)->hash_next;
+	}
+}
+
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count)
 {
 	struct bcache *cache;
+	uint32_t hash_size;
+	int i;
 
-	cache = malloc(sizeof(struct bcache));
+	if (block_count <= 0)
+		block_count = MAX(BCACHE_DEFAULT_SIZE / block_size, 1U);
+
+	cache = calloc(1, sizeof(struct bcache));
+	if (cache == NULL)
+		return NULL;
 
 	cache->dev = dev;
 	cache->block_size = block_size;
 	cache->count = block_count;
-	memset(&cache->stats, 0, sizeof(cache->stats));
 
 	list_initialize(&cache->free_list);
 	list_initialize(&cache->lru_list);
 
-	cache->blocks = malloc(sizeof(struct bcache_block) * block_count);
-	int i;
+	/* at least one bucket per block, keeps the chains short */
+	cache->hash_shift = 1;
+	while ((1U << cache->hash_shift) < (uint32_t)block_count)
+		cache->hash_shift++;
+	hash_size = 1U << cache->hash_shift;
+
+	cache->hash = calloc(hash_size, sizeof(struct bcache_block *));
+	cache->blocks = calloc(block_count, sizeof(struct bcache_block));
+	cache->dirty = calloc(block_count, sizeof(struct bcache_block *));
+	cache->data = malloc(block_size * block_count);
+	if ((cache->hash == NULL) || (cache->blocks == NULL) || (cache->dirty == NULL) ||
+	    (cache->data == NULL)) {
+		free(cache->hash);
+		free(cache->blocks);
+		free(cache->dirty);
+		free(cache->data);
+		free(cache);
+		return NULL;
+	}
+	mutex_init(&cache->lock);
+
+	cache->ra_max = MIN(BCACHE_RA_MAX_SIZE / block_size, (size_t)block_count / 2);
+	cache->ra_min = MIN(MAX(BCACHE_RA_MIN_SIZE / block_size, 2U), cache->ra_max);
+	if (cache->ra_max >= 2)
+		cache->ra_buf = malloc(cache->ra_max * block_size);
+	if (cache->ra_buf == NULL)
+		cache->ra_max = 0;
+
+	cache->wb_max = MIN(BCACHE_WB_MAX_SIZE / block_size, (size_t)block_count);
+	if (cache->wb_max >= 2)
+		cache->wb_buf = malloc(cache->wb_max * block_size);
+	if (cache->wb_buf == NULL)
+		cache->wb_max = 1;
+
 	for (i=0; i < block_count; i++) {
-		cache->blocks[i].ref_count = 0;
-		cache->blocks[i].is_dirty = false;
-		cache->blocks[i].ptr = malloc(block_size);
+		cache->blocks[i].ptr = (uint8_t *)cache->data + (i * block_size);
 		// add to the free list
 		list_add_head(&cache->free_list, &cache->blocks[i].node);
 	}
 
+	mutex_acquire(&bcache_list_lock);
+	list_add_tail(&bcache_list, &cache->node);
+	mutex_release(&bcache_list_lock);
+
+	LTRACEF("%d blocks of %zu bytes, %u hash buckets\n", block_count, block_size, hash_size);
+
 	return (bcache_t)cache;
 }
 
-static int flush_block(struct bcache *cache, struct bcache_block *block)
+static void set_dirty(struct bcache *cache, struct bcache_block *block, bool dirty)
 {
-	int rc;
+	if (block->is_dirty == dirty)
+		return;
 
-	rc = bio_write(cache->dev, block->ptr,
-	               (off_t)block->blocknum * cache->block_size,
-	               cache->block_size);
-	if (rc < 0)
-		goto exit;
+	block->is_dirty = dirty;
+	cache->dirty_count += dirty ? 1 : -1;
 
-	block->is_dirty = false;
-	cache->stats.writes++;
-	rc = 0;
-exit:
-	return (rc);
+	/* wake the flusher once enough of the cache is dirty */
+	if (dirty && cache->flusher &&
+	    (uint32_t)cache->dirty_count * 100 >= cache->flush_ratio * (uint32_t)cache->count)
+		event_signal(&cache->flush_event, false);
+}
+
+/* heapsort by block number, the dirty list can be as long as the cache */
+static void sift_down(struct bcache_block **list, uint root, uint count)
+{
+	struct bcache_block *tmp;
+	uint child;
+
+	while ((child = root * 2 + 1) < count) {
+		if (child + 1 < count && list[child + 1]->blocknum > list[child]->blocknum)
+			child++;
+		if (list[root]->blocknum >= list[child]->blocknum)
+			return;
+		tmp = list[root];
+		list[root] = list[child];
+		list[child] = tmp;
+		root = child;
+	}
+}
+
+static void sort_blocks(struct bcache_block **list, uint count)
+{
+	struct bcache_block *tmp;
+	uint i;
+
+	for (i = count / 2; i-- > 0; )
+		sift_down(list, i, count);
+	for (i = count; i-- > 1; ) {
+		tmp = list[0];
+		list[0] = list[i];
+		list[i] = tmp;
+		sift_down(list, 0, i);
+	}
+}
+
+/* write count blocks with consecutive block numbers in one go */
+static int write_run(struct bcache *cache, struct bcache_block **run, uint count)
+{
+	size_t len = count * cache->block_size;
+	const void *buf = run[0]->ptr;
+	ssize_t rc;
+	uint i;
+
+	if (count > 1) {
+		for (i = 0; i < count; i++)
+			memcpy((uint8_t *)cache->wb_buf + (i * cache->block_size), run[i]->ptr, cache->block_size);
+		buf = cache->wb_buf;
+	}
+
+	LTRACEF("block %u, count %u\n", run[0]->blocknum, count);
+
+	rc = bio_write(cache->dev, buf, (off_t)run[0]->blocknum * cache->block_size, len);
+	if (rc < (ssize_t)len)
+		return (rc < 0) ? (int)rc : -1;
+
+	for (i = 0; i < count; i++)
+		set_dirty(cache, run[i], false);
+	cache->stats.writes += count;
+	cache->stats.flush_runs++;
+
+	return 0;
+}
+
+/* write back the dirty blocks in block order, merging neighbours, optionally leaving pinned ones */
+static int write_back(struct bcache *cache, bool pinned)
+{
+	uint count = 0;
+	uint start;
+	uint i;
+	int err;
+
+	for (i = 0; i < (uint)cache->count; i++) {
+		struct bcache_block *block = &cache->blocks[i];
+		if (block->is_dirty && (pinned || block->ref_count == 0))
+			cache->dirty[count++] = block;
+	}
+	if (count == 0)
+		return 0;
+
+	sort_blocks(cache->dirty, count);
+	cache->stats.flushes++;
+
+	for (start = 0; start < count; start = i) {
+		for (i = start + 1; i < count && i - start < cache->wb_max; i++) {
+			if (cache->dirty[i]->blocknum != cache->dirty[i - 1]->blocknum + 1)
+				break;
+		}
+
+		err = write_run(cache, &cache->dirty[start], i - start);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int bcache_flusher(void *arg)
+{
+	struct bcache *cache = arg;
+
+	for (;;) {
+		event_wait_timeout(&cache->flush_event, BCACHE_FLUSH_INTERVAL);
+
+		mutex_acquire(&cache->lock);
+		if (cache->flusher_exit) {
+			mutex_release(&cache->lock);
+			break;
+		}
+		/* pinned blocks may be half way through an update, their owner flushes them */
+		if (cache->dirty_count > 0 && write_back(cache, false) < 0)
+			dprintf(CRITICAL, "bcache: background write back to %s failed\n", cache->dev->name);
+		mutex_release(&cache->lock);
+	}
+
+	return 0;
+}
+
+int bcache_start_flusher(bcache_t _cache, uint dirty_ratio)
+{
+	struct bcache *cache = _cache;
+	char name[32];
+
+	if (cache->flusher)
+		return -1;
+
+	mutex_acquire(&cache->lock);
+	cache->flush_ratio = MIN(dirty_ratio, 100U);
+	cache->flusher_exit = false;
+	event_init(&cache->flush_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+	snprintf(name, sizeof(name), "bcache %s", cache->dev->name);
+	cache->flusher = thread_create(name, &bcache_flusher, cache, LOW_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!cache->flusher) {
+		event_destroy(&cache->flush_event);
+		mutex_release(&cache->lock);
+		return -1;
+	}
+	thread_resume(cache->flusher);
+	mutex_release(&cache->lock);
+
+	return 0;
+}
+
+static void stop_flusher(struct bcache *cache)
+{
+	if (!cache->flusher)
+		return;
+
+	mutex_acquire(&cache->lock);
+	cache->flusher_exit = true;
+	mutex_release(&cache->lock);
+
+	event_signal(&cache->flush_event, false);
+	thread_join(cache->flusher, NULL, INFINITE_TIME);
+	event_destroy(&cache->flush_event);
+	cache->flusher = NULL;
 }
 
 void bcache_destroy(bcache_t _cache)
@@ -109,19 +400,46 @@ void bcache_destroy(bcache_t _cache)
 	struct bcache *cache = _cache;
 	int i;
 
+	mutex_acquire(&bcache_list_lock);
+	list_delete(&cache->node);
+	mutex_release(&bcache_list_lock);
+
+	stop_flusher(cache);
+
 	for (i=0; i < cache->count; i++) {
 		DEBUG_ASSERT(cache->blocks[i].ref_count == 0);
 
 		if (cache->blocks[i].is_dirty)
 			printf("warning: freeing dirty block %u\n",
 			       cache->blocks[i].blocknum);
-
-		free(cache->blocks[i].ptr);
 	}
 
+	mutex_destroy(&cache->lock);
+	free(cache->wb_buf);
+	free(cache->ra_buf);
+	free(cache->data);
+	free(cache->dirty);
+	free(cache->blocks);
+	free(cache->hash);
 	free(cache);
 }
 
+static struct bcache_block *hash_lookup(struct bcache *cache, bnum_t blocknum, uint32_t *depth)
+{
+	struct bcache_block *block;
+
+	for (block = cache->hash[hash_bucket(cache, blocknum)]; block != NULL;
+	     block = block->hash_next) {
+		LTRACEF("looking at entry %p, num %u\n", block, block->blocknum);
+		(*depth)++;
+
+		if (block->blocknum == blocknum)
+			return block;
+	}
+
+	return NULL;
+}
+
 /* find a block if it's already present */
 static struct bcache_block *find_block(struct bcache *cache, uint blocknum)
 {
@@ -130,25 +448,27 @@ static struct bcache_block *find_block(struct bcache *cache, uint blocknum)
 
 	LTRACEF("num %u\n", blocknum);
 
-	block = NULL;
-	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
-		LTRACEF("looking at entry %p, num %u\n", block, block->blocknum);
-		depth++;
-
-		if (block->blocknum == blocknum) {
-			list_delete(&block->node);
-			list_add_tail(&cache->lru_list, &block->node);
-			cache->stats.hits++;
-			cache->stats.depth += depth;
-			return block;
-		}
+	block = hash_lookup(cache, blocknum, &depth);
+	if (block == NULL) {
+		cache->stats.misses++;
+		return NULL;
 	}
 
-	cache->stats.misses++;
-	return NULL;
+	/* most recently used goes to the tail, pinned blocks are not on the lru */
+	if (block->ref_count == 0) {
+		list_delete(&block->node);
+		list_add_tail(&cache->lru_list, &block->node);
+	}
+	if (block->is_readahead) {
+		block->is_readahead = false;
+		cache->stats.ra_hits++;
+	}
+	cache->stats.hits++;
+	cache->stats.depth += depth;
+	return block;
 }
 
-/* allocate a new block */
+/* allocate a new block, it is on the lru but not in the hash */
 static struct bcache_block *alloc_block(struct bcache *cache)
 {
 	int err;
@@ -159,31 +479,95 @@ static struct bcache_block *alloc_block(struct bcache *cache)
 	if (block) {
 		block->ref_count = 0;
 		list_add_tail(&cache->lru_list, &block->node);
+		block->is_readahead = false;
 		LTRACEF("found block %p on free list\n", block);
 		return block;
 	}
 
-	/* walk the lru, looking for a free block */
-	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
-		LTRACEF("looking at %p, num %u\n", block, block->blocknum);
-		if (block->ref_count == 0) {
-			if (block->is_dirty) {
-				err = flush_block(cache, block);
-				if (err)
-					return NULL;
-			}
-
-			// add it to the tail of the lru
-			list_delete(&block->node);
-			list_add_tail(&cache->lru_list, &block->node);
-			return block;
+	/* evict the least recently used block, pinned blocks are not on the lru */
+	block = list_peek_head_type(&cache->lru_list, struct bcache_block, node);
+	if (block == NULL)
+		return NULL;
+
+	LTRACEF("evicting %p, num %u\n", block, block->blocknum);
+	DEBUG_ASSERT(block->ref_count == 0);
+	if (block->is_dirty) {
+		/* a write is due anyway, take the other unpinned dirty blocks along in runs */
+		err = write_back(cache, false);
+		if (err)
+			return NULL;
+	}
+
+	hash_remove(cache, block);
+	block->is_readahead = false;
+	cache->stats.evictions++;
+
+	// add it to the tail of the lru
+	list_delete(&block->node);
+	list_add_tail(&cache->lru_list, &block->node);
+	return block;
+}
+
+/* return a block from alloc_block() that could not be filled */
+static void release_block(struct bcache *cache, struct bcache_block *block)
+{
+	list_delete(&block->node);
+	list_add_tail(&cache->free_list, &block->node);
+}
+
+/*
+ * Fills blocknum and up to count - 1 blocks after it with one read. Stops at the
+ * first block that is already cached. Returns the block for blocknum, or NULL if
+ * the read failed.
+ */
+static struct bcache_block *read_ahead(struct bcache *cache, bnum_t blocknum, uint32_t count)
+{
+	struct bcache_block *block = NULL;
+	struct bcache_block *ra_block;
+	uint32_t depth = 0;
+	ssize_t len;
+	uint32_t i;
+
+	for (i = 1; i < count; i++) {
+		if (hash_lookup(cache, blocknum + i, &depth) != NULL)
+			break;
+	}
+	count = i;
+
+	LTRACEF("block %u, count %u\n", blocknum, count);
+
+	len = bio_read(cache->dev, cache->ra_buf, (off_t)blocknum * cache->block_size,
+	               count * cache->block_size);
+	if (len < (ssize_t)cache->block_size)
+		return NULL;
+	count = len / cache->block_size;
+
+	cache->stats.reads++;
+	cache->stats.ra_reads++;
+
+	/* the requested block goes in last, so that it is the most recently used */
+	for (i = count; i-- > 0; ) {
+		ra_block = alloc_block(cache);
+		if (ra_block == NULL)
+			break;
+
+		ra_block->blocknum = blocknum + i;
+		memcpy(ra_block->ptr, (uint8_t *)cache->ra_buf + (i * cache->block_size),
+		       cache->block_size);
+		hash_insert(cache, ra_block);
+
+		if (i == 0) {
+			block = ra_block;
+		} else {
+			ra_block->is_readahead = true;
+			cache->stats.ra_blocks++;
 		}
 	}
 
-	return NULL;
+	return block;
 }
 
-static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum)
+static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blocknum, bool sequential)
 {
 	int err;
 
@@ -194,9 +578,25 @@ static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blockn
 	if (block == NULL) {
 		LTRACEF("wasn't allocated\n");
 
+		/* grow the window while the stream keeps missing, drop it on a random miss */
+		if (sequential && (cache->ra_max != 0))
+			cache->ra_window = cache->ra_window ?
+			                   MIN(cache->ra_window * 2, cache->ra_max) : cache->ra_min;
+		else
+			cache->ra_window = 0;
+
+		if (cache->ra_window > 1) {
+			block = read_ahead(cache, blocknum, cache->ra_window);
+			if (block != NULL)
+				return block;
+		}
+
 		/* allocate a new block and fill it */
 		block = alloc_block(cache);
-		DEBUG_ASSERT(block);
+		if (block == NULL) {
+			dprintf(CRITICAL, "bcache: all %d blocks are pinned\n", cache->count);
+			return NULL;
+		}
 
 		LTRACEF("wasn't allocated, new block %p\n", block);
 
@@ -204,10 +604,11 @@ static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blockn
 		err = bio_read(cache->dev, block->ptr, (off_t)blocknum * cache->block_size, cache->block_size);
 		if (err < 0) {
 			/* free the block, return an error */
-			list_add_tail(&cache->free_list, &block->node);
+			release_block(cache, block);
 			return NULL;
 		}
 
+		hash_insert(cache, block);
 		cache->stats.reads++;
 	}
 
@@ -216,19 +617,44 @@ static struct bcache_block *find_or_fill_block(struct bcache *cache, uint blockn
 	return block;
 }
 
+/* pinned blocks are taken off the lru so that they are never evicted */
+static void pin_block(struct bcache *cache, struct bcache_block *block)
+{
+	if (block->ref_count++ == 0)
+		list_delete(&block->node);
+}
+
+static void unpin_block(struct bcache *cache, struct bcache_block *block)
+{
+	DEBUG_ASSERT(block->ref_count > 0);
+
+	if (--block->ref_count == 0)
+		list_add_tail(&cache->lru_list, &block->node);
+}
+
 int bcache_read_block(bcache_t _cache, void *buf, uint blocknum)
 {
 	struct bcache *cache = _cache;
+	bool sequential;
 
 	LTRACEF("buf %p, blocknum %u\n", buf, blocknum);
 
-	struct bcache_block *block = find_or_fill_block(cache, blocknum);
+	mutex_acquire(&cache->lock);
+
+	/* only data reads feed the stream detector, metadata lookups go through get_block */
+	sequential = (blocknum > cache->ra_last) &&
+	             ((blocknum - cache->ra_last) <= BCACHE_RA_MAX_GAP);
+	cache->ra_last = blocknum;
+
+	struct bcache_block *block = find_or_fill_block(cache, blocknum, sequential);
 	if (block == NULL) {
 		/* error */
+		mutex_release(&cache->lock);
 		return -1;
 	}
 
 	memcpy(buf, block->ptr, cache->block_size);
+	mutex_release(&cache->lock);
 	return 0;
 }
 
@@ -240,16 +666,20 @@ int bcache_get_block(bcache_t _cache, void **ptr, uint blocknum)
 
 	DEBUG_ASSERT(ptr);
 
-	struct bcache_block *block = find_or_fill_block(cache, blocknum);
+	mutex_acquire(&cache->lock);
+
+	struct bcache_block *block = find_or_fill_block(cache, blocknum, false);
 	if (block == NULL) {
 		/* error */
+		mutex_release(&cache->lock);
 		return -1;
 	}
 
 	/* increment the ref count to keep it from being freed */
-	block->ref_count++;
+	pin_block(cache, block);
 	*ptr = block->ptr;
 
+	mutex_release(&cache->lock);
 	return 0;
 }
 
@@ -259,14 +689,17 @@ int bcache_put_block(bcache_t _cache, uint blocknum)
 
 	LTRACEF("blocknum %u\n", blocknum);
 
+	mutex_acquire(&cache->lock);
+
 	struct bcache_block *block = find_block(cache, blocknum);
 
 	/* be pretty hard on the caller for now */
 	DEBUG_ASSERT(block);
 	DEBUG_ASSERT(block->ref_count > 0);
 
-	block->ref_count--;
+	unpin_block(cache, block);
 
+	mutex_release(&cache->lock);
 	return 0;
 }
 
@@ -276,15 +709,18 @@ int bcache_mark_block_dirty(bcache_t priv, uint blocknum)
 	struct bcache *cache = priv;
 	struct bcache_block *block;
 
+	mutex_acquire(&cache->lock);
+
 	block = find_block(cache, blocknum);
 	if (!block) {
 		err = -1;
 		goto exit;
 	}
 
-	block->is_dirty = true;
+	set_dirty(cache, block, true);
 	err = 0;
 exit:
+	mutex_release(&cache->lock);
 	return (err);
 }
 
@@ -294,6 +730,8 @@ int bcache_zero_block(bcache_t priv, uint blocknum)
 	struct bcache *cache = priv;
 	struct bcache_block *block;
 
+	mutex_acquire(&cache->lock);
+
 	block = find_block(cache, blocknum);
 	if (!block) {
 		block = alloc_block(cache);
@@ -303,12 +741,14 @@ int bcache_zero_block(bcache_t priv, uint blocknum)
 		}
 
 		block->blocknum = blocknum;
+		hash_insert(cache, block);
 	}
 
 	memset(block->ptr, 0, cache->block_size);
-	block->is_dirty = true;
+	set_dirty(cache, block, true);
 	err = 0;
 exit:
+	mutex_release(&cache->lock);
 	return (err);
 }
 
@@ -316,35 +756,64 @@ int bcache_flush(bcache_t priv)
 {
 	int err;
 	struct bcache *cache = priv;
-	struct bcache_block *block;
 
-	list_for_every_entry(&cache->lru_list, block, struct bcache_block, node) {
-		if (block->is_dirty) {
-			err = flush_block(cache, block);
-			if (err)
-				goto exit;
-		}
-	}
+	/* pinned blocks included, the caller is done with them */
+	mutex_acquire(&cache->lock);
+	err = write_back(cache, true);
+	mutex_release(&cache->lock);
 
-	err = 0;
-exit:
 	return (err);
 }
 
 void bcache_dump(bcache_t priv, const char *name)
 {
 	uint32_t finds;
+	uint32_t pinned = 0;
+	int i;
 	struct bcache *cache = priv;
 
 	finds = cache->stats.hits + cache->stats.misses;
+	for (i = 0; i < cache->count; i++) {
+		if (cache->blocks[i].ref_count > 0)
+			pinned++;
+	}
 
-	printf("%s: hits=%u(%u%%) depth=%u misses=%u(%u%%) reads=%u writes=%u\n",
+	printf("%s: %d x %zu byte blocks, %u pinned, %u hash buckets\n",
+	       name, cache->count, cache->block_size, pinned, 1U << cache->hash_shift);
+	printf("%s: hits=%u(%u%%) depth=%u misses=%u(%u%%) evictions=%u reads=%u writes=%u\n",
 	       name,
 	       cache->stats.hits,
 	       finds ? (cache->stats.hits * 100) / finds : 0,
 	       cache->stats.hits ? cache->stats.depth / cache->stats.hits : 0,
 	       cache->stats.misses,
 	       finds ? (cache->stats.misses * 100) / finds : 0,
+	       cache->stats.evictions,
 	       cache->stats.reads,
 	       cache->stats.writes);
+	printf("%s: readahead window=%u/%u reads=%u blocks=%u hits=%u\n",
+	       name,
+	       cache->ra_window,
+	       cache->ra_max,
+	       cache->stats.ra_reads,
+	       cache->stats.ra_blocks,
+	       cache->stats.ra_hits);
+	printf("%s: writeback dirty=%d flushes=%u runs=%u max run=%u flusher=%s(%u%%)\n",
+	       name,
+	       cache->dirty_count,
+	       cache->stats.flushes,
+	       cache->stats.flush_runs,
+	       cache->wb_max,
+	       cache->flusher ? "on" : "off",
+	       cache->flush_ratio);
+}
+
+void bcache_dump_all(void)
+{
+	struct bcache *cache;
+
+	mutex_acquire(&bcache_list_lock);
+	list_for_every_entry(&bcache_list, cache, struct bcache, node) {
+		bcache_dump(cache, cache->dev->name);
+	}
+	mutex_release(&bcache_list_lock);
 }
@@ -24,22 +24,44 @@
 #include <debug.h>
 #include <trace.h>
 #include <err.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <list.h>
+#include <hash.h>
 #include <lib/bio.h>
 #include <kernel/mutex.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
 #include <lk/init.h>
+#include <arch/ops.h>
+#include <platform.h>
 
 #define LOCAL_TRACE 0
 
 struct bdev_struct {
 	struct list_node list;
+	struct list_node hash[BIO_NAME_HASH_SIZE];
 	mutex_t lock;
 };
 
+/* per device request queue, served by a worker thread calling the sync hooks */
+struct bio_queue {
+	struct list_node pending;
+	mutex_t lock;
+	event_t wakeup;
+	thread_t *worker;
+	bool exiting;
+	bool detached; // the worker dropped the last device ref and frees the queue itself
+};
+
 static struct bdev_struct *bdevs;
 
+static void bio_queue_destroy(struct bio_queue *q);
+static ssize_t bio_do_read_block(bdev_t *dev, void *buf, bnum_t block, uint count);
+static ssize_t bio_do_write(bdev_t *dev, const void *buf, off_t offset, size_t len);
+static ssize_t bio_do_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count);
+
 /* default implementation is to use the read_block hook to 'deblock' the device */
 static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size_t len)
 {
@@ -56,7 +78,7 @@ static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size
 	/* handle partial first block */
 	if ((offset % dev->block_size) != 0) {
 		/* read in the block */
-		err = bio_read_block(dev, temp, block, 1);
+		err = bio_do_read_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -77,7 +99,7 @@ static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size
 	if (len >= dev->block_size) {
 		/* do the middle reads */
 		size_t block_count = len / dev->block_size;
-		err = bio_read_block(dev, buf, block, block_count);
+		err = bio_do_read_block(dev, buf, block, block_count);
 		if (err < 0)
 			goto err;
 
@@ -95,7 +117,7 @@ static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size
 	/* handle partial last block */
 	if (len > 0) {
 		/* read the block */
-		err = bio_read_block(dev, temp, block, 1);
+		err = bio_do_read_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -125,7 +147,7 @@ static ssize_t bio_default_write(struct bdev *dev, const void *_buf, off_t offse
 	/* handle partial first block */
 	if ((offset % dev->block_size) != 0) {
 		/* read in the block */
-		err = bio_read_block(dev, temp, block, 1);
+		err = bio_do_read_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -135,7 +157,7 @@ static ssize_t bio_default_write(struct bdev *dev, const void *_buf, off_t offse
 		memcpy(temp + block_offset, buf, tocopy);
 
 		/* write it back out */
-		err = bio_write_block(dev, temp, block, 1);
+		err = bio_do_write_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -151,7 +173,7 @@ static ssize_t bio_default_write(struct bdev *dev, const void *_buf, off_t offse
 	if (len >= dev->block_size) {
 		/* do the middle writes */
 		size_t block_count = len / dev->block_size;
-		err = bio_write_block(dev, buf, block, block_count);
+		err = bio_do_write_block(dev, buf, block, block_count);
 		if (err < 0)
 			goto err;
 
@@ -169,7 +191,7 @@ static ssize_t bio_default_write(struct bdev *dev, const void *_buf, off_t offse
 	/* handle partial last block */
 	if (len > 0) {
 		/* read the block */
-		err = bio_read_block(dev, temp, block, 1);
+		err = bio_do_read_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -177,7 +199,7 @@ static ssize_t bio_default_write(struct bdev *dev, const void *_buf, off_t offse
 		memcpy(temp, buf, len);
 
 		/* write it back out */
-		err = bio_write_block(dev, temp, block, 1);
+		err = bio_do_write_block(dev, temp, block, 1);
 		if (err < 0)
 			goto err;
 
@@ -189,6 +211,220 @@ err:
 	return (err >= 0) ? bytes_written : err;
 }
 
+/* position within a segment list */
+struct bio_iov_cursor {
+	const bio_iovec_t *iov;
+	uint index;
+	size_t offset;
+};
+
+static inline uint8_t *bio_iov_ptr(const struct bio_iov_cursor *cur)
+{
+	return (uint8_t *)cur->iov[cur->index].base + cur->offset;
+}
+
+static inline size_t bio_iov_left(const struct bio_iov_cursor *cur)
+{
+	return cur->iov[cur->index].len - cur->offset;
+}
+
+static void bio_iov_advance(struct bio_iov_cursor *cur, size_t len)
+{
+	while (len > 0) {
+		size_t step = MIN(len, bio_iov_left(cur));
+
+		cur->offset += step;
+		len -= step;
+		if (cur->offset == cur->iov[cur->index].len) {
+			cur->index++;
+			cur->offset = 0;
+		}
+	}
+}
+
+/* copy len bytes between buf and the segments, in either direction */
+static void bio_iov_copy(struct bio_iov_cursor *cur, uint8_t *buf, size_t len, bool to_iov)
+{
+	while (len > 0) {
+		size_t tocopy = MIN(len, bio_iov_left(cur));
+
+		if (to_iov)
+			memcpy(bio_iov_ptr(cur), buf, tocopy);
+		else
+			memcpy(buf, bio_iov_ptr(cur), tocopy);
+
+		buf += tocopy;
+		len -= tocopy;
+		bio_iov_advance(cur, tocopy);
+	}
+}
+
+/* describe the next len bytes of the segments in sg, returning the entry count */
+static uint bio_iov_slice(struct bio_iov_cursor *cur, size_t len, bio_iovec_t *sg)
+{
+	uint count = 0;
+
+	while (len > 0) {
+		sg[count].base = bio_iov_ptr(cur);
+		sg[count].len = MIN(len, bio_iov_left(cur));
+		len -= sg[count].len;
+		bio_iov_advance(cur, sg[count].len);
+		count++;
+	}
+
+	return count;
+}
+
+static size_t bio_iov_total(const bio_iovec_t *iov, uint iovcnt)
+{
+	size_t len = 0;
+	uint i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+
+	return len;
+}
+
+/*
+ * default vectored read, a single pass over the segments: whole blocks go straight
+ * into them (all in one call to read_block_sg if the device has it), partial blocks
+ * and blocks straddling two segments bounce through a temp buffer
+ */
+static ssize_t bio_default_readv(struct bdev *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	struct bio_iov_cursor cur = { iov, 0, 0 };
+	size_t len = bio_iov_total(iov, iovcnt);
+	bnum_t block = offset / dev->block_size;
+	size_t block_offset = offset % dev->block_size;
+	ssize_t bytes_read = 0;
+	ssize_t err = 0;
+	STACKBUF_DMA_ALIGN(temp, dev->block_size); // temporary buffer for partial block transfers
+
+	LTRACEF("iovcnt %u, offset %lld, block %u, len %zu\n", iovcnt, offset, block, len);
+
+	while (len > 0) {
+		if (block_offset == 0 && len >= dev->block_size) {
+			if (dev->read_block_sg) {
+				bio_iovec_t sg[BIO_IOV_MAX];
+				size_t bytes = ROUNDDOWN(len, dev->block_size);
+				uint sgcnt = bio_iov_slice(&cur, bytes, sg);
+
+				err = dev->read_block_sg(dev, sg, sgcnt, block);
+				if (err < 0)
+					goto err;
+
+				block += bytes / dev->block_size;
+				len -= bytes;
+				bytes_read += bytes;
+				continue;
+			}
+
+			if (bio_iov_left(&cur) >= dev->block_size) {
+				size_t block_count = MIN(bio_iov_left(&cur), len) / dev->block_size;
+				size_t bytes = block_count * dev->block_size;
+
+				err = bio_do_read_block(dev, bio_iov_ptr(&cur), block, block_count);
+				if (err < 0)
+					goto err;
+
+				bio_iov_advance(&cur, bytes);
+				block += block_count;
+				len -= bytes;
+				bytes_read += bytes;
+				continue;
+			}
+		}
+
+		/* partial block, or one split between segments */
+		err = bio_do_read_block(dev, temp, block, 1);
+		if (err < 0)
+			goto err;
+
+		size_t tocopy = MIN(dev->block_size - block_offset, len);
+		bio_iov_copy(&cur, temp + block_offset, tocopy, true);
+
+		block++;
+		block_offset = 0;
+		len -= tocopy;
+		bytes_read += tocopy;
+	}
+
+err:
+	/* return error or bytes read */
+	return (err >= 0) ? bytes_read : err;
+}
+
+static ssize_t bio_default_writev(struct bdev *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	struct bio_iov_cursor cur = { iov, 0, 0 };
+	size_t len = bio_iov_total(iov, iovcnt);
+	bnum_t block = offset / dev->block_size;
+	size_t block_offset = offset % dev->block_size;
+	ssize_t bytes_written = 0;
+	ssize_t err = 0;
+	STACKBUF_DMA_ALIGN(temp, dev->block_size); // temporary buffer for partial block transfers
+
+	LTRACEF("iovcnt %u, offset %lld, block %u, len %zu\n", iovcnt, offset, block, len);
+
+	while (len > 0) {
+		if (block_offset == 0 && len >= dev->block_size) {
+			if (dev->write_block_sg) {
+				bio_iovec_t sg[BIO_IOV_MAX];
+				size_t bytes = ROUNDDOWN(len, dev->block_size);
+				uint sgcnt = bio_iov_slice(&cur, bytes, sg);
+
+				err = dev->write_block_sg(dev, sg, sgcnt, block);
+				if (err < 0)
+					goto err;
+
+				block += bytes / dev->block_size;
+				len -= bytes;
+				bytes_written += bytes;
+				continue;
+			}
+
+			if (bio_iov_left(&cur) >= dev->block_size) {
+				size_t block_count = MIN(bio_iov_left(&cur), len) / dev->block_size;
+				size_t bytes = block_count * dev->block_size;
+
+				err = bio_do_write_block(dev, bio_iov_ptr(&cur), block, block_count);
+				if (err < 0)
+					goto err;
+
+				bio_iov_advance(&cur, bytes);
+				block += block_count;
+				len -= bytes;
+				bytes_written += bytes;
+				continue;
+			}
+		}
+
+		/* partial block, or one split between segments, only the former needs reading first */
+		size_t tocopy = MIN(dev->block_size - block_offset, len);
+		if (tocopy < dev->block_size) {
+			err = bio_do_read_block(dev, temp, block, 1);
+			if (err < 0)
+				goto err;
+		}
+
+		bio_iov_copy(&cur, temp + block_offset, tocopy, false);
+
+		err = bio_do_write_block(dev, temp, block, 1);
+		if (err < 0)
+			goto err;
+
+		block++;
+		block_offset = 0;
+		len -= tocopy;
+		bytes_written += tocopy;
+	}
+
+err:
+	/* return error or bytes written */
+	return (err >= 0) ? bytes_written : err;
+}
+
 static ssize_t bio_default_erase(struct bdev *dev, off_t offset, size_t len)
 {
 	/* default erase operation is to just write zeros over the device */
@@ -202,7 +438,7 @@ static ssize_t bio_default_erase(struct bdev *dev, off_t offset, size_t len)
 	while (remaining > 0) {
 		ssize_t towrite = MIN(remaining, ERASE_BUF_SIZE);
 
-		ssize_t written = bio_write(dev, zero_buf, pos, towrite);
+		ssize_t written = bio_do_write(dev, zero_buf, pos, towrite);
 		if (written < 0)
 			return pos;
 
@@ -240,6 +476,10 @@ static void bdev_dec_ref(bdev_t *dev)
 
 		TRACEF("last ref, removing (%s)\n", dev->name);
 
+		// nothing can be queued without a ref, stop the worker
+		if (dev->queue)
+			bio_queue_destroy(dev->queue);
+
 		// call the close hook if it exists
 		if (dev->close)
 			dev->close(dev);
@@ -253,14 +493,20 @@ bdev_t *bio_open(const char *name)
 {
 	bdev_t *bdev = NULL;
 
-	/* see if it's in our list */
+	/* see if it's in our name index */
+	struct list_node *bucket = &bdevs->hash[hash_str_bucket(name, BIO_NAME_HASH_SIZE)];
 	bdev_t *entry;
 	mutex_acquire(&bdevs->lock);
-	list_for_every_entry(&bdevs->list, entry, bdev_t, node) {
+	list_for_every_entry(bucket, entry, bdev_t, hash_node) {
 		DEBUG_ASSERT(entry->ref > 0);
 		if (!strcmp(entry->name, name)) {
 			bdev = entry;
 			bdev_inc_ref(bdev);
+			/* the same few partitions get opened over and over, keep them up front */
+			if (bucket->next != &entry->hash_node) {
+				list_delete(&entry->hash_node);
+				list_add_head(bucket, &entry->hash_node);
+			}
 			break;
 		}
 	}
@@ -276,7 +522,7 @@ void bio_close(bdev_t *dev)
 	bdev_dec_ref(dev);
 }
 
-ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len)
+static ssize_t bio_do_read(bdev_t *dev, void *buf, off_t offset, size_t len)
 {
 	LTRACEF("dev '%s', buf %p, offset %lld, len %zd\n", dev->name, buf, offset, len);
 
@@ -295,7 +541,7 @@ ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len)
 	return dev->read(dev, buf, offset, len);
 }
 
-ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
+static ssize_t bio_do_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
 {
 	LTRACEF("dev '%s', buf %p, block %d, count %u\n", dev->name, buf, block, count);
 
@@ -312,7 +558,7 @@ ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
 	return dev->read_block(dev, buf, block, count);
 }
 
-ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
+static ssize_t bio_do_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
 {
 	LTRACEF("dev '%s', buf %p, offset %lld, len %zd\n", dev->name, buf, offset, len);
 
@@ -331,7 +577,7 @@ ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
 	return dev->write(dev, buf, offset, len);
 }
 
-ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
+static ssize_t bio_do_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
 {
 	LTRACEF("dev '%s', buf %p, block %d, count %u\n", dev->name, buf, block, count);
 
@@ -348,7 +594,69 @@ ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
 	return dev->write_block(dev, buf, block, count);
 }
 
-ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
+/* copy the segments that fall within len bytes, dropping empty ones */
+static uint bio_iov_clip(const bio_iovec_t *iov, uint iovcnt, size_t len, bio_iovec_t *clipped)
+{
+	uint count = 0;
+	uint i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (iov[i].len == 0)
+			continue;
+		clipped[count].base = iov[i].base;
+		clipped[count].len = MIN(iov[i].len, len);
+		len -= clipped[count].len;
+		count++;
+	}
+
+	return count;
+}
+
+static ssize_t bio_do_readv(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	bio_iovec_t clipped[BIO_IOV_MAX];
+
+	LTRACEF("dev '%s', iov %p, iovcnt %u, offset %lld\n", dev->name, iov, iovcnt, offset);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	/* range check */
+	if (iovcnt > BIO_IOV_MAX)
+		return ERR_INVALID_ARGS;
+	if (offset < 0)
+		return -1;
+	if (offset >= dev->size)
+		return 0;
+	iovcnt = bio_iov_clip(iov, iovcnt, dev->size - offset, clipped);
+	if (iovcnt == 0)
+		return 0;
+
+	return dev->readv(dev, clipped, iovcnt, offset);
+}
+
+static ssize_t bio_do_writev(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	bio_iovec_t clipped[BIO_IOV_MAX];
+
+	LTRACEF("dev '%s', iov %p, iovcnt %u, offset %lld\n", dev->name, iov, iovcnt, offset);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	/* range check */
+	if (iovcnt > BIO_IOV_MAX)
+		return ERR_INVALID_ARGS;
+	if (offset < 0)
+		return -1;
+	if (offset >= dev->size)
+		return 0;
+	iovcnt = bio_iov_clip(iov, iovcnt, dev->size - offset, clipped);
+	if (iovcnt == 0)
+		return 0;
+
+	return dev->writev(dev, clipped, iovcnt, offset);
+}
+
+static ssize_t bio_do_erase(bdev_t *dev, off_t offset, size_t len)
 {
 	LTRACEF("dev '%s', offset %lld, len %zd\n", dev->name, offset, len);
 
@@ -367,6 +675,345 @@ ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
 	return dev->erase(dev, offset, len);
 }
 
+/* index of the power of two bucket val falls in, the last bucket catches everything larger */
+static uint bio_stat_bucket(uint64_t val, uint buckets)
+{
+	uint bucket = 0;
+
+	while (val > 1 && bucket < buckets - 1) {
+		val >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void bio_account(bdev_t *dev, uint op, lk_bigtime_t start, size_t len, ssize_t result)
+{
+	lk_bigtime_t end = current_time_hires();
+	uint64_t us = end - start;
+	struct bio_op_stats *st = &dev->stats.op[op];
+
+	enter_critical_section();
+	st->count++;
+	if (result < 0)
+		st->errors++;
+	else
+		st->bytes += result;
+	st->total_us += us;
+	if (us > st->max_us)
+		st->max_us = MIN(us, UINT32_MAX);
+	st->latency[bio_stat_bucket(us, BIO_STAT_LAT_BUCKETS)]++;
+	st->size[bio_stat_bucket(len / 512, BIO_STAT_SIZE_BUCKETS)]++;
+
+	/* the coarse totals older code looks at */
+	if (op == BIO_STAT_READ) {
+		dev->last_read_start_time = start / 1000;
+		dev->last_read_end_time = end / 1000;
+		dev->total_read_time += (end - start) / 1000;
+		if (result > 0)
+			dev->total_read_size += result;
+	} else if (op == BIO_STAT_WRITE) {
+		dev->last_write_start_time = start / 1000;
+		dev->last_write_end_time = end / 1000;
+		dev->total_write_time += (end - start) / 1000;
+		if (result > 0)
+			dev->total_write_size += result;
+	}
+	exit_critical_section();
+}
+
+ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_read(dev, buf, offset, len);
+
+	bio_account(dev, BIO_STAT_READ, start, len, ret);
+
+	return ret;
+}
+
+ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_read_block(dev, buf, block, count);
+
+	bio_account(dev, BIO_STAT_READ, start, (size_t)count * dev->block_size, ret);
+
+	return ret;
+}
+
+ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_write(dev, buf, offset, len);
+
+	bio_account(dev, BIO_STAT_WRITE, start, len, ret);
+
+	return ret;
+}
+
+ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_write_block(dev, buf, block, count);
+
+	bio_account(dev, BIO_STAT_WRITE, start, (size_t)count * dev->block_size, ret);
+
+	return ret;
+}
+
+ssize_t bio_readv(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_readv(dev, iov, iovcnt, offset);
+
+	bio_account(dev, BIO_STAT_READ, start, bio_iov_total(iov, MIN(iovcnt, BIO_IOV_MAX)), ret);
+
+	return ret;
+}
+
+ssize_t bio_writev(bdev_t *dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_writev(dev, iov, iovcnt, offset);
+
+	bio_account(dev, BIO_STAT_WRITE, start, bio_iov_total(iov, MIN(iovcnt, BIO_IOV_MAX)), ret);
+
+	return ret;
+}
+
+ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
+{
+	lk_bigtime_t start = current_time_hires();
+	ssize_t ret = bio_do_erase(dev, offset, len);
+
+	bio_account(dev, BIO_STAT_ERASE, start, len, ret);
+
+	return ret;
+}
+
+static void bio_queue_free(struct bio_queue *q)
+{
+	mutex_destroy(&q->lock);
+	event_destroy(&q->wakeup);
+	free(q);
+}
+
+static int bio_queue_worker(void *arg)
+{
+	struct bio_queue *q = (struct bio_queue *)arg;
+
+	for (;;) {
+		mutex_acquire(&q->lock);
+		bio_request_t *req = list_remove_head_type(&q->pending, bio_request_t, node);
+		if (req)
+			req->state = BIO_REQ_ACTIVE;
+		bool exiting = q->exiting;
+		mutex_release(&q->lock);
+
+		if (!req) {
+			if (exiting)
+				break;
+			event_wait(&q->wakeup);
+			continue;
+		}
+
+		LTRACEF("dev '%s', req %p, op %d, offset %lld, len %zu\n", req->dev->name, req, req->op, req->offset, req->len);
+
+		ssize_t result;
+		if (req->op == BIO_OP_READ)
+			result = bio_read(req->dev, req->buf, req->offset, req->len);
+		else
+			result = bio_write(req->dev, req->buf, req->offset, req->len);
+
+		/* may drop the last ref on the device, don't touch it past here */
+		bio_request_complete(req, result);
+	}
+
+	if (q->detached)
+		bio_queue_free(q);
+
+	return 0;
+}
+
+static struct bio_queue *bio_queue_create(bdev_t *dev)
+{
+	char name[32];
+	struct bio_queue *q = calloc(1, sizeof(struct bio_queue));
+	if (!q)
+		return NULL;
+
+	list_initialize(&q->pending);
+	mutex_init(&q->lock);
+	event_init(&q->wakeup, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+	snprintf(name, sizeof(name), "bio %s", dev->name);
+	q->worker = thread_create(name, &bio_queue_worker, q, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!q->worker) {
+		bio_queue_free(q);
+		return NULL;
+	}
+	thread_resume(q->worker);
+
+	return q;
+}
+
+static void bio_queue_destroy(struct bio_queue *q)
+{
+	mutex_acquire(&q->lock);
+	DEBUG_ASSERT(list_is_empty(&q->pending));
+	q->exiting = true;
+
+	/* the last ref can go with a request completed on the worker itself, which can't join itself */
+	if (current_thread == q->worker) {
+		q->detached = true;
+		mutex_release(&q->lock);
+		thread_detach(q->worker);
+		return;
+	}
+	mutex_release(&q->lock);
+
+	event_signal(&q->wakeup, false);
+	thread_join(q->worker, NULL, INFINITE_TIME);
+	bio_queue_free(q);
+}
+
+void bio_request_init(bio_request_t *req, bio_op_t op, void *buf, off_t offset, size_t len,
+                      bio_complete_t callback, void *callback_arg)
+{
+	DEBUG_ASSERT(req);
+
+	list_clear_node(&req->node);
+	req->op = op;
+	req->buf = buf;
+	req->offset = offset;
+	req->len = len;
+	req->callback = callback;
+	req->callback_arg = callback_arg;
+	req->dev = NULL;
+	req->state = BIO_REQ_IDLE;
+	req->result = 0;
+	event_init(&req->done, false, 0);
+}
+
+/* counts the new request as in flight and records how deep the device is now */
+static void bio_sample_queue_depth(bdev_t *dev)
+{
+	int depth = atomic_add(&dev->stats.inflight, 1) + 1;
+
+	enter_critical_section();
+	dev->stats.queue_depth[bio_stat_bucket(depth, BIO_STAT_QD_BUCKETS)]++;
+	exit_critical_section();
+}
+
+status_t bio_submit(bdev_t *dev, bio_request_t *req)
+{
+	LTRACEF("dev '%s', req %p, op %d, offset %lld, len %zu\n", dev->name, req, req->op, req->offset, req->len);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	if (req->state == BIO_REQ_QUEUED || req->state == BIO_REQ_ACTIVE)
+		return ERR_ALREADY_STARTED;
+	if (req->op != BIO_OP_READ && req->op != BIO_OP_WRITE)
+		return ERR_INVALID_ARGS;
+
+	/* the request holds a ref on the device until it completes */
+	bdev_inc_ref(dev);
+	req->dev = dev;
+	req->result = 0;
+	event_unsignal(&req->done);
+
+	if (dev->submit) {
+		req->state = BIO_REQ_ACTIVE;
+		bio_sample_queue_depth(dev);
+		status_t err = dev->submit(dev, req);
+		if (err < 0) {
+			atomic_add(&dev->stats.inflight, -1);
+			req->state = BIO_REQ_IDLE;
+			bdev_dec_ref(dev);
+		}
+		return err;
+	}
+
+	mutex_acquire(&bdevs->lock);
+	if (!dev->queue)
+		dev->queue = bio_queue_create(dev);
+	mutex_release(&bdevs->lock);
+
+	struct bio_queue *q = dev->queue;
+	if (!q) {
+		req->state = BIO_REQ_IDLE;
+		bdev_dec_ref(dev);
+		return ERR_NO_MEMORY;
+	}
+
+	mutex_acquire(&q->lock);
+	req->state = BIO_REQ_QUEUED;
+	bio_sample_queue_depth(dev);
+	list_add_tail(&q->pending, &req->node);
+	mutex_release(&q->lock);
+
+	event_signal(&q->wakeup, false);
+
+	return NO_ERROR;
+}
+
+status_t bio_cancel(bio_request_t *req)
+{
+	bdev_t *dev = req->dev;
+
+	/* only requests still sitting in a worker queue can be pulled back */
+	if (!dev || !dev->queue)
+		return (req->state == BIO_REQ_ACTIVE) ? ERR_NOT_SUPPORTED : ERR_NOT_VALID;
+
+	mutex_acquire(&dev->queue->lock);
+	if (req->state != BIO_REQ_QUEUED) {
+		mutex_release(&dev->queue->lock);
+		return (req->state == BIO_REQ_ACTIVE) ? ERR_ALREADY_STARTED : ERR_NOT_VALID;
+	}
+	list_delete(&req->node);
+	req->state = BIO_REQ_ACTIVE;
+	mutex_release(&dev->queue->lock);
+
+	bio_request_complete(req, ERR_CANCELLED);
+
+	return NO_ERROR;
+}
+
+ssize_t bio_wait(bio_request_t *req, lk_time_t timeout)
+{
+	if (req->state == BIO_REQ_IDLE)
+		return ERR_NOT_VALID;
+
+	status_t err = event_wait_timeout(&req->done, timeout);
+	if (err < 0)
+		return err;
+
+	return req->result;
+}
+
+void bio_request_complete(bio_request_t *req, ssize_t result)
+{
+	bdev_t *dev = req->dev;
+
+	LTRACEF("dev '%s', req %p, result %zd\n", dev->name, req, result);
+
+	DEBUG_ASSERT(req->state == BIO_REQ_ACTIVE);
+
+	req->result = result;
+	req->state = BIO_REQ_DONE;
+	atomic_add(&dev->stats.inflight, -1);
+
+	if (req->callback)
+		req->callback(req, req->callback_arg);
+
+	/* the caller may reuse or free the request as soon as this is signaled */
+	event_signal(&req->done, false);
+
+	bdev_dec_ref(dev);
+}
+
 int bio_ioctl(bdev_t *dev, int request, void *argp)
 {
 	LTRACEF("dev '%s', request %08x, argp %p\n", dev->name, request, argp);
@@ -385,6 +1032,7 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 	DEBUG_ASSERT(block_size == 512); // XXX can only deal with 512 for now
 
 	list_clear_node(&dev->node);
+	list_clear_node(&dev->hash_node);
 	dev->name = strdup(name);
 	dev->block_size = block_size;
 	dev->block_count = block_count;
@@ -397,7 +1045,14 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 	dev->write = bio_default_write;
 	dev->write_block = bio_default_write_block;
 	dev->erase = bio_default_erase;
+	dev->readv = bio_default_readv;
+	dev->writev = bio_default_writev;
+	dev->read_block_sg = NULL;
+	dev->write_block_sg = NULL;
 	dev->close = NULL;
+	dev->submit = NULL;
+	dev->queue = NULL;
+	memset(&dev->stats, 0, sizeof(dev->stats));
 }
 
 void bio_register_device(bdev_t *dev)
@@ -410,6 +1065,7 @@ void bio_register_device(bdev_t *dev)
 
 	mutex_acquire(&bdevs->lock);
 	list_add_head(&bdevs->list, &dev->node);
+	list_add_head(&bdevs->hash[hash_str_bucket(dev->name, BIO_NAME_HASH_SIZE)], &dev->hash_node);
 	mutex_release(&bdevs->lock);
 }
 
@@ -422,6 +1078,7 @@ void bio_unregister_device(bdev_t *dev)
 	// remove it from the list
 	mutex_acquire(&bdevs->lock);
 	list_delete(&dev->node);
+	list_delete(&dev->hash_node);
 	mutex_release(&bdevs->lock);
 
 	bdev_dec_ref(dev); // remove the ref the list used to have
@@ -438,11 +1095,125 @@ void bio_dump_devices(void)
 	mutex_release(&bdevs->lock);
 }
 
+static const char *bio_stat_op_name[BIO_STAT_OPS] = { "read", "write", "erase" };
+
+static void bio_print_hist(const char *label, const uint32_t *hist, uint buckets, uint shift, bool kv)
+{
+	uint i;
+
+	if (kv) {
+		printf(" %s=", label);
+		for (i = 0; i < buckets; i++)
+			printf("%s%u", i ? "," : "", hist[i]);
+		return;
+	}
+
+	printf("\t\t%s:", label);
+	for (i = 0; i < buckets; i++) {
+		if (hist[i])
+			printf(" [%llu]%u", 1ULL << (i + shift), hist[i]);
+	}
+	printf("\n");
+}
+
+static void bio_dump_dev_stats(bdev_t *dev, bool kv)
+{
+	struct bio_stats stats;
+	uint op;
+
+	/* snapshot so a single line is self consistent */
+	enter_critical_section();
+	stats = dev->stats;
+	exit_critical_section();
+
+	if (!kv)
+		printf("\t%s, inflight %d\n", dev->name, stats.inflight);
+
+	for (op = 0; op < BIO_STAT_OPS; op++) {
+		struct bio_op_stats *st = &stats.op[op];
+
+		if (kv) {
+			printf("bio_kpi dev=%s op=%s count=%u errors=%u bytes=%llu total_us=%llu max_us=%u",
+			       dev->name, bio_stat_op_name[op], st->count, st->errors,
+			       (unsigned long long)st->bytes, (unsigned long long)st->total_us, st->max_us);
+			bio_print_hist("lat_us_log2", st->latency, BIO_STAT_LAT_BUCKETS, 0, true);
+			bio_print_hist("size_log2", st->size, BIO_STAT_SIZE_BUCKETS, 9, true);
+			printf("\n");
+			continue;
+		}
+
+		if (st->count == 0)
+			continue;
+		printf("\t    %s: count %u, errors %u, bytes %llu, avg %llu us, max %u us\n",
+		       bio_stat_op_name[op], st->count, st->errors, (unsigned long long)st->bytes,
+		       (unsigned long long)(st->total_us / st->count), st->max_us);
+		bio_print_hist("latency us", st->latency, BIO_STAT_LAT_BUCKETS, 0, false);
+		bio_print_hist("size bytes", st->size, BIO_STAT_SIZE_BUCKETS, 9, false);
+	}
+
+	if (kv) {
+		printf("bio_kpi dev=%s op=queue inflight=%d", dev->name, stats.inflight);
+		bio_print_hist("qd_log2", stats.queue_depth, BIO_STAT_QD_BUCKETS, 0, true);
+		printf("\n");
+	} else {
+		bio_print_hist("queue depth", stats.queue_depth, BIO_STAT_QD_BUCKETS, 0, false);
+	}
+}
+
+void bio_dump_stats(const char *name, bool kv)
+{
+	bdev_t *entry;
+
+	if (!kv)
+		printf("block device stats:\n");
+
+	mutex_acquire(&bdevs->lock);
+	list_for_every_entry(&bdevs->list, entry, bdev_t, node) {
+		if (!name || !strcmp(name, entry->name))
+			bio_dump_dev_stats(entry, kv);
+	}
+	mutex_release(&bdevs->lock);
+}
+
+void bio_reset_stats(const char *name)
+{
+	bdev_t *entry;
+
+	mutex_acquire(&bdevs->lock);
+	list_for_every_entry(&bdevs->list, entry, bdev_t, node) {
+		if (name && strcmp(name, entry->name))
+			continue;
+		/* requests in flight still have to be retired, keep their count */
+		enter_critical_section();
+		int inflight = entry->stats.inflight;
+		memset(&entry->stats, 0, sizeof(entry->stats));
+		entry->stats.inflight = inflight;
+		exit_critical_section();
+	}
+	mutex_release(&bdevs->lock);
+}
+
+void bio_list_kpi(void)
+{
+	bdev_t *entry;
+
+	printf("block device kpi:\n");
+	mutex_acquire(&bdevs->lock);
+	list_for_every_entry(&bdevs->list, entry, bdev_t, node) {
+		printf("\t%s, read %lld bytes in %u msecs, write %lld bytes in %u msecs\n", entry->name,
+		       (long long)entry->total_read_size, (uint)entry->total_read_time,
+		       (long long)entry->total_write_size, (uint)entry->total_write_time);
+	}
+	mutex_release(&bdevs->lock);
+}
+
 static void bio_init(uint level)
 {
 	bdevs = malloc(sizeof(*bdevs));
 
 	list_initialize(&bdevs->list);
+	for (uint i = 0; i < BIO_NAME_HASH_SIZE; i++)
+		list_initialize(&bdevs->hash[i]);
 	mutex_init(&bdevs->lock);
 }
 
@@ -27,6 +27,9 @@
 #include <lib/console.h>
 #include <lib/bio.h>
 #include <lib/partition.h>
+#if WITH_LIB_BCACHE
+#include <lib/bcache.h>
+#endif
 #include <platform.h>
 
 #if defined(WITH_LIB_CONSOLE)
@@ -51,6 +54,11 @@ usage:
 		printf("%s erase <device> <offset> <len>\n", argv[0].str);
 		printf("%s ioctl <device> <request> <arg>\n", argv[0].str);
 		printf("%s remove <device>\n", argv[0].str);
+		printf("%s stats [reset] [device]\n", argv[0].str);
+		printf("%s kpi [device]\n", argv[0].str);
+#if WITH_LIB_BCACHE
+		printf("%s cache\n", argv[0].str);
+#endif
 #if WITH_LIB_PARTITION
 		printf("%s partscan <device> [offset]\n", argv[0].str);
 #endif
@@ -165,6 +173,18 @@ usage:
 
 		bio_unregister_device(dev);
 		bio_close(dev);
+	} else if (!strcmp(argv[1].str, "stats")) {
+		if (argc > 2 && !strcmp(argv[2].str, "reset"))
+			bio_reset_stats((argc > 3) ? argv[3].str : NULL);
+		else
+			bio_dump_stats((argc > 2) ? argv[2].str : NULL, false);
+	} else if (!strcmp(argv[1].str, "kpi")) {
+		/* one key=value line per device and op, for scripts scraping the console */
+		bio_dump_stats((argc > 2) ? argv[2].str : NULL, true);
+#if WITH_LIB_BCACHE
+	} else if (!strcmp(argv[1].str, "cache")) {
+		bcache_dump_all();
+#endif
 #if WITH_LIB_PARTITION
 	} else if (!strcmp(argv[1].str, "partscan")) {
 		if (argc < 3) {
@@ -66,6 +66,20 @@ static ssize_t subdev_write_block(struct bdev *_dev, const void *buf, bnum_t blo
 	return bio_write_block(subdev->parent, buf, block + subdev->offset, count);
 }
 
+static ssize_t subdev_readv(struct bdev *_dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	return bio_readv(subdev->parent, iov, iovcnt, offset + subdev->offset * subdev->dev.block_size);
+}
+
+static ssize_t subdev_writev(struct bdev *_dev, const bio_iovec_t *iov, uint iovcnt, off_t offset)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	return bio_writev(subdev->parent, iov, iovcnt, offset + subdev->offset * subdev->dev.block_size);
+}
+
 static ssize_t subdev_erase(struct bdev *_dev, off_t offset, size_t len)
 {
 	subdev_t *subdev = (subdev_t *)_dev;
@@ -104,6 +118,8 @@ status_t bio_publish_subdevice(const char *parent_dev, const char *subdev, bnum_
 	sub->dev.write = &subdev_write;
 	sub->dev.write_block = &subdev_write_block;
 	sub->dev.erase = &subdev_erase;
+	sub->dev.readv = &subdev_readv;
+	sub->dev.writev = &subdev_writev;
 	sub->dev.close = &subdev_close;
 
 	bio_register_device(&sub->dev);
@@ -5,6 +5,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_SRCS += \
 	$(LOCAL_DIR)/adler32.c \
 	$(LOCAL_DIR)/crc32.c \
+	$(LOCAL_DIR)/sha256.c \
 	$(LOCAL_DIR)/debug.c
 
 include make/module.mk
@@ -13,6 +13,15 @@ static struct {
 	struct device *dev;
 } mount_table[_VOLUMES];
 
+/* FILE is a FIL plus the cluster link map that lets reads and seeks skip the FAT */
+struct ffs_file {
+	FIL fil;
+	DWORD *clmt;
+};
+
+/* DWORDs in the first link map try, 2 per fragment plus 2, grown once if the file is more fragmented */
+#define FFS_CLMT_INITIAL_SIZE 34
+
 status_t ffs_mount(size_t index, struct device *dev)
 {
 	FRESULT res;
@@ -92,7 +101,7 @@ DSTATUS disk_status(BYTE pdrv)
 	return RES_OK;
 }
 
-DRESULT disk_read(BYTE pdrv, BYTE* buf, DWORD sector, BYTE count)
+DRESULT disk_read(BYTE pdrv, BYTE* buf, DWORD sector, UINT count)
 {
 	ssize_t ret;
 
@@ -108,7 +117,7 @@ DRESULT disk_read(BYTE pdrv, BYTE* buf, DWORD sector, BYTE count)
 }
 
 #if	_READONLY == 0
-DRESULT disk_write(BYTE pdrv, const BYTE* buf, DWORD sector, BYTE count)
+DRESULT disk_write(BYTE pdrv, const BYTE* buf, DWORD sector, UINT count)
 {
 	ssize_t ret;
 
@@ -182,16 +191,47 @@ DWORD get_fattime(void)
 			;
 }
 
+#if _USE_FASTSEEK
+/* build the link map of a file opened for reading, it is left in normal mode if that fails */
+static void ffs_build_clmt(struct ffs_file *file)
+{
+	DWORD size = FFS_CLMT_INITIAL_SIZE;
+	FRESULT res;
+
+	for (;;) {
+		file->clmt = malloc(size * sizeof(DWORD));
+		if (!file->clmt)
+			return;
+
+		file->clmt[0] = size;
+		file->fil.cltbl = file->clmt;
+		res = f_lseek(&file->fil, CREATE_LINKMAP);
+		if (res == FR_OK)
+			return;
+
+		/* too small, the required size was left in the first entry */
+		size = file->clmt[0];
+		file->fil.cltbl = NULL;
+		free(file->clmt);
+		file->clmt = NULL;
+		if (res != FR_NOT_ENOUGH_CORE || size <= FFS_CLMT_INITIAL_SIZE)
+			return;
+	}
+}
+#endif
+
 FILE *fopen(const char *filename, const char *mode)
 {
 	FRESULT res;
 	BYTE flags = 0;
+	struct ffs_file *file;
 	FIL *fil;
 	int i;
 	
-	fil = malloc(sizeof(FIL));
-	if (!fil)
+	file = calloc(1, sizeof(struct ffs_file));
+	if (!file)
 		return NULL;
+	fil = &file->fil;
 	
 	for (i=0; mode[i] != 0; i++) {
 		switch (mode[i]) {
@@ -211,23 +251,30 @@ FILE *fopen(const char *filename, const char *mode)
 	
 	res = f_open(fil, filename, flags);
 	if (res != FR_OK) {
-		free(fil);
+		free(file);
 		return NULL;
 	}
 
-	return (FILE *) fil;
+#if _USE_FASTSEEK
+	/* a file in fast seek mode cannot grow, only map the ones that are read */
+	if (flags == FA_READ)
+		ffs_build_clmt(file);
+#endif
+
+	return (FILE *) file;
 }
 
 int fclose(FILE *stream)
 {
 	FRESULT res;
-	FIL *fil = (FIL *) stream;
+	struct ffs_file *file = (struct ffs_file *) stream;
 
-	res = f_close(fil);
+	res = f_close(&file->fil);
 	if (res != FR_OK)
 		return -1;
 	
-	free(fil);
+	free(file->clmt);
+	free(file);
 	return 0;
 }
 
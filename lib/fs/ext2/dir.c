@@ -30,6 +30,324 @@
 
 #define LOCAL_TRACE 0
 
+/* htree hashes, matching what ext3/4 store in dx_entry.hash */
+#define DX_TEA_DELTA 0x9E3779B9
+
+#define DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define DX_ROUND(f, a, b, c, d, x, s) \
+	(a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+#define DX_K1 0
+#define DX_K2 013240474631U
+#define DX_K3 015666365641U
+
+static uint32_t dx_hack_hash(const char *name, size_t len, bool unsigned_char)
+{
+	uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+	for (; len > 0; len--, name++) {
+		int c = unsigned_char ? (int)(unsigned char)*name : (int)(signed char)*name;
+
+		hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+/* pack up to num words of the name, padding with the length */
+static void dx_str2hashbuf(const char *msg, size_t len, uint32_t *buf, int num, bool unsigned_char)
+{
+	uint32_t pad, val;
+	size_t i;
+
+	pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > (size_t)num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		int c = unsigned_char ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+static void dx_half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* round 1 */
+	DX_ROUND(DX_F, a, b, c, d, in[0] + DX_K1, 3);
+	DX_ROUND(DX_F, d, a, b, c, in[1] + DX_K1, 7);
+	DX_ROUND(DX_F, c, d, a, b, in[2] + DX_K1, 11);
+	DX_ROUND(DX_F, b, c, d, a, in[3] + DX_K1, 19);
+	DX_ROUND(DX_F, a, b, c, d, in[4] + DX_K1, 3);
+	DX_ROUND(DX_F, d, a, b, c, in[5] + DX_K1, 7);
+	DX_ROUND(DX_F, c, d, a, b, in[6] + DX_K1, 11);
+	DX_ROUND(DX_F, b, c, d, a, in[7] + DX_K1, 19);
+
+	/* round 2 */
+	DX_ROUND(DX_G, a, b, c, d, in[1] + DX_K2, 3);
+	DX_ROUND(DX_G, d, a, b, c, in[3] + DX_K2, 5);
+	DX_ROUND(DX_G, c, d, a, b, in[5] + DX_K2, 9);
+	DX_ROUND(DX_G, b, c, d, a, in[7] + DX_K2, 13);
+	DX_ROUND(DX_G, a, b, c, d, in[0] + DX_K2, 3);
+	DX_ROUND(DX_G, d, a, b, c, in[2] + DX_K2, 5);
+	DX_ROUND(DX_G, c, d, a, b, in[4] + DX_K2, 9);
+	DX_ROUND(DX_G, b, c, d, a, in[6] + DX_K2, 13);
+
+	/* round 3 */
+	DX_ROUND(DX_H, a, b, c, d, in[3] + DX_K3, 3);
+	DX_ROUND(DX_H, d, a, b, c, in[7] + DX_K3, 9);
+	DX_ROUND(DX_H, c, d, a, b, in[2] + DX_K3, 11);
+	DX_ROUND(DX_H, b, c, d, a, in[6] + DX_K3, 15);
+	DX_ROUND(DX_H, a, b, c, d, in[1] + DX_K3, 3);
+	DX_ROUND(DX_H, d, a, b, c, in[5] + DX_K3, 9);
+	DX_ROUND(DX_H, c, d, a, b, in[0] + DX_K3, 11);
+	DX_ROUND(DX_H, b, c, d, a, in[4] + DX_K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+static void dx_tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+	uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+	int n;
+
+	for (n = 0; n < 16; n++) {
+		sum += DX_TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	}
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+static int dx_hash(ext2_t *ext2, uint hash_version, const char *name, size_t len, uint32_t *hash)
+{
+	uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	uint32_t in[8];
+	bool unsigned_char = false;
+	uint32_t h;
+
+	/* an all zero seed means the default one */
+	if (ext2->sb.s_hash_seed[0] | ext2->sb.s_hash_seed[1] | ext2->sb.s_hash_seed[2] | ext2->sb.s_hash_seed[3])
+		memcpy(buf, ext2->sb.s_hash_seed, sizeof(buf));
+
+	switch (hash_version) {
+		case EXT2_HASH_LEGACY_UNSIGNED:
+			unsigned_char = true;
+		/* fallthrough */
+		case EXT2_HASH_LEGACY:
+			h = dx_hack_hash(name, len, unsigned_char);
+			break;
+		case EXT2_HASH_HALF_MD4_UNSIGNED:
+			unsigned_char = true;
+		/* fallthrough */
+		case EXT2_HASH_HALF_MD4:
+			do {
+				dx_str2hashbuf(name, len, in, 8, unsigned_char);
+				dx_half_md4_transform(buf, in);
+				name += MIN(len, 32);
+				len -= MIN(len, 32);
+			} while (len > 0);
+			h = buf[1];
+			break;
+		case EXT2_HASH_TEA_UNSIGNED:
+			unsigned_char = true;
+		/* fallthrough */
+		case EXT2_HASH_TEA:
+			do {
+				dx_str2hashbuf(name, len, in, 4, unsigned_char);
+				dx_tea_transform(buf, in);
+				name += MIN(len, 16);
+				len -= MIN(len, 16);
+			} while (len > 0);
+			h = buf[0];
+			break;
+		default:
+			return -1;
+	}
+
+	/* bit 0 flags hash collisions continuing in the next block, and the top hash marks EOF */
+	h &= ~1U;
+	if (h == (EXT2_HTREE_EOF_32BIT << 1))
+		h = (EXT2_HTREE_EOF_32BIT - 1) << 1;
+
+	*hash = h;
+	return 0;
+}
+
+/* read one whole block of the directory */
+static int ext2_dir_read_block(ext2_t *ext2, struct ext2_inode *dir_inode, struct ext2_block_run *extent_cache,
+                               uint8_t *buf, uint file_blocknum)
+{
+	int err = ext2_read_inode(ext2, dir_inode, extent_cache, buf,
+	                          (off_t)file_blocknum * EXT2_BLOCK_SIZE(ext2->sb), EXT2_BLOCK_SIZE(ext2->sb));
+
+	return (err == (int)EXT2_BLOCK_SIZE(ext2->sb)) ? 0 : -1;
+}
+
+/* walk through the directory entries of one block, looking for the one that matches */
+static bool ext2_dir_block_lookup(ext2_t *ext2, const uint8_t *buf, const char *name, size_t namelen, inodenum_t *inum)
+{
+	const struct ext2_dir_entry_2 *ent;
+	uint pos = 0;
+
+	while (pos + EXT2_DIR_REC_LEN(0) <= EXT2_BLOCK_SIZE(ext2->sb)) {
+		ent = (const struct ext2_dir_entry_2 *)&buf[pos];
+
+		LTRACEF("ent %d: inode 0x%x, reclen %d, namelen %d\n",
+		        pos, LE32(ent->inode), LE16(ent->rec_len), ent->name_len/* , ent->name*/);
+
+		/* sanity check the record length */
+		if (LE16(ent->rec_len) == 0)
+			break;
+
+		if (LE32(ent->inode) != 0 && ent->name_len == namelen && memcmp(name, ent->name, ent->name_len) == 0) {
+			// match
+			*inum = LE32(ent->inode);
+			LTRACEF("match: inode %d\n", *inum);
+			return true;
+		}
+
+		pos += ROUNDUP(LE16(ent->rec_len), 4);
+	}
+
+	return false;
+}
+
+/*
+ * look the name up through the htree index, reading only the leaf block its
+ * hash lands in. returns 1 if found, 0 if it isn't there, < 0 if the index
+ * can't answer and the directory has to be scanned.
+ */
+static int ext2_dx_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, struct ext2_block_run *extent_cache,
+                          uint8_t *buf, const char *name, size_t namelen, inodenum_t *inum)
+{
+	const size_t block_size = EXT2_BLOCK_SIZE(ext2->sb);
+	const struct ext2_dx_entry *ent;
+	uint32_t hash;
+	uint32_t parent_next = 0; // hash of the entry after ours in the levels above, if any
+	bool parent_has_next = false;
+	uint count, i, level, levels;
+	int err;
+
+	uint8_t *node = malloc(block_size);
+	if (!node)
+		return ERR_NO_MEMORY;
+
+	/* the root follows the fake "." and ".." entries */
+	err = ext2_dir_read_block(ext2, dir_inode, extent_cache, node, 0);
+	if (err < 0)
+		goto out;
+
+	err = -1;
+	const struct ext2_dir_entry_2 *dot = (const struct ext2_dir_entry_2 *)node;
+	const struct ext2_dx_root_info *info = (const struct ext2_dx_root_info *)(node + 2 * EXT2_DIR_REC_LEN(1));
+	if (LE16(dot->rec_len) != EXT2_DIR_REC_LEN(1) || info->reserved_zero != 0 ||
+	        info->info_length < sizeof(*info) || info->indirect_levels > 2)
+		goto out;
+
+	uint hash_version = info->hash_version;
+	if (hash_version <= EXT2_HASH_TEA && (ext2->sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH))
+		hash_version += EXT2_HASH_LEGACY_UNSIGNED;
+	if (dx_hash(ext2, hash_version, name, namelen, &hash) < 0)
+		goto out;
+
+	LTRACEF("name '%s', hash version %u, hash 0x%x, levels %u\n", name, hash_version, hash, info->indirect_levels);
+
+	size_t entries_off = 2 * EXT2_DIR_REC_LEN(1) + info->info_length;
+	levels = info->indirect_levels;
+	for (level = 0; ; level++) {
+		const struct ext2_dx_countlimit *cl = (const struct ext2_dx_countlimit *)(node + entries_off);
+		uint limit = LE16(cl->limit);
+
+		count = LE16(cl->count);
+		ent = (const struct ext2_dx_entry *)cl;
+		if (count == 0 || count > limit || entries_off + limit * sizeof(*ent) > block_size)
+			goto out;
+
+		/* entry 0 has no hash and takes everything below entry 1 */
+		uint lo = 1, hi = count;
+		while (lo < hi) {
+			uint mid = lo + (hi - lo) / 2;
+
+			if (LE32(ent[mid].hash) > hash)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		i = lo - 1;
+
+		if (level == levels)
+			break;
+
+		if (i + 1 < count) {
+			parent_next = LE32(ent[i + 1].hash);
+			parent_has_next = true;
+		}
+
+		/* interior nodes sit behind a fake empty entry spanning the block */
+		err = ext2_dir_read_block(ext2, dir_inode, extent_cache, node, LE32(ent[i].block) & 0x0fffffff);
+		if (err < 0)
+			goto out;
+		err = -1;
+		entries_off = EXT2_DIR_REC_LEN(0);
+	}
+
+	for (;;) {
+		err = ext2_dir_read_block(ext2, dir_inode, extent_cache, buf, LE32(ent[i].block) & 0x0fffffff);
+		if (err < 0)
+			goto out;
+
+		if (ext2_dir_block_lookup(ext2, buf, name, namelen, inum)) {
+			err = 1;
+			goto out;
+		}
+
+		/* names whose hashes collide may straddle a split, flagged by bit 0 of the next hash */
+		bool has_next = (i + 1 < count) || parent_has_next;
+		uint32_t next = (i + 1 < count) ? LE32(ent[i + 1].hash) : parent_next;
+		if (!has_next || !(next & 1) || (next & ~1U) != hash) {
+			err = 0;
+			goto out;
+		}
+
+		/* continuing into the next index block is left to the linear scan */
+		if (i + 1 >= count) {
+			err = -1;
+			goto out;
+		}
+		i++;
+	}
+
+out:
+	free(node);
+	return err;
+}
+
 /* read in the dir, look for the entry */
 static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const char *name, inodenum_t *inum)
 {
@@ -37,43 +355,38 @@ static int ext2_dir_lookup(ext2_t *ext2, struct ext2_inode *dir_inode, const cha
 	int err;
 	uint8_t *buf;
 	size_t namelen = strlen(name);
+	struct ext2_block_run extent_cache = { 0 };
 
 	if (!S_ISDIR(dir_inode->i_mode))
 		return ERR_NOT_DIR;
 
 	buf = malloc(EXT2_BLOCK_SIZE(ext2->sb));
+	if (!buf)
+		return ERR_NO_MEMORY;
+
+	/* hashed directories point straight at the block the name has to be in */
+	if ((ext2->sb.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) && (dir_inode->i_flags & EXT2_INDEX_FL)) {
+		err = ext2_dx_lookup(ext2, dir_inode, &extent_cache, buf, name, namelen, inum);
+		if (err >= 0) {
+			free(buf);
+			return (err > 0) ? 1 : -1;
+		}
+
+		LTRACEF("htree lookup failed with %d, scanning\n", err);
+	}
 
 	file_blocknum = 0;
 	for (;;) {
 		/* read in the offset */
-		err = ext2_read_inode(ext2, dir_inode, buf, file_blocknum * EXT2_BLOCK_SIZE(ext2->sb), EXT2_BLOCK_SIZE(ext2->sb));
-		if (err <= 0) {
+		err = ext2_dir_read_block(ext2, dir_inode, &extent_cache, buf, file_blocknum);
+		if (err < 0) {
 			free(buf);
 			return -1;
 		}
 
-		/* walk through the directory entries, looking for the one that matches */
-		struct ext2_dir_entry_2 *ent;
-		uint pos = 0;
-		while (pos < EXT2_BLOCK_SIZE(ext2->sb)) {
-			ent = (struct ext2_dir_entry_2 *)&buf[pos];
-
-			LTRACEF("ent %d:%d: inode 0x%x, reclen %d, namelen %d\n",
-			        file_blocknum, pos, LE32(ent->inode), LE16(ent->rec_len), ent->name_len/* , ent->name*/);
-
-			/* sanity check the record length */
-			if (LE16(ent->rec_len) == 0)
-				break;
-
-			if (ent->name_len == namelen && memcmp(name, ent->name, ent->name_len) == 0) {
-				// match
-				*inum = LE32(ent->inode);
-				LTRACEF("match: inode %d\n", *inum);
-				free(buf);
-				return 1;
-			}
-
-			pos += ROUNDUP(LE16(ent->rec_len), 4);
+		if (ext2_dir_block_lookup(ext2, buf, name, namelen, inum)) {
+			free(buf);
+			return 1;
 		}
 
 		file_blocknum++;
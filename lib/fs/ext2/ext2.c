@@ -30,6 +30,16 @@
 
 #define LOCAL_TRACE 0
 
+/* incompat features we can read through, ro_compat ones never stop a read-only mount */
+#define EXT2_FEATURE_INCOMPAT_READ_SUPP (EXT2_FEATURE_INCOMPAT_FILETYPE | \
+                                         EXT3_FEATURE_INCOMPAT_RECOVER | \
+                                         EXT4_FEATURE_INCOMPAT_EXTENTS | \
+                                         EXT4_FEATURE_INCOMPAT_64BIT | \
+                                         EXT4_FEATURE_INCOMPAT_MMP | \
+                                         EXT4_FEATURE_INCOMPAT_FLEX_BG | \
+                                         EXT4_FEATURE_INCOMPAT_CSUM_SEED | \
+                                         EXT4_FEATURE_INCOMPAT_LARGEDIR)
+
 static void endian_swap_superblock(struct ext2_super_block *sb)
 {
 	LE32SWAP(sb->s_inodes_count);
@@ -71,6 +81,15 @@ static void endian_swap_superblock(struct ext2_super_block *sb)
 	LE32SWAP(sb->s_last_orphan);
 	LE32SWAP(sb->s_default_mount_opts);
 	LE32SWAP(sb->s_first_meta_bg);
+
+	/* htree and ext4 stuff */
+	LE32SWAP(sb->s_hash_seed[0]);
+	LE32SWAP(sb->s_hash_seed[1]);
+	LE32SWAP(sb->s_hash_seed[2]);
+	LE32SWAP(sb->s_hash_seed[3]);
+	LE16SWAP(sb->s_desc_size);
+	LE32SWAP(sb->s_blocks_count_hi);
+	LE32SWAP(sb->s_flags);
 }
 
 static void endian_swap_inode(struct ext2_inode *inode)
@@ -130,7 +149,10 @@ int ext2_mount(bdev_t *dev, fscookie *cookie)
 	}
 
 	/* calculate group count, rounded up */
-	ext2->s_group_count = (ext2->sb.s_blocks_count + ext2->sb.s_blocks_per_group - 1) / ext2->sb.s_blocks_per_group;
+	uint64_t blocks_count = ext2->sb.s_blocks_count;
+	if (ext2->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT)
+		blocks_count |= (uint64_t)ext2->sb.s_blocks_count_hi << 32;
+	ext2->s_group_count = (blocks_count - ext2->sb.s_first_data_block + ext2->sb.s_blocks_per_group - 1) / ext2->sb.s_blocks_per_group;
 
 	/* print some info */
 	LTRACEF("rev level %d\n", ext2->sb.s_rev_level);
@@ -139,7 +161,8 @@ int ext2_mount(bdev_t *dev, fscookie *cookie)
 	LTRACEF("ro compat features 0x%x\n", ext2->sb.s_feature_ro_compat);
 	LTRACEF("block size %d\n", EXT2_BLOCK_SIZE(ext2->sb));
 	LTRACEF("inode size %d\n", EXT2_INODE_SIZE(ext2->sb));
-	LTRACEF("block count %d\n", ext2->sb.s_blocks_count);
+	LTRACEF("group desc size %d\n", EXT2_DESC_SIZE(ext2->sb));
+	LTRACEF("block count %llu\n", (unsigned long long)blocks_count);
 	LTRACEF("blocks per group %d\n", ext2->sb.s_blocks_per_group);
 	LTRACEF("group count %d\n", ext2->s_group_count);
 	LTRACEF("inodes per group %d\n", ext2->sb.s_inodes_per_group);
@@ -150,25 +173,54 @@ int ext2_mount(bdev_t *dev, fscookie *cookie)
 		return err;
 	}
 
-	/* make sure it doesn't have any ro features we don't support */
-	if (ext2->sb.s_feature_ro_compat & ~(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER|EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+	/* make sure it doesn't have any incompat features we don't understand */
+	if (ext2->sb.s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_READ_SUPP) {
 		err = -3;
 		return err;
 	}
 
-	/* read in all the group descriptors */
+	if (ext2->sb.s_feature_incompat & EXT3_FEATURE_INCOMPAT_RECOVER)
+		dprintf(INFO, "ext2: journal needs recovery, reading without replaying it\n");
+
+	/* 64bit descriptors are at least 64 bytes and a power of two */
+	size_t desc_size = EXT2_DESC_SIZE(ext2->sb);
+	if ((ext2->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) &&
+	        (desc_size < EXT4_MIN_DESC_SIZE_64BIT || desc_size > EXT4_MAX_DESC_SIZE || (desc_size & (desc_size - 1)))) {
+		err = -3;
+		return err;
+	}
+
+	/*
+	 * read in all the group descriptors, packed in the blocks after the superblock.
+	 * flex_bg only moves the bitmaps and inode tables, which the descriptors point at.
+	 */
+	size_t gdt_len = desc_size * ext2->s_group_count;
+	uint8_t *gdt = malloc(gdt_len);
 	ext2->gd = malloc(sizeof(struct ext2_group_desc) * ext2->s_group_count);
-	err = bio_read(ext2->dev, (void *)ext2->gd,
-	               (EXT2_BLOCK_SIZE(ext2->sb) == 4096) ? 4096 : 2048,
-	               sizeof(struct ext2_group_desc) * ext2->s_group_count);
-	if (err < 0) {
+	if (!gdt || !ext2->gd) {
 		err = -4;
-		return err;
+		goto err_gd;
+	}
+
+	ssize_t rc = bio_read(ext2->dev, gdt, (off_t)(ext2->sb.s_first_data_block + 1) * EXT2_BLOCK_SIZE(ext2->sb), gdt_len);
+	if (rc < (ssize_t)gdt_len) {
+		err = -4;
+		goto err_gd;
 	}
 
 	int i;
 	for (i=0; i < ext2->s_group_count; i++) {
+		const struct ext4_group_desc *desc = (const struct ext4_group_desc *)(gdt + i * desc_size);
+
+		memcpy(&ext2->gd[i], desc, sizeof(struct ext2_group_desc));
 		endian_swap_group_desc(&ext2->gd[i]);
+
+		/* inode tables are read through the block cache, which takes 32-bit block numbers */
+		if (desc_size >= EXT4_MIN_DESC_SIZE_64BIT && desc->bg_inode_table_hi != 0) {
+			err = -4;
+			goto err_gd;
+		}
+
 		LTRACEF("group %d:\n", i);
 		LTRACEF("\tblock bitmap %d\n", ext2->gd[i].bg_block_bitmap);
 		LTRACEF("\tinode bitmap %d\n", ext2->gd[i].bg_inode_bitmap);
@@ -177,9 +229,15 @@ int ext2_mount(bdev_t *dev, fscookie *cookie)
 		LTRACEF("\tfree inodes %d\n", ext2->gd[i].bg_free_inodes_count);
 		LTRACEF("\tused dirs %d\n", ext2->gd[i].bg_used_dirs_count);
 	}
+	free(gdt);
 
 	/* initialize the block cache */
-	ext2->cache = bcache_create(ext2->dev, EXT2_BLOCK_SIZE(ext2->sb), 4);
+	ext2->cache = bcache_create(ext2->dev, EXT2_BLOCK_SIZE(ext2->sb), EXT2_BCACHE_BLOCKS);
+	if (ext2->cache == NULL) {
+		free(ext2->gd);
+		err = -5;
+		goto err;
+	}
 
 	/* load the first inode */
 	err = ext2_load_inode(ext2, EXT2_ROOT_INO, &ext2->root_inode);
@@ -192,6 +250,11 @@ int ext2_mount(bdev_t *dev, fscookie *cookie)
 
 	return 0;
 
+err_gd:
+	free(gdt);
+	free(ext2->gd);
+	goto err;
+
 err:
 	LTRACEF("exiting with err code %d\n", err);
 
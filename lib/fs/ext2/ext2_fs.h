@@ -82,6 +82,43 @@ struct ext2_group_desc
 	uint32_t	bg_reserved[3];
 };
 
+/*
+ * Structure of a blocks group descriptor with the ext4 64bit feature,
+ * s_desc_size bytes of which the first 32 match ext2_group_desc
+ */
+struct ext4_group_desc
+{
+	uint32_t	bg_block_bitmap_lo;	/* Blocks bitmap block */
+	uint32_t	bg_inode_bitmap_lo;	/* Inodes bitmap block */
+	uint32_t	bg_inode_table_lo;	/* Inodes table block */
+	uint16_t	bg_free_blocks_count_lo;/* Free blocks count */
+	uint16_t	bg_free_inodes_count_lo;/* Free inodes count */
+	uint16_t	bg_used_dirs_count_lo;	/* Directories count */
+	uint16_t	bg_flags;		/* EXT4_BG_flags (INODE_UNINIT, etc) */
+	uint32_t	bg_exclude_bitmap_lo;	/* Exclude bitmap for snapshots */
+	uint16_t	bg_block_bitmap_csum_lo;/* crc32c(s_uuid+grp_num+bbitmap) LE */
+	uint16_t	bg_inode_bitmap_csum_lo;/* crc32c(s_uuid+grp_num+ibitmap) LE */
+	uint16_t	bg_itable_unused_lo;	/* Unused inodes count */
+	uint16_t	bg_checksum;		/* crc16(sb_uuid+group+desc) */
+	uint32_t	bg_block_bitmap_hi;	/* Blocks bitmap block MSB */
+	uint32_t	bg_inode_bitmap_hi;	/* Inodes bitmap block MSB */
+	uint32_t	bg_inode_table_hi;	/* Inodes table block MSB */
+	uint16_t	bg_free_blocks_count_hi;/* Free blocks count MSB */
+	uint16_t	bg_free_inodes_count_hi;/* Free inodes count MSB */
+	uint16_t	bg_used_dirs_count_hi;	/* Directories count MSB */
+	uint16_t	bg_itable_unused_hi;	/* Unused inodes count MSB */
+	uint32_t	bg_exclude_bitmap_hi;	/* Exclude bitmap block MSB */
+	uint16_t	bg_block_bitmap_csum_hi;/* crc32c(s_uuid+grp_num+bbitmap) BE */
+	uint16_t	bg_inode_bitmap_csum_hi;/* crc32c(s_uuid+grp_num+ibitmap) BE */
+	uint32_t	bg_reserved;
+};
+
+#define EXT2_MIN_DESC_SIZE		32
+#define EXT4_MIN_DESC_SIZE_64BIT	64
+#define EXT4_MAX_DESC_SIZE		EXT2_MIN_BLOCK_SIZE
+#define EXT2_DESC_SIZE(s)	(((s).s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) ? \
+				 (s).s_desc_size : EXT2_MIN_DESC_SIZE)
+
 /*
  * Macro-instructions used to manage group descriptors
  */
@@ -166,6 +203,14 @@ struct ext2_inode {
 #define i_gid_high	osd2.linux2.l_i_gid_high
 #define i_reserved2	osd2.linux2.l_i_reserved2
 
+/*
+ * Inode flags
+ */
+#define EXT2_INDEX_FL			0x00001000 /* hash-indexed directory */
+#define EXT4_HUGE_FILE_FL		0x00040000 /* Set to each huge file */
+#define EXT4_EXTENTS_FL			0x00080000 /* Inode uses extents */
+#define EXT4_INLINE_DATA_FL		0x10000000 /* Inode has inline data */
+
 /*
  * File system states
  */
@@ -282,13 +327,38 @@ struct ext2_super_block {
 	uint32_t	s_last_orphan;		/* start of list of inodes to delete */
 	uint32_t	s_hash_seed[4];		/* HTREE hash seed */
 	uint8_t	s_def_hash_version;	/* Default hash version to use */
-	uint8_t	s_reserved_char_pad;
-	uint16_t	s_reserved_word_pad;
+	uint8_t	s_jnl_backup_type;
+	uint16_t	s_desc_size;		/* size of group descriptor */
 	uint32_t	s_default_mount_opts;
  	uint32_t	s_first_meta_bg; 	/* First metablock block group */
-	uint32_t	s_reserved[190];	/* Padding to the end of the block */
+	/*
+	 * ext4 fields, valid if the matching features are set.
+	 */
+	uint32_t	s_mkfs_time;		/* When the filesystem was created */
+	uint32_t	s_jnl_blocks[17];	/* Backup of the journal inode */
+	uint32_t	s_blocks_count_hi;	/* Blocks count MSB */
+	uint32_t	s_r_blocks_count_hi;	/* Reserved blocks count MSB */
+	uint32_t	s_free_blocks_count_hi;	/* Free blocks count MSB */
+	uint16_t	s_min_extra_isize;	/* All inodes have at least # bytes */
+	uint16_t	s_want_extra_isize; 	/* New inodes should reserve # bytes */
+	uint32_t	s_flags;		/* Miscellaneous flags */
+	uint16_t	s_raid_stride;		/* RAID stride */
+	uint16_t	s_mmp_interval;		/* # seconds to wait in MMP checking */
+	uint64_t	s_mmp_block;		/* Block for multi-mount protection */
+	uint32_t	s_raid_stripe_width;	/* blocks on all data disks (N*stride)*/
+	uint8_t	s_log_groups_per_flex;	/* FLEX_BG group size */
+	uint8_t	s_checksum_type;	/* metadata checksum algorithm used */
+	uint16_t	s_reserved_pad;
+	uint32_t	s_reserved[162];	/* Padding to the end of the block */
 };
 
+/*
+ * Miscellaneous superblock flags
+ */
+#define EXT2_FLAGS_SIGNED_HASH		0x0001  /* Signed dirhash in use */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002  /* Unsigned dirhash in use */
+#define EXT2_FLAGS_TEST_FILESYS		0x0004	/* to test development code */
+
 /*
  * Codes for operating systems
  */
@@ -343,6 +413,11 @@ struct ext2_super_block {
 #define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT2_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
 #define EXT2_FEATURE_RO_COMPAT_BTREE_DIR	0x0004
+#define EXT4_FEATURE_RO_COMPAT_HUGE_FILE	0x0008
+#define EXT4_FEATURE_RO_COMPAT_GDT_CSUM		0x0010
+#define EXT4_FEATURE_RO_COMPAT_DIR_NLINK	0x0020
+#define EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE	0x0040
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM	0x0400
 #define EXT2_FEATURE_RO_COMPAT_ANY		0xffffffff
 
 #define EXT2_FEATURE_INCOMPAT_COMPRESSION	0x0001
@@ -350,6 +425,16 @@ struct ext2_super_block {
 #define EXT3_FEATURE_INCOMPAT_RECOVER		0x0004
 #define EXT3_FEATURE_INCOMPAT_JOURNAL_DEV	0x0008
 #define EXT2_FEATURE_INCOMPAT_META_BG		0x0010
+#define EXT4_FEATURE_INCOMPAT_EXTENTS		0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT		0x0080
+#define EXT4_FEATURE_INCOMPAT_MMP		0x0100
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG		0x0200
+#define EXT4_FEATURE_INCOMPAT_EA_INODE		0x0400
+#define EXT4_FEATURE_INCOMPAT_DIRDATA		0x1000
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED		0x2000
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR		0x4000
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA	0x8000
+#define EXT4_FEATURE_INCOMPAT_ENCRYPT		0x10000
 #define EXT2_FEATURE_INCOMPAT_ANY		0xffffffff
 
 #define EXT2_FEATURE_COMPAT_SUPP	EXT2_FEATURE_COMPAT_EXT_ATTR
@@ -433,4 +518,69 @@ enum {
 #define EXT2_DIR_REC_LEN(name_len)	(((name_len) + 8 + EXT2_DIR_ROUND) & \
 					 ~EXT2_DIR_ROUND)
 
+/*
+ * Hash-indexed (htree) directories. The first block of the directory
+ * holds a dx_root behind fake "." and ".." entries, interior index
+ * blocks hold a dx_node behind a fake empty entry spanning the block.
+ */
+#define EXT2_HASH_LEGACY		0
+#define EXT2_HASH_HALF_MD4		1
+#define EXT2_HASH_TEA			2
+#define EXT2_HASH_LEGACY_UNSIGNED	3
+#define EXT2_HASH_HALF_MD4_UNSIGNED	4
+#define EXT2_HASH_TEA_UNSIGNED		5
+
+#define EXT2_HTREE_EOF_32BIT		0x7fffffffU
+
+struct ext2_dx_root_info {
+	uint32_t	reserved_zero;
+	uint8_t	hash_version;
+	uint8_t	info_length;		/* 8 */
+	uint8_t	indirect_levels;
+	uint8_t	unused_flags;
+};
+
+struct ext2_dx_entry {
+	uint32_t	hash;
+	uint32_t	block;			/* logical block in the directory */
+};
+
+/* overlays the hash of the first dx_entry of each index block */
+struct ext2_dx_countlimit {
+	uint16_t	limit;
+	uint16_t	count;
+};
+
+/*
+ * Extent tree. The root node lives in i_block, interior and leaf nodes
+ * are whole blocks, each starting with an ext4_extent_header.
+ */
+#define EXT4_EXT_MAGIC			0xf30a
+#define EXT4_EXT_MAX_DEPTH		5
+#define EXT4_EXT_INIT_MAX_LEN		(1UL << 15)
+
+struct ext4_extent_header {
+	uint16_t	eh_magic;		/* probably will support different formats */
+	uint16_t	eh_entries;		/* number of valid entries */
+	uint16_t	eh_max;			/* capacity of store in entries */
+	uint16_t	eh_depth;		/* has tree real underlying blocks? */
+	uint32_t	eh_generation;		/* generation of the tree */
+};
+
+/* leaf entry */
+struct ext4_extent {
+	uint32_t	ee_block;		/* first logical block extent covers */
+	uint16_t	ee_len;			/* number of blocks covered by extent */
+	uint16_t	ee_start_hi;		/* high 16 bits of physical block */
+	uint32_t	ee_start_lo;		/* low 32 bits of physical block */
+};
+
+/* interior node entry */
+struct ext4_extent_idx {
+	uint32_t	ei_block;		/* index covers logical blocks from 'block' */
+	uint32_t	ei_leaf_lo;		/* pointer to the physical block of the next level */
+	uint16_t	ei_leaf_hi;		/* high 16 bits of physical block */
+	uint16_t	ei_unused;
+};
+
 #endif	/* _LINUX_EXT2_FS_H */
@@ -28,6 +28,11 @@
 #include <lib/bcache.h>
 #include "ext2_fs.h"
 
+/* blocks in the per-mount block cache, 0 sizes it to BCACHE_DEFAULT_SIZE bytes */
+#ifndef EXT2_BCACHE_BLOCKS
+#define EXT2_BCACHE_BLOCKS 0
+#endif
+
 typedef uint32_t blocknum_t;
 typedef uint32_t inodenum_t;
 typedef uint32_t groupnum_t;
@@ -38,7 +43,7 @@ typedef struct {
 
 	struct ext2_super_block sb;
 	int s_group_count;
-	struct ext2_group_desc *gd;
+	struct ext2_group_desc *gd; // the low 32 bytes of each descriptor, whatever s_desc_size is
 	struct ext2_inode root_inode;
 } ext2_t;
 
@@ -47,11 +52,19 @@ struct cache_block {
 	void *ptr;
 };
 
+/* a run of file blocks backed by contiguous physical blocks, phys 0 for a hole */
+struct ext2_block_run {
+	uint32_t file_block;
+	uint32_t len;
+	uint64_t phys;
+};
+
 /* open file handle */
 typedef struct {
 	ext2_t *ext2;
 
 	struct cache_block ind_cache[3]; // cache of indirect blocks as they're scanned
+	struct ext2_block_run extent_cache; // last extent looked up, for extent mapped inodes
 	struct ext2_inode inode;
 } ext2_file_t;
 
@@ -65,7 +78,7 @@ int ext2_get_block(ext2_t *ext2, void **ptr, blocknum_t bnum);
 int ext2_put_block(ext2_t *ext2, blocknum_t bnum);
 
 off_t ext2_file_len(ext2_t *ext2, struct ext2_inode *inode);
-int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *buf, off_t offset, size_t len);
+int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, struct ext2_block_run *extent_cache, void *buf, off_t offset, size_t len);
 int ext2_read_link(ext2_t *ext2, struct ext2_inode *inode, char *str, size_t len);
 
 /* mode stuff */
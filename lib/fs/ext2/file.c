@@ -72,7 +72,7 @@ int ext2_read_file(fsfilecookie fcookie, void *buf, off_t offset, size_t len)
 	}
 
 	// read from the inode
-	err = ext2_read_inode(file->ext2, &file->inode, buf, offset, len);
+	err = ext2_read_inode(file->ext2, &file->inode, &file->extent_cache, buf, offset, len);
 
 	return err;
 }
@@ -130,7 +130,7 @@ int ext2_read_link(ext2_t *ext2, struct ext2_inode *inode, char *str, size_t len
 		return ERR_NO_MEMORY;
 
 	if (linklen > 60) {
-		int err = ext2_read_inode(ext2, inode, str, 0, linklen);
+		int err = ext2_read_inode(ext2, inode, NULL, str, 0, linklen);
 		if (err < 0)
 			return err;
 		str[linklen] = 0;
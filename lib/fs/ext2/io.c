@@ -30,6 +30,14 @@
 
 #define LOCAL_TRACE 0
 
+/*
+ * Runs of data blocks at least this long are read straight into the caller's
+ * buffer with one device read. Shorter ones, typical of fragmented files, go
+ * through bcache so its sequential read-ahead turns them into large reads.
+ * Matches the smallest bcache read-ahead window.
+ */
+#define EXT2_DIRECT_READ_MIN (128 * 1024)
+
 int ext2_read_block(ext2_t *ext2, void *buf, blocknum_t bnum)
 {
 	return bcache_read_block(ext2->cache, buf, bnum);
@@ -181,11 +189,176 @@ static blocknum_t file_block_to_fs_block(ext2_t *ext2, struct ext2_inode *inode,
 	return block;
 }
 
-int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_t offset, size_t len)
+/* index of the last entry of a node starting at or before file_block, -1 if there is none */
+static int ext4_ext_search(const struct ext4_extent_header *eh, uint32_t file_block)
+{
+	/* leaf and index entries are both 12 bytes and lead with their first logical block */
+	const struct ext4_extent *ent = (const struct ext4_extent *)(eh + 1);
+	int lo = 0;
+	int hi = LE16(eh->eh_entries) - 1;
+	int found = -1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (LE32(ent[mid].ee_block) <= file_block) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return found;
+}
+
+/* walk the extent tree down from i_block to the extent holding file_block, or the hole around it */
+static int ext4_ext_lookup(ext2_t *ext2, struct ext2_inode *inode, uint32_t file_block, struct ext2_block_run *run)
+{
+	const struct ext4_extent_header *eh = (const struct ext4_extent_header *)inode->i_block;
+	size_t node_size = sizeof(inode->i_block);
+	uint32_t next_start = UINT32_MAX; // first mapped block past file_block, as far as we know
+	blocknum_t held = 0;
+	uint depth;
+	int err = -1;
+
+	for (depth = 0; depth <= EXT4_EXT_MAX_DEPTH; depth++) {
+		uint entries = LE16(eh->eh_entries);
+
+		if (LE16(eh->eh_magic) != EXT4_EXT_MAGIC || (entries + 1) * sizeof(struct ext4_extent) > node_size)
+			break;
+
+		int i = ext4_ext_search(eh, file_block);
+		const struct ext4_extent *ex = (const struct ext4_extent *)(eh + 1);
+		if ((uint)(i + 1) < entries)
+			next_start = MIN(next_start, LE32(ex[i + 1].ee_block));
+
+		if (LE16(eh->eh_depth) == 0 || i < 0) {
+			/* a hole unless a leaf extent covers it */
+			run->file_block = file_block;
+			run->len = next_start - file_block;
+			run->phys = 0;
+
+			if (LE16(eh->eh_depth) == 0 && i >= 0) {
+				uint32_t start = LE32(ex[i].ee_block);
+				uint32_t len = LE16(ex[i].ee_len);
+				bool unwritten = len > EXT4_EXT_INIT_MAX_LEN;
+
+				if (unwritten)
+					len -= EXT4_EXT_INIT_MAX_LEN;
+				if (file_block - start < len) {
+					run->file_block = start;
+					run->len = len;
+					/* preallocated but unwritten extents read back as zeros */
+					if (!unwritten)
+						run->phys = ((uint64_t)LE16(ex[i].ee_start_hi) << 32) | LE32(ex[i].ee_start_lo);
+				}
+			}
+
+			err = (run->len > 0) ? 0 : -1;
+			break;
+		}
+
+		const struct ext4_extent_idx *ix = (const struct ext4_extent_idx *)(eh + 1);
+		uint64_t child = ((uint64_t)LE16(ix[i].ei_leaf_hi) << 32) | LE32(ix[i].ei_leaf_lo);
+
+		/* tree nodes are read through the block cache, which takes 32-bit block numbers */
+		if (child == 0 || child > UINT32_MAX)
+			break;
+
+		if (held)
+			ext2_put_block(ext2, held);
+		held = 0;
+
+		void *ptr;
+		err = ext2_get_block(ext2, &ptr, child);
+		if (err < 0)
+			break;
+		err = -1;
+
+		held = child;
+		eh = ptr;
+		node_size = EXT2_BLOCK_SIZE(ext2->sb);
+	}
+
+	if (held)
+		ext2_put_block(ext2, held);
+
+	LTRACEF("file block %u: err %d, run %u + %u, phys %llu\n", file_block, err,
+	        run->file_block, run->len, (unsigned long long)run->phys);
+
+	return err;
+}
+
+/*
+ * map file_block to a run of at most max_len blocks that are either physically
+ * contiguous or all holes, returning the first physical block (0 for a hole)
+ */
+static int ext2_map_blocks(ext2_t *ext2, struct ext2_inode *inode, struct ext2_block_run *extent_cache,
+                           uint32_t file_block, uint32_t max_len, uint64_t *phys, uint32_t *len)
+{
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		/* sequential reads keep landing in the extent we looked up last */
+		if (file_block - extent_cache->file_block >= extent_cache->len) {
+			int err = ext4_ext_lookup(ext2, inode, file_block, extent_cache);
+			if (err < 0) {
+				extent_cache->len = 0;
+				return err;
+			}
+		}
+
+		uint32_t skip = file_block - extent_cache->file_block;
+		*phys = (extent_cache->phys == 0) ? 0 : extent_cache->phys + skip;
+		*len = MIN(extent_cache->len - skip, max_len);
+		return 0;
+	}
+
+	/* block mapped, extend the run one block pointer at a time */
+	blocknum_t block = file_block_to_fs_block(ext2, inode, file_block);
+	uint32_t run;
+
+	for (run = 1; run < max_len; run++) {
+		blocknum_t next_block = file_block_to_fs_block(ext2, inode, file_block + run);
+		if (next_block != ((block == 0) ? 0 : block + run))
+			break;
+	}
+
+	*phys = block;
+	*len = run;
+	return 0;
+}
+
+/* read one block for a partial first or last block, phys 0 for a hole */
+static int ext2_read_data_block(ext2_t *ext2, void *buf, uint64_t phys)
+{
+	if (phys == 0) {
+		memset(buf, 0, EXT2_BLOCK_SIZE(ext2->sb));
+		return 0;
+	}
+
+	/* the block cache takes 32-bit block numbers, go around it beyond that */
+	if (phys > UINT32_MAX) {
+		ssize_t rc = bio_read(ext2->dev, buf, (off_t)phys * EXT2_BLOCK_SIZE(ext2->sb), EXT2_BLOCK_SIZE(ext2->sb));
+		if (rc < (ssize_t)EXT2_BLOCK_SIZE(ext2->sb))
+			return (rc < 0) ? (int)rc : -1;
+		return 0;
+	}
+
+	return ext2_read_block(ext2, buf, phys);
+}
+
+int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, struct ext2_block_run *extent_cache, void *_buf, off_t offset, size_t len)
 {
 	int err = 0;
 	int bytes_read = 0;
 	uint8_t *buf = _buf;
+	struct ext2_block_run local_cache = { 0 };
+	uint64_t phys_block;
+	uint32_t run;
+
+	/* callers without a per-file cache still share lookups across this read */
+	if (!extent_cache)
+		extent_cache = &local_cache;
 
 	/* calculate the file size */
 	off_t file_size = ext2_file_len(ext2, inode);
@@ -208,12 +381,11 @@ int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_t of
 		uint8_t temp[EXT2_BLOCK_SIZE(ext2->sb)];
 
 		/* calculate the block and read it */
-		blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
-		if (phys_block == 0) {
-			memset(temp, 0, EXT2_BLOCK_SIZE(ext2->sb));
-		} else {
-			ext2_read_block(ext2, temp, phys_block);
-		}
+		err = ext2_map_blocks(ext2, inode, extent_cache, file_block, 1, &phys_block, &run);
+		if (err >= 0)
+			err = ext2_read_data_block(ext2, temp, phys_block);
+		if (err < 0)
+			return err;
 
 		/* copy out what we need */
 		size_t block_offset = offset % EXT2_BLOCK_SIZE(ext2->sb);
@@ -227,44 +399,62 @@ int ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_t of
 		buf += tocopy;
 	}
 
-	/* handle middle blocks */
+	/* handle middle blocks, a run of physically contiguous blocks (or of holes) at a time */
 	while (len >= EXT2_BLOCK_SIZE(ext2->sb)) {
-		/* calculate the block and read it */
-		blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
+		err = ext2_map_blocks(ext2, inode, extent_cache, file_block, len / EXT2_BLOCK_SIZE(ext2->sb), &phys_block, &run);
+		if (err < 0)
+			break;
+
+		size_t run_len = (size_t)run * EXT2_BLOCK_SIZE(ext2->sb);
+
+		LTRACEF("file block %u, phys block %llu, run %u\n", file_block, (unsigned long long)phys_block, run);
+
 		if (phys_block == 0) {
-			memset(buf, 0, EXT2_BLOCK_SIZE(ext2->sb));
+			memset(buf, 0, run_len);
+		} else if (run_len < EXT2_DIRECT_READ_MIN) {
+			/* short runs of a fragmented file go through the cache and its read-ahead */
+			for (uint32_t i = 0; i < run; i++) {
+				err = ext2_read_data_block(ext2, buf + i * EXT2_BLOCK_SIZE(ext2->sb), phys_block + i);
+				if (err < 0)
+					break;
+			}
+			if (err < 0)
+				break;
 		} else {
-			ext2_read_block(ext2, buf, phys_block);
+			/* straight into the caller's buffer, one device read for the whole run */
+			ssize_t rc = bio_read(ext2->dev, buf, (off_t)phys_block * EXT2_BLOCK_SIZE(ext2->sb), run_len);
+			if (rc < (ssize_t)run_len) {
+				err = (rc < 0) ? (int)rc : -1;
+				break;
+			}
 		}
 
 		/* increment our stuff */
-		file_block++;
-		len -= EXT2_BLOCK_SIZE(ext2->sb);
-		bytes_read += EXT2_BLOCK_SIZE(ext2->sb);
-		buf += EXT2_BLOCK_SIZE(ext2->sb);
+		file_block += run;
+		len -= run_len;
+		bytes_read += run_len;
+		buf += run_len;
 	}
 
 	/* handle partial last block */
-	if (len > 0) {
+	if ((err >= 0) && (len > 0)) {
 		uint8_t temp[EXT2_BLOCK_SIZE(ext2->sb)];
 
 		/* calculate the block and read it */
-		blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
-		if (phys_block == 0) {
-			memset(temp, 0, EXT2_BLOCK_SIZE(ext2->sb));
-		} else {
-			ext2_read_block(ext2, temp, phys_block);
-		}
+		err = ext2_map_blocks(ext2, inode, extent_cache, file_block, 1, &phys_block, &run);
+		if (err >= 0)
+			err = ext2_read_data_block(ext2, temp, phys_block);
 
-		/* copy out what we need */
-		memcpy(buf, temp, len);
+		if (err >= 0) {
+			/* copy out what we need */
+			memcpy(buf, temp, len);
 
-		/* increment our stuff */
-		bytes_read += len;
+			/* increment our stuff */
+			bytes_read += len;
+		}
 	}
 
 	LTRACEF("err %d, bytes_read %d\n", err, bytes_read);
 
 	return (err < 0) ? err : bytes_read;
 }
-
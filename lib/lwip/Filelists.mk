@@ -170,6 +170,9 @@ TFTPSERVERFILES=$(LWIPDIR)/apps/tftp/tftp_server.c
 # TFTPCLIENTFILES: TFTP client files
 TFTPCLIENTFILES=$(LWIPDIR)/apps/tftp/tftp_client.c
 
+# HTTPCLIENTFILES: HTTP client files
+HTTPCLIENTFILES=$(LWIPDIR)/apps/http/http_client.c
+
 # MQTTFILES: MQTT client files
 MQTTFILES=$(LWIPDIR)/apps/mqtt/mqtt.c
 
@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2019, NVIDIA Corporation.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ */
+
+#include "lwip/apps/http_client.h"
+#include "lwip/ip_addr.h"
+#include "lwip/def.h"
+#include "arch/core_lock.h"
+#include <kernel/event.h>
+#include <string.h>
+
+#if LWIP_TCP
+
+#include "lwip/tcp.h"
+
+#ifndef HTTP_DEBUG
+#define HTTP_DEBUG                     LWIP_DBG_ON
+#endif
+
+#define HTTP_CONNECT_TIMEOUT           5000U
+#define HTTP_RECV_TIMEOUT              5000U
+#define HTTP_MAX_HDR_LENGTH            1024U
+#define HTTP_MAX_REQ_LENGTH            512U
+#define HTTP_NUM_STR_LENGTH            12U
+#define HTTP_MAX_REQ_FIELDS            10U
+
+#define HTTP_STATUS_OK                 200U
+#define HTTP_STATUS_PARTIAL_CONTENT    206U
+
+#define HTTP_STATE_IDLE                0U
+#define HTTP_STATE_CONNECTING          1U
+#define HTTP_STATE_RECV_HDR            2U
+#define HTTP_STATE_RECV_BODY           3U
+#define HTTP_STATE_DONE                4U
+
+#define HTTP_CLIENT_DEBUG              0U
+
+struct http_client_priv {
+    struct tcp_pcb *pcb;
+    ip_addr_t http_server_ip;
+    u16_t port;
+    u8_t state;
+    const char *path;
+    void *dst_mem_addr;
+    u32_t dst_size;
+    u32_t offset;
+    http_client_data_fn data_fn;
+    void *data_arg;
+    u32_t content_length;
+    bool has_content_length;
+    u32_t body_rcvd;
+    char hdr[HTTP_MAX_HDR_LENGTH];
+    u16_t hdr_len;
+    time_t last_rx_time_ms;
+    err_t err;
+    event_t done_event;    /* signaled from the callbacks once state is DONE or err is set */
+};
+
+static struct http_client_priv http_client = {0};
+static char *prefix_str = "HTTP Client:";
+
+#if HTTP_CLIENT_DEBUG
+static u32_t transfer_start_ms;
+#endif
+
+static u32_t
+str_to_u32(const char *str)
+{
+    u32_t val = 0;
+
+    while ((*str >= '0') && (*str <= '9')) {
+        val = (val * 10U) + (u32_t)(*str - '0');
+        str++;
+    }
+    return val;
+}
+
+static const char *
+skip_spaces(const char *str)
+{
+    while ((*str == ' ') || (*str == '\t')) {
+        str++;
+    }
+    return str;
+}
+
+/*
+ * Only called by the thread in http_client_get()/http_client_deinit(), with the lwIP core lock held.
+ * The callbacks run on the network RX thread and just record the outcome and signal done_event.
+ */
+static void
+close_conn(bool abort)
+{
+    struct tcp_pcb *pcb = http_client.pcb;
+
+    if (pcb == NULL) {
+        return;
+    }
+
+    http_client.pcb = NULL;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+    if (abort || (tcp_close(pcb) != ERR_OK)) {
+        tcp_abort(pcb);
+    }
+}
+
+/*
+ * Parse the status line and the headers needed to place the body. A 200 reply to a Range request means
+ * the server sends the whole file again, so the body is written from the start of the buffer.
+ */
+static err_t
+parse_header(void)
+{
+    char *line = http_client.hdr;
+    char *eol;
+    const char *value;
+    u32_t status = 0;
+    u32_t range_start = 0;
+    bool has_range = false;
+    bool is_status_line = true;
+    err_t ret = ERR_OK;
+
+    while ((eol = strstr(line, "\r\n")) != NULL) {
+        *eol = '\0';
+
+        if (is_status_line) {
+            /* HTTP/1.x <status> <reason> */
+            value = strchr(line, ' ');
+            if ((lwip_strnicmp(line, "HTTP/1.", 7) != 0) || (value == NULL)) {
+                ret = ERR_VAL;
+                goto done;
+            }
+            status = str_to_u32(skip_spaces(value));
+            is_status_line = false;
+        } else if (lwip_strnicmp(line, "Content-Length:", 15) == 0) {
+            http_client.content_length = str_to_u32(skip_spaces(line + 15));
+            http_client.has_content_length = true;
+        } else if (lwip_strnicmp(line, "Content-Range:", 14) == 0) {
+            /* bytes <first>-<last>/<total> */
+            value = skip_spaces(line + 14);
+            if (lwip_strnicmp(value, "bytes", 5) == 0) {
+                value = skip_spaces(value + 5);
+            }
+            range_start = str_to_u32(value);
+            has_range = true;
+        } else if (lwip_strnicmp(line, "Transfer-Encoding:", 18) == 0) {
+            /* Only a plain body can be streamed to the load address, chunk framing would end up in the image */
+            value = skip_spaces(line + 18);
+            if (lwip_strnicmp(value, "identity", 8) != 0) {
+                LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                            ("%s Unsupported Transfer-Encoding: %s\n", prefix_str, value));
+                ret = ERR_VAL;
+                goto done;
+            }
+        }
+
+        line = eol + 2;
+    }
+
+    if (status == HTTP_STATUS_OK) {
+        http_client.offset = 0;
+    } else if (status == HTTP_STATUS_PARTIAL_CONTENT) {
+        if (!has_range || (range_start != http_client.offset)) {
+            LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Unexpected Content-Range\n", prefix_str));
+            ret = ERR_VAL;
+            goto done;
+        }
+    } else {
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s GET %s failed, status: %u\n", prefix_str, http_client.path, status));
+        ret = ERR_ARG;
+        goto done;
+    }
+
+    /* Fail before any data is transferred if the file can't fit */
+    if (http_client.has_content_length &&
+        ((http_client.offset + http_client.content_length) > http_client.dst_size)) {
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s Destination size is smaller than the file size\n", prefix_str));
+        ret = ERR_BUF;
+    }
+
+done:
+    return ret;
+}
+
+/* Record the outcome of the transfer, keeping the first error, and wake up http_client_get() */
+static void
+finish(err_t err)
+{
+    if ((err != ERR_OK) && (http_client.err == ERR_OK)) {
+        http_client.err = err;
+    }
+    event_signal(&http_client.done_event, false);
+}
+
+static err_t
+recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    u16_t tot_len;
+    u16_t copy_len;
+    u16_t prev_hdr_len;
+    u16_t body_start = 0;
+    char *hdr_end;
+    u8_t *ram_addr;
+    err_t ret = ERR_OK;
+
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(err);
+
+    if (p == NULL) {
+        /* Without a Content-Length the body is delimited by the server closing the connection */
+        if ((http_client.state == HTTP_STATE_RECV_BODY) && !http_client.has_content_length) {
+            http_client.state = HTTP_STATE_DONE;
+        }
+        finish((http_client.state == HTTP_STATE_DONE) ? ERR_OK : ERR_CLSD);
+        goto done;
+    }
+
+    /* The transfer failed or is complete, drop anything else until the connection is torn down */
+    if ((http_client.err != ERR_OK) || (http_client.state == HTTP_STATE_DONE)) {
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+        goto done;
+    }
+
+    http_client.last_rx_time_ms = tegrabl_get_timestamp_ms();
+    tot_len = p->tot_len;
+
+    if (http_client.state == HTTP_STATE_RECV_HDR) {
+        prev_hdr_len = http_client.hdr_len;
+        copy_len = LWIP_MIN(tot_len, (u16_t)(HTTP_MAX_HDR_LENGTH - 1U - prev_hdr_len));
+        (void)pbuf_copy_partial(p, &http_client.hdr[prev_hdr_len], copy_len, 0);
+        http_client.hdr_len = (u16_t)(prev_hdr_len + copy_len);
+        http_client.hdr[http_client.hdr_len] = '\0';
+
+        hdr_end = strstr(http_client.hdr, "\r\n\r\n");
+        if (hdr_end == NULL) {
+            if (http_client.hdr_len >= (HTTP_MAX_HDR_LENGTH - 1U)) {
+                LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Response header too long\n", prefix_str));
+                ret = ERR_VAL;
+                goto fail;
+            }
+            goto recved;
+        }
+
+        /* Keep the CRLF of the last header line for the parser */
+        hdr_end[2] = '\0';
+        body_start = (u16_t)((u16_t)(hdr_end + 4 - http_client.hdr) - prev_hdr_len);
+
+        ret = parse_header();
+        if (ret != ERR_OK) {
+            goto fail;
+        }
+        http_client.state = HTTP_STATE_RECV_BODY;
+    }
+
+    if ((http_client.state == HTTP_STATE_RECV_BODY) && (body_start < tot_len)) {
+        copy_len = (u16_t)(tot_len - body_start);
+        if (http_client.has_content_length &&
+            ((http_client.body_rcvd + copy_len) > http_client.content_length)) {
+            copy_len = (u16_t)(http_client.content_length - http_client.body_rcvd);
+        }
+        if ((http_client.offset + http_client.body_rcvd + copy_len) > http_client.dst_size) {
+            LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                        ("%s Destination size is smaller than the rcvd file size\n", prefix_str));
+            ret = ERR_BUF;
+            goto fail;
+        }
+
+        /* Stream the body straight to its final location */
+        ram_addr = (u8_t *)http_client.dst_mem_addr + http_client.offset + http_client.body_rcvd;
+        (void)pbuf_copy_partial(p, ram_addr, copy_len, body_start);
+        if ((http_client.data_fn != NULL) && (copy_len != 0U)) {
+            http_client.data_fn(http_client.data_arg, http_client.offset + http_client.body_rcvd,
+                                ram_addr, copy_len);
+        }
+        http_client.body_rcvd += copy_len;
+
+        if (http_client.has_content_length && (http_client.body_rcvd == http_client.content_length)) {
+            http_client.state = HTTP_STATE_DONE;
+            finish(ERR_OK);
+        }
+    }
+
+recved:
+    /* Data has been consumed, re-open the receive window */
+    tcp_recved(pcb, tot_len);
+    pbuf_free(p);
+    goto done;
+
+fail:
+    /* The waiting thread aborts the connection */
+    pbuf_free(p);
+    finish(ret);
+    ret = ERR_OK;
+
+done:
+    return ret;
+}
+
+static err_t
+connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    const char *fields[HTTP_MAX_REQ_FIELDS];
+    char req[HTTP_MAX_REQ_LENGTH];
+    char offset_str[HTTP_NUM_STR_LENGTH];
+    u8_t num_fields = 0;
+    u8_t i;
+    u16_t field_len;
+    u16_t len = 0;
+    err_t ret = ERR_OK;
+
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(err);
+
+    fields[num_fields++] = "GET ";
+    fields[num_fields++] = http_client.path;
+    fields[num_fields++] = " HTTP/1.1\r\nHost: ";
+    fields[num_fields++] = ipaddr_ntoa(&http_client.http_server_ip);
+    fields[num_fields++] = "\r\nConnection: close\r\n";
+    if (http_client.offset != 0U) {
+        /* Resume an interrupted transfer */
+        lwip_itoa(offset_str, sizeof(offset_str), (int)http_client.offset);
+        fields[num_fields++] = "Range: bytes=";
+        fields[num_fields++] = offset_str;
+        fields[num_fields++] = "-\r\n";
+    }
+    fields[num_fields++] = "\r\n";
+
+    for (i = 0; i < num_fields; i++) {
+        field_len = (u16_t)strlen(fields[i]);
+        if ((len + field_len) > HTTP_MAX_REQ_LENGTH) {
+            LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Request too long\n", prefix_str));
+            ret = ERR_MEM;
+            goto fail;
+        }
+        memcpy(&req[len], fields[i], field_len);
+        len = (u16_t)(len + field_len);
+    }
+
+    ret = tcp_write(pcb, req, len, TCP_WRITE_FLAG_COPY);
+    if (ret != ERR_OK) {
+        goto fail;
+    }
+    ret = tcp_output(pcb);
+    if (ret != ERR_OK) {
+        goto fail;
+    }
+
+    http_client.state = HTTP_STATE_RECV_HDR;
+    http_client.last_rx_time_ms = tegrabl_get_timestamp_ms();
+    goto done;
+
+fail:
+    LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to send request: err: %d\n", prefix_str, ret));
+    finish(ret);
+    ret = ERR_OK;
+
+done:
+    return ret;
+}
+
+static void
+conn_err(void *arg, err_t err)
+{
+    LWIP_UNUSED_ARG(arg);
+
+    /* lwIP has already freed the pcb */
+    http_client.pcb = NULL;
+    if (http_client.state != HTTP_STATE_DONE) {
+        finish((err != ERR_OK) ? err : ERR_CLSD);
+    }
+}
+
+err_t
+http_client_init(const u8_t * const http_server_ip, u16_t port)
+{
+    err_t ret = ERR_OK;
+
+    if (http_server_ip == NULL) {
+        ret = ERR_ARG;
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid HTTP server IP addr passed\n", prefix_str));
+        goto done;
+    }
+
+    ip_addr_set_zero(&http_client.http_server_ip);
+    ip_2_ip4(&http_client.http_server_ip)->addr = (http_server_ip[0] << 0U)  |
+                                                 (http_server_ip[1] << 8U)  |
+                                                 (http_server_ip[2] << 16U) |
+                                                 (http_server_ip[3] << 24U);
+    http_client.port = port;
+    http_client.pcb = NULL;
+    http_client.state = HTTP_STATE_IDLE;
+    event_init(&http_client.done_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+    LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                ("%s Server: %s:%u\n", prefix_str, ipaddr_ntoa(&http_client.http_server_ip), port));
+
+done:
+    return ret;
+}
+
+err_t
+http_client_get(const char * const path,
+                void * const dst_addr,
+                u32_t dst_size,
+                u32_t offset,
+                http_client_data_fn data_fn,
+                void *data_arg,
+                u32_t * const rcvd_size)
+{
+    time_t elapsed_ms;
+    u32_t timeout_ms;
+    err_t ret = ERR_OK;
+
+    http_client.offset = offset;
+    http_client.body_rcvd = 0;
+
+    if ((path == NULL) || (dst_addr == NULL) || (offset > dst_size)) {
+        ret = ERR_ARG;
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid args\n", prefix_str));
+        goto fail;
+    }
+
+    LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s GET %s, offset: %u\n", prefix_str, path, offset));
+
+    http_client.path = path;
+    http_client.dst_mem_addr = dst_addr;
+    http_client.dst_size = dst_size;
+    http_client.data_fn = data_fn;
+    http_client.data_arg = data_arg;
+    http_client.content_length = 0;
+    http_client.has_content_length = false;
+    http_client.hdr_len = 0;
+    http_client.err = ERR_OK;
+    http_client.state = HTTP_STATE_CONNECTING;
+    http_client.last_rx_time_ms = tegrabl_get_timestamp_ms();
+    event_unsignal(&http_client.done_event);
+
+    lwip_core_lock();
+    http_client.pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (http_client.pcb == NULL) {
+        lwip_core_unlock();
+        ret = ERR_MEM;
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to allocate TCP PCB\n", prefix_str));
+        goto fail;
+    }
+    tcp_arg(http_client.pcb, &http_client);
+    tcp_recv(http_client.pcb, recv);
+    tcp_err(http_client.pcb, conn_err);
+
+#if HTTP_CLIENT_DEBUG
+    transfer_start_ms = tegrabl_get_timestamp_ms();
+#endif
+
+    ret = tcp_connect(http_client.pcb, &http_client.http_server_ip, http_client.port, connected);
+    if (ret != ERR_OK) {
+        close_conn(true);
+        lwip_core_unlock();
+        goto fail;
+    }
+
+    /*
+     * Sleep till the callbacks report the full body or an error. Each wakeup re-arms the timeout from the
+     * last received segment, so a slow but progressing transfer is not cut off.
+     */
+    while ((http_client.state != HTTP_STATE_DONE) && (http_client.err == ERR_OK)) {
+        elapsed_ms = tegrabl_get_timestamp_ms() - http_client.last_rx_time_ms;
+        timeout_ms = (http_client.state == HTTP_STATE_CONNECTING) ? HTTP_CONNECT_TIMEOUT : HTTP_RECV_TIMEOUT;
+        if (elapsed_ms >= (time_t)timeout_ms) {
+            ret = (http_client.state == HTTP_STATE_CONNECTING) ? ERR_CONN : ERR_TIMEOUT;
+            LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE, ("%s Timed out\n", prefix_str));
+            break;
+        }
+        lwip_core_unlock();
+        (void)event_wait_timeout(&http_client.done_event, (lk_time_t)(timeout_ms - (u32_t)elapsed_ms));
+        lwip_core_lock();
+    }
+
+    /* The connection is only ever closed or aborted here, never from the callbacks */
+    if ((ret == ERR_OK) && (http_client.err != ERR_OK)) {
+        ret = http_client.err;
+    }
+    close_conn(ret != ERR_OK);
+    lwip_core_unlock();
+
+#if HTTP_CLIENT_DEBUG
+    if (ret == ERR_OK) {
+        LWIP_DEBUGF(HTTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s Total data: %u bytes in %u ms\n", prefix_str, http_client.body_rcvd,
+                        (u32_t)(tegrabl_get_timestamp_ms() - transfer_start_ms)));
+    }
+#endif
+
+fail:
+    if (rcvd_size != NULL) {
+        *rcvd_size = http_client.offset + http_client.body_rcvd;
+    }
+    return ret;
+}
+
+void
+http_client_deinit(void)
+{
+    lwip_core_lock();
+    close_conn(true);
+    http_client.state = HTTP_STATE_IDLE;
+    lwip_core_unlock();
+}
+
+#endif /* LWIP_TCP */
@@ -10,60 +10,111 @@
 
 #include "lwip/apps/tftp_client.h"
 #include "lwip/ip_addr.h"
+#include "lwip/def.h"
+#include "arch/core_lock.h"
+#include <kernel/event.h>
 #include <string.h>
 
 #if LWIP_UDP
 
 #include "lwip/udp.h"
+#include "lwip/timeouts.h"
 
-#define TFTP_MAX_PAYLOAD_SIZE_BYTES    512U
+#define TFTP_DEFAULT_BLKSIZE           512U
+#define TFTP_MIN_BLKSIZE               8U
 #define TFTP_HEADER_LENGTH             4U
+#define TFTP_OPCODE_LENGTH             2U
 #define TFTP_SERVER_PORT               69U
 #define TFTP_CLIENT_PORT               50033U
 #define TFTP_ACK_RESEND_TIMEOUT        5000U
 #define TFTP_MAX_ACK_RETRIES           5U
+#define TFTP_MAX_OACK_LENGTH           128U
+#define TFTP_OPT_VALUE_LENGTH          12U
+#define TFTP_MAX_RRQ_FIELDS            8U
 
 #define TFTP_READ                      1U
 #define TFTP_WRITE                     2U
 #define TFTP_DATA                      3U
 #define TFTP_ACK                       4U
 #define TFTP_ERROR                     5U
+#define TFTP_OACK                      6U
+
+#define TFTP_ERR_DISK_FULL             3U
+#define TFTP_ERR_ILLEGAL_OPERATION     4U
+#define TFTP_ERR_UNKNOWN_TID           5U
+#define TFTP_ERR_OPTION_NEGOTIATION    8U
+
+/* Options are only worth negotiating if at least one of them differs from RFC 1350 behaviour */
+#define TFTP_USE_OPTIONS               ((TFTP_BLKSIZE != TFTP_DEFAULT_BLKSIZE) || \
+                                        (TFTP_WINDOWSIZE != 1) || TFTP_TSIZE)
 
 #define TFTP_CLIENT_DEBUG              0U
 #define PROGRESS_BAR                   1U
 
 #define PROGRESS_BAR_INTERVAL_BLKS     250U
-#define PROGRESS_BAR_INTERVAL_BYTES    (PROGRESS_BAR_INTERVAL_BLKS * TFTP_MAX_PAYLOAD_SIZE_BYTES)
+#define PROGRESS_BAR_INTERVAL_BYTES    (PROGRESS_BAR_INTERVAL_BLKS * TFTP_DEFAULT_BLKSIZE)
 #define MIN_CONSOLE_ROW_SIZE           80U
 
 #define PBUF_TAKE_ERR_MSG(str)         "Failed to copy " "" str "" " to pbuf buffer"
 
+/* Transfers waited for by one tftp_client_recv_wait() call */
+struct tftp_batch {
+    u32_t pending;
+    event_t done;
+};
+
 struct tftp_client_priv {
     struct udp_pcb *pcb;
     ip_addr_t tftp_server_ip;
     void *dst_mem_addr;
     u32_t dst_size;
+    tftp_client_data_fn data_fn;
+    void *data_arg;
     u16_t last_rcvd_blk;
     u16_t exptd_blk;
     u32_t tot_data_cnt_bytes;
     u16_t temp_conn_port;
+    bool tid_set;          /* temp_conn_port is the server's transfer ID */
     time_t last_ack_time_ms;
     bool is_file_rcvd;
     err_t err;
+    /* Negotiated transfer parameters, RFC 1350 defaults until an OACK is received */
+    u16_t blksize;
+    u16_t windowsize;
+    u16_t window_blk_cnt;
+    u32_t tsize;
+    bool opts_sent;
+    bool oack_rcvd;
+    bool opts_rejected;
+    bool gap_acked;
+    /* Session bookkeeping, each session owns its own UDP PCB and client port */
+    bool in_use;
+    bool is_done;
+    char *filename;
+    char *filetype;
+    u8_t ack_retries;
+    u16_t last_ack_retry_blk;
+    struct tftp_batch *batch;
+#if TFTP_CLIENT_DEBUG
+    u32_t transfer_start_ms;
+#endif
 };
 
-struct tftp_client_priv tftp_client = {0};
+static struct tftp_client_priv tftp_sessions[TFTP_MAX_SESSIONS];
 static char *prefix_str = "TFTP Client:";
 static u32_t bar_cnt;
+static u32_t bar_bytes;
+static u32_t next_bar_bytes;
 
 #if TFTP_CLIENT_DEBUG
-static u32_t transfer_start_ms;
 static u32_t transfer_end_ms;
 static u32_t speed_kibi_byte_per_sec;
 #endif
 
+static bool session_poll(struct tftp_client_priv *tc);
+
 static int
-send_ack(u16_t blk_num, u16_t port)
+send_ack(struct tftp_client_priv *tc, u16_t blk_num, u16_t port)
 {
     struct pbuf *p = NULL;
     u16_t *payload;
@@ -79,14 +130,14 @@ send_ack(u16_t blk_num, u16_t port)
     payload[0] = lwip_htons(TFTP_ACK);
     payload[1] = lwip_htons(blk_num);
 
-    ret = udp_sendto(tftp_client.pcb, p, &tftp_client.tftp_server_ip, port);
+    ret = udp_sendto(tc->pcb, p, &tc->tftp_server_ip, port);
     if (ret != ERR_OK) {
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                     ("%s Failed to send ACK: err: %d\n", prefix_str, (signed)ret));
         goto fail;
     }
 
-    tftp_client.last_ack_time_ms = tegrabl_get_timestamp_ms();
+    tc->last_ack_time_ms = tegrabl_get_timestamp_ms();
 
 #if TFTP_CLIENT_DEBUG && !PROGRESS_BAR
     LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("Sent ACK: %u\n", blk_num));
@@ -99,13 +150,136 @@ fail:
     return ret;
 }
 
+static int
+send_error(struct tftp_client_priv *tc, u16_t code, const char * const msg, const ip_addr_t *addr, u16_t port)
+{
+    struct pbuf *p = NULL;
+    u16_t *payload;
+    u16_t msg_len = (u16_t)(strlen(msg) + 1U);
+    err_t ret = ERR_OK;
+
+    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(TFTP_HEADER_LENGTH + msg_len), PBUF_RAM);
+    if (p == NULL) {
+        ret = ERR_MEM;
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to allocate memory\n", prefix_str));
+        goto fail;
+    }
+    payload = (u16_t *)p->payload;
+    payload[0] = lwip_htons(TFTP_ERROR);
+    payload[1] = lwip_htons(code);
+    memcpy((u8_t *)p->payload + TFTP_HEADER_LENGTH, msg, msg_len);
+
+    ret = udp_sendto(tc->pcb, p, addr, port);
+    if (ret != ERR_OK) {
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s Failed to send ERROR: err: %d\n", prefix_str, (signed)ret));
+    }
+
+fail:
+    if (p != NULL) {
+        pbuf_free(p);
+    }
+    return ret;
+}
+
+static u32_t
+opt_val_to_u32(const char *str)
+{
+    u32_t val = 0;
+
+    while ((*str >= '0') && (*str <= '9')) {
+        val = (val * 10U) + (u32_t)(*str - '0');
+        str++;
+    }
+    return val;
+}
+
+/*
+ * Apply the options acknowledged by the server (RFC 2347). The server may only lower the values we
+ * asked for, anything else is answered with an option negotiation error.
+ */
+static err_t
+process_oack(struct tftp_client_priv *tc, struct pbuf *p, u16_t port)
+{
+    char opts[TFTP_MAX_OACK_LENGTH];
+    char *name;
+    char *value;
+    u16_t len;
+    u16_t i = 0;
+    u32_t val;
+    err_t ret = ERR_OK;
+
+    len = pbuf_copy_partial(p, opts, sizeof(opts) - 1U, TFTP_OPCODE_LENGTH);
+    opts[len] = '\0';
+
+    while (i < len) {
+        name = &opts[i];
+        i = (u16_t)(i + strlen(name) + 1U);
+        if (i >= len) {
+            break;
+        }
+        value = &opts[i];
+        i = (u16_t)(i + strlen(value) + 1U);
+        val = opt_val_to_u32(value);
+
+        if (lwip_stricmp(name, "blksize") == 0) {
+            if ((val < TFTP_MIN_BLKSIZE) || (val > TFTP_BLKSIZE)) {
+                ret = ERR_VAL;
+                break;
+            }
+            tc->blksize = (u16_t)val;
+        } else if (lwip_stricmp(name, "windowsize") == 0) {
+            if ((val == 0U) || (val > TFTP_WINDOWSIZE)) {
+                ret = ERR_VAL;
+                break;
+            }
+            tc->windowsize = (u16_t)val;
+        } else if (lwip_stricmp(name, "tsize") == 0) {
+            tc->tsize = val;
+            if (val > tc->dst_size) {
+                LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
+                            ("%s File size %u exceeds destination size %u\n",
+                                prefix_str, val, tc->dst_size));
+                (void)send_error(tc, TFTP_ERR_DISK_FULL, "File too large", &tc->tftp_server_ip, port);
+                ret = ERR_BUF;
+                goto done;
+            }
+        } else {
+            ret = ERR_VAL;
+            break;
+        }
+    }
+
+    if (ret != ERR_OK) {
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid option in OACK\n", prefix_str));
+        (void)send_error(tc, TFTP_ERR_OPTION_NEGOTIATION, "Invalid option", &tc->tftp_server_ip, port);
+        tc->opts_rejected = true;
+        goto done;
+    }
+
+    LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
+                ("%s OACK: blksize %u, windowsize %u, tsize %u\n",
+                    prefix_str, tc->blksize, tc->windowsize, tc->tsize));
+
+    tc->oack_rcvd = true;
+    tc->temp_conn_port = port;
+    tc->tid_set = true;
+
+    /* Block 0 acknowledges the OACK and starts the transfer */
+    ret = send_ack(tc, 0, port);
+
+done:
+    return ret;
+}
+
 static void
 recv(void *a, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
+    struct tftp_client_priv *tc = (struct tftp_client_priv *)a;
     u16_t *sbuf = NULL;
-    u8_t *data_ptr = NULL;
     u8_t *ram_addr = NULL;
     u16_t opcode = 0;
+    u16_t err_code = 0;
     u16_t data_len_bytes = 0;
     u16_t blk_num = 0;
     err_t ret = ERR_OK;
@@ -113,7 +287,7 @@ recv(void *a, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t
     bool old_setting;
 #endif
 
-    char *err_msg[8] = {
+    char *err_msg[9] = {
         [0] = "Not defined",
         [1] = "File not found",
         [2] = "Access Violation",
@@ -121,29 +295,67 @@ recv(void *a, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t
         [4] = "Illegal operation",
         [5] = "Unknown port number",
         [6] = "File already exists",
-        [7] = "No such user"
+        [7] = "No such user",
+        [8] = "Option negotiation failed"
     };
 
+    /* Late packets of a finished transfer must not change its result */
+    if (!tc->in_use || tc->is_done) {
+        pbuf_free(p);
+        return;
+    }
+
+    /*
+     * The first reply from the server fixes its transfer ID (RFC 1350). Datagrams from any other host
+     * or port are not part of this transfer and are refused without touching the session.
+     */
+    if (!ip_addr_cmp(addr, &tc->tftp_server_ip) || (tc->tid_set && (port != tc->temp_conn_port))) {
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s %s: Packet from unknown transfer ID %s:%u\n",
+                        prefix_str, tc->filename, ipaddr_ntoa(addr), port));
+        (void)send_error(tc, TFTP_ERR_UNKNOWN_TID, "Unknown transfer ID", addr, port);
+        pbuf_free(p);
+        return;
+    }
+
+    if (p->len < TFTP_HEADER_LENGTH) {
+        goto fail;
+    }
+
     sbuf = (u16_t *)p->payload;
     opcode = lwip_ntohs(sbuf[0]);
 
     switch (opcode) {
 
-    case TFTP_DATA:
-        /*
-         * Buffer length must be greater than TFTP header length otherwise actual data length (data_len_bytes)
-         * will be < 0
-         */
-        if (((u16_t)p->len == 0U) || ((u16_t)p->len <= TFTP_HEADER_LENGTH)) {
+    case TFTP_OACK:
+        /* An OACK is only valid as the first reply to an RRQ carrying options */
+        if (!tc->opts_sent || tc->oack_rcvd || (tc->tot_data_cnt_bytes != 0U)) {
             goto fail;
         }
+        ret = process_oack(tc, p, port);
+        if (ret != ERR_OK) {
+            tc->err = ret;
+        }
+        break;
 
+    case TFTP_DATA:
         blk_num = lwip_ntohs(sbuf[1]);
-        if (blk_num != tftp_client.exptd_blk) {
+        if (blk_num != tc->exptd_blk) {
 #if TFTP_CLIENT_DEBUG && !PROGRESS_BAR
             LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
-                        ("Rcvd blk no: %u  !=  expected blk no: %u\n", blk_num, tftp_client.exptd_blk));
+                        ("Rcvd blk no: %u  !=  expected blk no: %u\n", blk_num, tc->exptd_blk));
 #endif
+            /*
+             * A block went missing inside the window. Acknowledge the last in-order block once so that
+             * the server restarts the window from there instead of waiting for the ACK timeout (RFC 7440)
+             */
+            if (!tc->gap_acked &&
+                ((tc->tot_data_cnt_bytes != 0U) || tc->oack_rcvd)) {
+                if (send_ack(tc, tc->last_rcvd_blk, port) == ERR_OK) {
+                    tc->gap_acked = true;
+                    tc->window_blk_cnt = 0;
+                }
+            }
             goto fail;
         }
 
@@ -151,94 +363,124 @@ recv(void *a, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("blk no: %u\n", blk_num));
 #endif
 
-        tftp_client.exptd_blk++;
-        tftp_client.last_rcvd_blk = blk_num;
-
-        /* Calculate dst, src addr and data length to copy */
-        data_len_bytes = (u16_t)p->len - TFTP_HEADER_LENGTH;
-        ram_addr = (u8_t *)tftp_client.dst_mem_addr + tftp_client.tot_data_cnt_bytes;
-        data_ptr = (u8_t *)p->payload + TFTP_HEADER_LENGTH;
+        /* Frames bigger than the pbuf pool buffer size arrive chained, so use tot_len */
+        data_len_bytes = (u16_t)(p->tot_len - TFTP_HEADER_LENGTH);
+        if (data_len_bytes > tc->blksize) {
+            goto fail;
+        }
 
         /* Sanity check if total data length is exceeding destination size */
-        tftp_client.tot_data_cnt_bytes = tftp_client.tot_data_cnt_bytes + data_len_bytes;
-        if (tftp_client.tot_data_cnt_bytes > tftp_client.dst_size) {
+        if ((tc->tot_data_cnt_bytes + data_len_bytes) > tc->dst_size) {
             LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                         ("%s Destination size is smaller than the rcvd file size\n", prefix_str));
+            (void)send_error(tc, TFTP_ERR_DISK_FULL, "File too large", &tc->tftp_server_ip, port);
+            tc->err = ERR_BUF;
             goto fail;
         }
 
+        tc->exptd_blk++;
+        tc->last_rcvd_blk = blk_num;
+        tc->gap_acked = false;
+
         /* Copy data to RAM after ensuring destination size is sufficient */
-        memcpy((void *)ram_addr, (void *)data_ptr, data_len_bytes);
+        ram_addr = (u8_t *)tc->dst_mem_addr + tc->tot_data_cnt_bytes;
+        (void)pbuf_copy_partial(p, ram_addr, data_len_bytes, TFTP_HEADER_LENGTH);
+        if ((tc->data_fn != NULL) && (data_len_bytes != 0U)) {
+            tc->data_fn(tc->data_arg, tc->tot_data_cnt_bytes, ram_addr, data_len_bytes);
+        }
+        tc->tot_data_cnt_bytes = tc->tot_data_cnt_bytes + data_len_bytes;
 
-        if (data_len_bytes < TFTP_MAX_PAYLOAD_SIZE_BYTES) {
-            tftp_client.is_file_rcvd = true;
+        if (data_len_bytes < tc->blksize) {
+            tc->is_file_rcvd = true;
         }
 
 #if TFTP_CLIENT_DEBUG && !PROGRESS_BAR
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                     ("Total data rcvd: %u bytes, Curr pkt data len: %u bytes\n",
-                        tftp_client.tot_data_cnt_bytes, data_len_bytes));
+                        tc->tot_data_cnt_bytes, data_len_bytes));
 #endif
 
 #if PROGRESS_BAR
         old_setting = tegrabl_enable_timestamp(false);
-        if ((tftp_client.tot_data_cnt_bytes % PROGRESS_BAR_INTERVAL_BYTES) == 0) {
+        /* The bar tracks the bytes of all active sessions */
+        bar_bytes += data_len_bytes;
+        if (bar_bytes >= next_bar_bytes) {
             tegrabl_printf("#");
+            next_bar_bytes += PROGRESS_BAR_INTERVAL_BYTES;
             bar_cnt++;
             /* Enter a newline if bar crosses the minimum row size */
             if ((bar_cnt % MIN_CONSOLE_ROW_SIZE) == 0) {
                 tegrabl_printf("\n");
             }
         }
-        if (tftp_client.is_file_rcvd) {
+        if (tc->is_file_rcvd) {
             tegrabl_printf("\n");
         }
         (void)tegrabl_enable_timestamp(old_setting);
 #endif
 
-        if (tftp_client.is_file_rcvd) {
-            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Last packet received\n", prefix_str));
+        if (tc->is_file_rcvd) {
+            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s: Last packet received\n", prefix_str, tc->filename));
         }
 
 #if TFTP_CLIENT_DEBUG
-        if (tftp_client.is_file_rcvd) {
-            transfer_end_ms = tegrabl_get_timestamp_ms() - transfer_start_ms;
-            speed_kibi_byte_per_sec = ((tftp_client.tot_data_cnt_bytes/transfer_end_ms) * 1000) / 1024;
+        if (tc->is_file_rcvd) {
+            transfer_end_ms = tegrabl_get_timestamp_ms() - tc->transfer_start_ms;
+            speed_kibi_byte_per_sec = ((tc->tot_data_cnt_bytes/transfer_end_ms) * 1000) / 1024;
             LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                         ("Total data: %u bytes, transfer rate: %u KiB/s\n",
-                            tftp_client.tot_data_cnt_bytes, speed_kibi_byte_per_sec));
+                            tc->tot_data_cnt_bytes, speed_kibi_byte_per_sec));
         }
 #endif
 
-        /* Send acknowledgement for successful packet reception */
-        ret = send_ack(blk_num, port);
-        if (ret != ERR_OK) {
-            goto fail;
+        /* Acknowledge once per window, and always for the last block of the file */
+        tc->window_blk_cnt++;
+        if ((tc->window_blk_cnt >= tc->windowsize) || tc->is_file_rcvd) {
+            ret = send_ack(tc, blk_num, port);
+            if (ret != ERR_OK) {
+                goto fail;
+            }
+            tc->window_blk_cnt = 0;
         }
-        tftp_client.temp_conn_port = port;
+        tc->temp_conn_port = port;
+        tc->tid_set = true;
 
         break;
 
     case TFTP_ERROR:
+        err_code = lwip_ntohs(sbuf[1]);
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                     ("%s Error received: code: %u, msg: %s\n",
-                        prefix_str, lwip_ntohs(sbuf[1]), err_msg[lwip_ntohs(sbuf[1])]));
-        tftp_client.err = ERR_ARG;
+                        prefix_str, err_code,
+                        (err_code < LWIP_ARRAYSIZE(err_msg)) ? err_msg[err_code] : "Unknown"));
+        /* Servers that refuse the RRQ options get another try in classic RFC 1350 mode */
+        if (tc->opts_sent && !tc->oack_rcvd && (tc->tot_data_cnt_bytes == 0U) &&
+            ((err_code == TFTP_ERR_OPTION_NEGOTIATION) || (err_code == TFTP_ERR_ILLEGAL_OPERATION))) {
+            tc->opts_rejected = true;
+        }
+        tc->err = ERR_ARG;
         break;
 
     default:
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid opcode: %u\n", prefix_str, opcode));
-        tftp_client.err = ERR_ARG;
+        tc->err = ERR_ARG;
         break;
     }
 
 fail:
+    /* The receive callback owns the pbuf */
+    pbuf_free(p);
+
+    /* Completes the session, or restarts it if the server rejected the options */
+    (void)session_poll(tc);
     return;
 }
 
 err_t
 tftp_client_init(const u8_t * const tftp_server_ip)
 {
+    struct tftp_client_priv *tc;
+    u32_t i;
     err_t ret = ERR_OK;
 
     if (tftp_server_ip == NULL) {
@@ -249,81 +491,99 @@ tftp_client_init(const u8_t * const tftp_server_ip)
 
     LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Init\n", prefix_str));
 
-    tftp_client.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
-    if (tftp_client.pcb == NULL) {
-        ret = ERR_MEM;
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to allocate UDP PCB\n", prefix_str));
-        goto done;
-    }
+    lwip_core_lock();
+    for (i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        tc = &tftp_sessions[i];
+        memset(tc, 0, sizeof(*tc));
+
+        tc->pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+        if (tc->pcb == NULL) {
+            ret = ERR_MEM;
+            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to allocate UDP PCB\n", prefix_str));
+            lwip_core_unlock();
+            goto cleanup;
+        }
 
-    ret = udp_bind(tftp_client.pcb, IP_ANY_TYPE, TFTP_CLIENT_PORT);
-    if (ret != ERR_OK) {
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to bind port to UDP PCB\n", prefix_str));
-        goto cleanup;
+        /* The server tells the transfers apart by the client port */
+        ret = udp_bind(tc->pcb, IP_ANY_TYPE, (u16_t)(TFTP_CLIENT_PORT + i));
+        if (ret != ERR_OK) {
+            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to bind port to UDP PCB\n", prefix_str));
+            lwip_core_unlock();
+            goto cleanup;
+        }
+
+        tc->tftp_server_ip.addr = (tftp_server_ip[0] << 0U)  |
+                                  (tftp_server_ip[1] << 8U)  |
+                                  (tftp_server_ip[2] << 16U) |
+                                  (tftp_server_ip[3] << 24U);
+
+        udp_recv(tc->pcb, recv, tc);
     }
+    lwip_core_unlock();
 
-    tftp_client.tftp_server_ip.addr = (tftp_server_ip[0] << 0U)  |
-                                      (tftp_server_ip[1] << 8U)  |
-                                      (tftp_server_ip[2] << 16U) |
-                                      (tftp_server_ip[3] << 24U);
     LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
                 ("%s Server IP: %u.%u.%u.%u\n",
-                    prefix_str,
-                    (tftp_client.tftp_server_ip.addr >>  0U) & 0xFF,
-                    (tftp_client.tftp_server_ip.addr >>  8U) & 0xFF,
-                    (tftp_client.tftp_server_ip.addr >> 16U) & 0xFF,
-                    (tftp_client.tftp_server_ip.addr >> 24U) & 0xFF));
-
-    udp_recv(tftp_client.pcb, recv, NULL);
+                    prefix_str, tftp_server_ip[0], tftp_server_ip[1], tftp_server_ip[2], tftp_server_ip[3]));
 
     goto done;
 
 cleanup:
-    if (tftp_client.pcb == NULL) {
-        udp_remove(tftp_client.pcb);
-    }
+    tftp_client_deinit();
 
 done:
     return ret;
 }
 
-err_t
-tftp_client_recv(char * const filename,
-				 char * const filetype,
-				 void * const dst_addr,
-				 u32_t dst_size,
-				 u32_t * const file_size)
+static err_t
+rrq_append(struct pbuf *p, u16_t *offset, const char *str)
+{
+    /* Every RRQ field is terminated by a null byte */
+    u16_t len = (u16_t)(strlen(str) + 1U);
+    err_t ret;
+
+    ret = pbuf_take_at(p, str, len, *offset);
+    if (ret == ERR_OK) {
+        *offset = (u16_t)(*offset + len);
+    }
+    return ret;
+}
+
+static err_t
+send_rrq(struct tftp_client_priv *tc, const char * const filename, const char * const filetype,
+         bool with_opts)
 {
     struct pbuf *p = NULL;
+    const char *fields[TFTP_MAX_RRQ_FIELDS];
+    char blksize_str[TFTP_OPT_VALUE_LENGTH];
+    char windowsize_str[TFTP_OPT_VALUE_LENGTH];
+    u8_t num_fields = 0;
+    u8_t i;
     u16_t opcode;
-    u8_t offset = 0;
-    u8_t null_byte = 0;
-    u8_t write_len = 0;
-    u8_t ack_retries;
-    u32_t last_ack_retry_blk;
-    time_t curr_time_ms;
+    u16_t len;
+    u16_t offset;
     err_t ret = ERR_OK;
 
-    if ((filename == NULL) || (filetype == NULL) || (dst_addr == NULL)) {
-        ret = ERR_ARG;
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid args\n", prefix_str));
-        goto fail;
+    fields[num_fields++] = filename;
+    fields[num_fields++] = filetype;
+    if (with_opts) {
+        lwip_itoa(blksize_str, sizeof(blksize_str), TFTP_BLKSIZE);
+        lwip_itoa(windowsize_str, sizeof(windowsize_str), TFTP_WINDOWSIZE);
+        fields[num_fields++] = "blksize";
+        fields[num_fields++] = blksize_str;
+        fields[num_fields++] = "windowsize";
+        fields[num_fields++] = windowsize_str;
+#if TFTP_TSIZE
+        fields[num_fields++] = "tsize";
+        fields[num_fields++] = "0";
+#endif
     }
 
-    LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Send RRQ, file: %s\n", prefix_str, filename));
-
-    tftp_client.dst_mem_addr = dst_addr;
-    tftp_client.dst_size = dst_size;
-    tftp_client.is_file_rcvd = false;
-    tftp_client.last_rcvd_blk = 0;
-    tftp_client.exptd_blk = 1;
-    tftp_client.tot_data_cnt_bytes = 0;
-    tftp_client.last_ack_time_ms = tegrabl_get_timestamp_ms();
-    tftp_client.err = ERR_OK;
-    bar_cnt = 0;
+    len = sizeof(opcode);
+    for (i = 0; i < num_fields; i++) {
+        len = (u16_t)(len + strlen(fields[i]) + 1U);
+    }
 
-    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(TFTP_HEADER_LENGTH + strlen(filename) + strlen(filetype)),
-                   PBUF_RAM);
+    p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
     if (p == NULL) {
         ret = ERR_MEM;
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Failed to allocate buffer\n", prefix_str));
@@ -331,116 +591,348 @@ tftp_client_recv(char * const filename,
     }
 
     /* Create RRQ packet */
-    opcode = lwip_ntohs(TFTP_READ);
-    write_len = sizeof(opcode);
-    ret = pbuf_take(p, &opcode, write_len);
+    opcode = lwip_htons(TFTP_READ);
+    ret = pbuf_take(p, &opcode, sizeof(opcode));
     if (ret != ERR_OK) {
         LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("opcode")));
         goto fail;
     }
-    offset = write_len;
-    write_len = strlen(filename);
-    ret = pbuf_take_at(p, filename, write_len, offset);
-    if (ret != ERR_OK) {
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("filename")));
-        goto fail;
+    offset = sizeof(opcode);
+    for (i = 0; i < num_fields; i++) {
+        ret = rrq_append(p, &offset, fields[i]);
+        if (ret != ERR_OK) {
+            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("RRQ field")));
+            goto fail;
+        }
     }
-    offset = offset + write_len;
-    write_len = sizeof(null_byte);
-    ret = pbuf_take_at(p, &null_byte, write_len, offset);
-    if (ret != ERR_OK) {
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("null byte")));
-        goto fail;
+
+    /* Send RRQ packet to destination */
+    ret = udp_sendto(tc->pcb, p, &tc->tftp_server_ip, TFTP_SERVER_PORT);
+
+fail:
+    if (p != NULL) {
+        pbuf_free(p);
     }
-    offset = offset + write_len;
-    write_len = strlen(filetype);
-    ret = pbuf_take_at(p, filetype, write_len, offset);
-    if (ret != ERR_OK) {
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("filetype")));
+    return ret;
+}
+
+static void session_tmr(void *arg);
+
+static void
+session_tmr_arm(struct tftp_client_priv *tc, u32_t timeout_ms)
+{
+    sys_untimeout(session_tmr, tc);
+    sys_timeout(timeout_ms, session_tmr, tc);
+}
+
+/* Wake up tftp_client_recv_wait() once the last session of its batch is done */
+static void
+session_finish(struct tftp_client_priv *tc)
+{
+    tc->is_done = true;
+    sys_untimeout(session_tmr, tc);
+    if (tc->batch != NULL) {
+        if (--tc->batch->pending == 0U) {
+            event_signal(&tc->batch->done, false);
+        }
+        tc->batch = NULL;
+    }
+}
+
+static err_t
+session_start(struct tftp_client_priv *tc, bool with_opts)
+{
+    LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Send RRQ, file: %s\n", prefix_str, tc->filename));
+
+    tc->is_file_rcvd = false;
+    tc->is_done = false;
+    tc->last_rcvd_blk = 0;
+    tc->exptd_blk = 1;
+    tc->tot_data_cnt_bytes = 0;
+    tc->last_ack_time_ms = tegrabl_get_timestamp_ms();
+    tc->err = ERR_OK;
+    tc->blksize = TFTP_DEFAULT_BLKSIZE;
+    tc->windowsize = 1;
+    tc->window_blk_cnt = 0;
+    tc->tsize = 0;
+    tc->opts_sent = with_opts;
+    tc->oack_rcvd = false;
+    tc->opts_rejected = false;
+    tc->gap_acked = false;
+    tc->tid_set = false;
+    tc->ack_retries = 0;
+    tc->last_ack_retry_blk = 0;
+#if TFTP_CLIENT_DEBUG
+    tc->transfer_start_ms = tegrabl_get_timestamp_ms();
+#endif
+
+    session_tmr_arm(tc, TFTP_ACK_RESEND_TIMEOUT);
+
+    return send_rrq(tc, tc->filename, tc->filetype, with_opts);
+}
+
+/*
+ * Check a session for completion and re-send the last ACK if the server went quiet. Runs with the lwIP
+ * core lock held, from the receive callback and from the session timer, so all of the session state
+ * is only changed on the network RX thread once the transfer has started.
+ * Returns true once the session has finished, with the result in tc->err.
+ */
+static bool
+session_poll(struct tftp_client_priv *tc)
+{
+    time_t curr_time_ms;
+    err_t ret;
+
+    if (tc->is_done) {
+        goto done;
+    }
+
+    if ((tc->err != ERR_OK) && tc->opts_rejected) {
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE,
+                    ("%s %s: Server rejected options, retrying with %u byte blocks\n",
+                        prefix_str, tc->filename, TFTP_DEFAULT_BLKSIZE));
+        ret = session_start(tc, false);
+        if (ret != ERR_OK) {
+            tc->err = ret;
+            session_finish(tc);
+        }
+        goto done;
+    }
+
+    if (tc->is_file_rcvd || (tc->err != ERR_OK)) {
+        session_finish(tc);
+        goto done;
+    }
+
+    curr_time_ms = tegrabl_get_timestamp_ms();
+
+    if (curr_time_ms > (tc->last_ack_time_ms + TFTP_ACK_RESEND_TIMEOUT)) {
+
+        /* Exit if haven't received a single packet */
+        if ((tc->tot_data_cnt_bytes == 0U) && !tc->oack_rcvd) {
+            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s: Connection failed\n", prefix_str, tc->filename));
+            tc->err = ERR_CONN;
+            session_finish(tc);
+            goto done;
+        }
+
+#if TFTP_CLIENT_DEBUG && !PROGRESS_BAR
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("Resend ACK: %u\n", tc->last_rcvd_blk));
+#endif
+        ret = send_ack(tc, tc->last_rcvd_blk, tc->temp_conn_port);
+        if (ret != ERR_OK) {
+            tc->err = ret;
+            session_finish(tc);
+            goto done;
+        }
+
+        if (tc->last_ack_retry_blk == tc->last_rcvd_blk) {
+            tc->ack_retries++;
+        } else {
+            tc->ack_retries = 0;
+        }
+
+        tc->last_ack_retry_blk = tc->last_rcvd_blk;
+        tc->exptd_blk = tc->last_rcvd_blk + 1;
+        tc->window_blk_cnt = 0;
+
+        if (tc->ack_retries >= TFTP_MAX_ACK_RETRIES) {
+            tc->err = ERR_TIMEOUT;
+            session_finish(tc);
+        }
+    }
+
+done:
+    return tc->is_done;
+}
+
+/* lwIP timeout of a session, fires when no ACK has been sent for TFTP_ACK_RESEND_TIMEOUT */
+static void
+session_tmr(void *arg)
+{
+    struct tftp_client_priv *tc = (struct tftp_client_priv *)arg;
+    time_t elapsed_ms;
+
+    if (session_poll(tc)) {
+        return;
+    }
+
+    /* Sleep till the resend deadline of the last ACK, whether that was resent just now or not */
+    elapsed_ms = tegrabl_get_timestamp_ms() - tc->last_ack_time_ms;
+    if (elapsed_ms > (time_t)TFTP_ACK_RESEND_TIMEOUT) {
+        elapsed_ms = TFTP_ACK_RESEND_TIMEOUT;
+    }
+    session_tmr_arm(tc, (u32_t)(TFTP_ACK_RESEND_TIMEOUT + 1U - (u32_t)elapsed_ms));
+}
+
+err_t
+tftp_client_recv_start(char * const filename,
+                       char * const filetype,
+                       void * const dst_addr,
+                       u32_t dst_size,
+                       tftp_client_data_fn data_fn,
+                       void *data_arg,
+                       struct tftp_client_priv ** const session)
+{
+    struct tftp_client_priv *tc = NULL;
+    u32_t i;
+    err_t ret = ERR_OK;
+
+    if ((filename == NULL) || (filetype == NULL) || (dst_addr == NULL) || (session == NULL)) {
+        ret = ERR_ARG;
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid args\n", prefix_str));
         goto fail;
     }
-    offset = offset + write_len;
-    write_len = sizeof(null_byte);
-    ret = pbuf_take_at(p, &null_byte, write_len, offset);
-    if (ret != ERR_OK) {
-        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s %s\n", prefix_str, PBUF_TAKE_ERR_MSG("null byte")));
+
+    for (i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        if ((tftp_sessions[i].pcb != NULL) && !tftp_sessions[i].in_use) {
+            tc = &tftp_sessions[i];
+            break;
+        }
+    }
+    if (tc == NULL) {
+        ret = ERR_MEM;
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s No free session for %s\n", prefix_str, filename));
         goto fail;
     }
 
-    /* Send RRQ packet to destination */
-    ret = udp_sendto(tftp_client.pcb, p, &tftp_client.tftp_server_ip, TFTP_SERVER_PORT);
+    /* Restart the progress bar when the first of a group of transfers starts */
+    for (i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        if (tftp_sessions[i].in_use) {
+            break;
+        }
+    }
+    if (i == TFTP_MAX_SESSIONS) {
+        bar_cnt = 0;
+        bar_bytes = 0;
+        next_bar_bytes = PROGRESS_BAR_INTERVAL_BYTES;
+    }
+
+    tc->in_use = true;
+    tc->filename = filename;
+    tc->filetype = filetype;
+    tc->dst_mem_addr = dst_addr;
+    tc->dst_size = dst_size;
+    tc->data_fn = data_fn;
+    tc->data_arg = data_arg;
+
+    lwip_core_lock();
+    ret = session_start(tc, TFTP_USE_OPTIONS);
+    lwip_core_unlock();
     if (ret != ERR_OK) {
-        udp_remove(tftp_client.pcb);
+        tc->in_use = false;
         goto fail;
     }
 
-    /* Wait till full file is received */
-#if TFTP_CLIENT_DEBUG
-    transfer_start_ms = tegrabl_get_timestamp_ms();
-#endif
-    ack_retries = 0;
-    last_ack_retry_blk = 0;
-    while ((tftp_client.is_file_rcvd == false) &&
-           (tftp_client.err == ERR_OK)         &&
-           (ack_retries < TFTP_MAX_ACK_RETRIES)) {
-
-        curr_time_ms = tegrabl_get_timestamp_ms();
+    *session = tc;
 
-        if (curr_time_ms > (tftp_client.last_ack_time_ms + TFTP_ACK_RESEND_TIMEOUT)) {
+fail:
+    return ret;
+}
 
-            /* Exit if haven't received a single packet */
-            if (tftp_client.last_rcvd_blk == 0) {
-                ret = ERR_CONN;
-                LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Connection failed\n", prefix_str));
-                goto fail;
-            }
+err_t
+tftp_client_recv_wait(struct tftp_client_priv * const * const sessions,
+                      u32_t num_sessions,
+                      err_t * const status,
+                      u32_t * const file_size)
+{
+    struct tftp_client_priv *tc;
+    struct tftp_batch batch;
+    u32_t i;
+    err_t ret = ERR_OK;
 
-#if TFTP_CLIENT_DEBUG && !PROGRESS_BAR
-            LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("Resend ACK: %u\n", tftp_client.last_rcvd_blk));
-#endif
-            ret = send_ack(tftp_client.last_rcvd_blk, tftp_client.temp_conn_port);
-            if (ret != ERR_OK) {
-                goto fail;
-            }
+    if ((sessions == NULL) || (status == NULL)) {
+        ret = ERR_ARG;
+        LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("%s Invalid args\n", prefix_str));
+        goto fail;
+    }
 
-            if (last_ack_retry_blk == tftp_client.last_rcvd_blk) {
-                ack_retries++;
-            } else {
-                ack_retries = 0;
-            }
+    /*
+     * The sessions are driven from the network RX thread by their receive callback and timer, which
+     * signal batch.done once the last one of them has finished. Each session gives up on its own
+     * after TFTP_MAX_ACK_RETRIES, so the wait is bounded.
+     */
+    event_init(&batch.done, false, 0);
+    batch.pending = 0;
+
+    lwip_core_lock();
+    for (i = 0; i < num_sessions; i++) {
+        if (!sessions[i]->is_done) {
+            sessions[i]->batch = &batch;
+            batch.pending++;
+        }
+    }
+    lwip_core_unlock();
 
-            last_ack_retry_blk = tftp_client.last_rcvd_blk;
-            tftp_client.exptd_blk = tftp_client.last_rcvd_blk + 1;
+    if (batch.pending != 0U) {
+        (void)event_wait(&batch.done);
+    }
+    event_destroy(&batch.done);
+
+    lwip_core_lock();
+    for (i = 0; i < num_sessions; i++) {
+        tc = sessions[i];
+        status[i] = tc->err;
+        if (tc->err != ERR_OK) {
+            ret = tc->err;
         }
-        tegrabl_udelay(100);
+        if (file_size != NULL) {
+            file_size[i] = tc->tot_data_cnt_bytes;
+        }
+        tc->in_use = false;
     }
+    lwip_core_unlock();
+
+fail:
+    return ret;
+}
+
+err_t
+tftp_client_recv(char * const filename,
+				 char * const filetype,
+				 void * const dst_addr,
+				 u32_t dst_size,
+				 u32_t * const file_size)
+{
+    struct tftp_client_priv *tc = NULL;
+    err_t status;
+    u32_t size;
+    err_t ret = ERR_OK;
 
-    if (ack_retries >= TFTP_MAX_ACK_RETRIES) {
-        ret = ERR_TIMEOUT;
+    ret = tftp_client_recv_start(filename, filetype, dst_addr, dst_size, NULL, NULL, &tc);
+    if (ret != ERR_OK) {
         goto fail;
     }
-    if (tftp_client.err != ERR_OK) {
-        ret = tftp_client.err;
+
+    ret = tftp_client_recv_wait(&tc, 1, &status, &size);
+    if (ret != ERR_OK) {
+        goto fail;
     }
 
 	if (file_size != NULL) {
-		*file_size = tftp_client.tot_data_cnt_bytes;
+		*file_size = size;
 	}
 
 fail:
-    if (p != NULL) {
-        pbuf_free(p);
-    }
     return ret;
 }
 
 void
 tftp_client_deinit(void)
 {
-    if (tftp_client.pcb != NULL) {
-        udp_remove(tftp_client.pcb);
-        tftp_client.pcb = NULL;
+    u32_t i;
+
+    lwip_core_lock();
+    for (i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        sys_untimeout(session_tmr, &tftp_sessions[i]);
+        tftp_sessions[i].batch = NULL;
+        if (tftp_sessions[i].pcb != NULL) {
+            udp_remove(tftp_sessions[i].pcb);
+            tftp_sessions[i].pcb = NULL;
+        }
+        tftp_sessions[i].in_use = false;
     }
+    lwip_core_unlock();
 }
 
 #endif /* LWIP_UDP */
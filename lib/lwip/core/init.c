@@ -95,6 +95,9 @@ PACK_STRUCT_END
 #if (!LWIP_UDP && LWIP_DHCP)
   #error "If you want to use DHCP, you have to define LWIP_UDP=1 in your lwipopts.h"
 #endif
+#if (LWIP_DHCP_BOOT_OPTIONS && !LWIP_DHCP_BOOTP_FILE)
+  #error "If you want to use LWIP_DHCP_BOOT_OPTIONS, you have to define LWIP_DHCP_BOOTP_FILE=1 in your lwipopts.h"
+#endif
 #if (!LWIP_UDP && LWIP_MULTICAST_TX_OPTIONS)
   #error "If you want to use IGMP/LWIP_MULTICAST_TX_OPTIONS, you have to define LWIP_UDP=1 in your lwipopts.h"
 #endif
@@ -156,6 +156,10 @@ static u8_t dhcp_discover_request_options[] = {
 #if LWIP_DHCP_GET_NTP_SRV
   , DHCP_OPTION_NTP
 #endif /* LWIP_DHCP_GET_NTP_SRV */
+#if LWIP_DHCP_BOOT_OPTIONS
+  , DHCP_OPTION_TFTP_SERVERNAME
+  , DHCP_OPTION_BOOTFILE
+#endif /* LWIP_DHCP_BOOT_OPTIONS */
   };
 
 #ifdef DHCP_GLOBAL_XID
@@ -1478,6 +1482,9 @@ dhcp_parse_reply(struct dhcp *dhcp, struct pbuf *p)
 #if LWIP_DHCP_BOOTP_FILE
   /* clear boot file name */
   dhcp->boot_file_name[0] = 0;
+#if LWIP_DHCP_BOOT_OPTIONS
+  dhcp->tftp_server_name[0] = 0;
+#endif /* LWIP_DHCP_BOOT_OPTIONS */
 #endif /* LWIP_DHCP_BOOTP_FILE */
 
   /* parse options */
@@ -1577,6 +1584,22 @@ again:
         LWIP_ERROR("len == 4", len == 4, return ERR_VAL;);
         decode_idx = DHCP_OPTION_IDX_T2;
         break;
+#if LWIP_DHCP_BOOT_OPTIONS
+      case(DHCP_OPTION_TFTP_SERVERNAME):
+      case(DHCP_OPTION_BOOTFILE):
+        {
+          /* strings are copied as they are, not decoded into dhcp_rx_options_val */
+          char *str = (op == DHCP_OPTION_BOOTFILE) ? dhcp->boot_file_name : dhcp->tftp_server_name;
+          u16_t str_len = (op == DHCP_OPTION_BOOTFILE) ? DHCP_BOOT_FILE_LEN : DHCP_TFTP_SERVER_NAME_LEN;
+          u16_t copy_len = LWIP_MIN(len, str_len - 1);
+          if (pbuf_copy_partial(q, str, copy_len, val_offset) != copy_len) {
+            return ERR_BUF;
+          }
+          str[copy_len] = 0;
+          decode_len = 0;
+        }
+        break;
+#endif /* LWIP_DHCP_BOOT_OPTIONS */
       default:
         decode_len = 0;
         LWIP_DEBUGF(DHCP_DEBUG, ("skipping option %"U16_F" in options\n", (u16_t)op));
@@ -1643,7 +1666,12 @@ decode_next:
       LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("invalid overload option: %d\n", (int)overload));
     }
 #if LWIP_DHCP_BOOTP_FILE
-    if (!parse_file_as_options) {
+    if (!parse_file_as_options
+#if LWIP_DHCP_BOOT_OPTIONS
+        /* bootfile option takes precedence over the BOOTP file field */
+        && (dhcp->boot_file_name[0] == 0)
+#endif /* LWIP_DHCP_BOOT_OPTIONS */
+       ) {
       /* only do this for ACK messages */
       if (dhcp_option_given(dhcp, DHCP_OPTION_IDX_MSG_TYPE) &&
         (dhcp_get_option_value(dhcp, DHCP_OPTION_IDX_MSG_TYPE) == DHCP_ACK))
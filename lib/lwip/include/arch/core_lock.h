@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2019, NVIDIA Corporation.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ */
+
+#ifndef LWIP_HDR_ARCH_CORE_LOCK_H
+#define LWIP_HDR_ARCH_CORE_LOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The stack is built with NO_SYS, so it has no locking of its own. The driver thread that feeds it
+ * received frames and runs sys_check_timeouts() holds this lock while doing so, and every other thread
+ * must hold it around any call into lwIP, including pbuf, udp, tcp, netif and dhcp functions.
+ *
+ * Receive, sent, error and timeout callbacks already run with the lock held and must not take it again;
+ * the lock is not recursive.
+ */
+void lwip_core_lock(void);
+void lwip_core_unlock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_ARCH_CORE_LOCK_H */
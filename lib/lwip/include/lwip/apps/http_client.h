@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019, NVIDIA Corporation.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ */
+
+#ifndef LWIP_HDR_APPS_HTTP_CLIENT_H
+#define LWIP_HDR_APPS_HTTP_CLIENT_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize HTTP client
+ * @param http_server_ip HTTP server IP address
+ * @param port HTTP server TCP port
+ * @returns error
+ */
+err_t http_client_init(const u8_t * const http_server_ip, u16_t port);
+
+/**
+ * Called from the receive path for each chunk of the response body, in file order, once it has
+ * been copied to the destination memory. offset is the position of the chunk in the file; a call
+ * with offset 0 means the transfer (re)started from the beginning of the file.
+ */
+typedef void (*http_client_data_fn)(void *arg, u32_t offset, const void *data, u32_t len);
+
+/**
+ * Fetch a file from the HTTP server with a GET request. The response body is written
+ * directly to dst_addr + offset as it arrives.
+ * @param path absolute path of the file on the server
+ * @param dst_addr memory address where the file is to be copied
+ * @param dst_size size of the destination memory
+ * @param offset number of bytes already present at dst_addr from an earlier, interrupted
+ *               transfer; a non-zero offset sends a Range request to resume from there
+ * @param data_fn called for every received chunk, e.g. to hash the file while it streams in, may be NULL
+ * @param data_arg argument passed to data_fn
+ * @param rcvd_size number of bytes of the file present at dst_addr when the call returns,
+ *                  also on failure so that the transfer can be resumed
+ * @returns error
+ */
+err_t http_client_get(const char * const path,
+					  void * const dst_addr,
+					  u32_t dst_size,
+					  u32_t offset,
+					  http_client_data_fn data_fn,
+					  void *data_arg,
+					  u32_t * const rcvd_size);
+
+/**
+ * De-initialize HTTP client
+ */
+void http_client_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_APPS_HTTP_CLIENT_H */
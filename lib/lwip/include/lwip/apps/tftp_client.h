@@ -40,6 +40,49 @@ err_t tftp_client_recv(char * const filename,
 					   u32_t dst_size,
 					   u32_t * const file_size);
 
+/** Per transfer state of the TFTP client */
+struct tftp_client_priv;
+
+/**
+ * Called from the receive path for each block of file data, in file order, once it has been
+ * copied to the destination memory. offset is the position of the block in the file; a call
+ * with offset 0 means the transfer (re)started from the beginning of the file.
+ */
+typedef void (*tftp_client_data_fn)(void *arg, u32_t offset, const void *data, u32_t len);
+
+/**
+ * Request file transfer from TFTP server without waiting for it to complete. Up to
+ * TFTP_MAX_SESSIONS transfers can be in flight at the same time.
+ * @param filename file to be read
+ * @param file_type type of file, ascii or binary
+ * @param dst_addr memory address where received file is to be copied
+ * @param dst_size size of the destination memory
+ * @param data_fn called for every received block, e.g. to hash the file while it streams in, may be NULL
+ * @param data_arg argument passed to data_fn
+ * @param session handle of the started transfer (output)
+ * @returns error
+ */
+err_t tftp_client_recv_start(char * const filename,
+							 char * const file_type,
+							 void * const dst_addr,
+							 u32_t dst_size,
+							 tftp_client_data_fn data_fn,
+							 void *data_arg,
+							 struct tftp_client_priv ** const session);
+
+/**
+ * Wait for transfers started with tftp_client_recv_start() to complete
+ * @param sessions handles of the transfers
+ * @param num_sessions number of handles
+ * @param status per transfer error (output)
+ * @param file_size per transfer size of the received file (output), may be NULL
+ * @returns ERR_OK if all transfers succeeded, otherwise the error of a failed one
+ */
+err_t tftp_client_recv_wait(struct tftp_client_priv * const * const sessions,
+							u32_t num_sessions,
+							err_t * const status,
+							u32_t * const file_size);
+
 /**
  * De-initialize TFTP client
  */
@@ -98,6 +98,38 @@
 #define TFTP_MAX_MODE_LEN     7
 #endif
 
+/**
+ * Block size requested from the server (RFC 2348). The default fills a
+ * standard 1500 byte ethernet MTU without IP fragmentation. Set to 512 to
+ * disable the option.
+ */
+#if !defined TFTP_BLKSIZE || defined __DOXYGEN__
+#define TFTP_BLKSIZE          1468
+#endif
+
+/**
+ * Number of blocks the server may send before waiting for an ACK (RFC 7440).
+ * Set to 1 to disable the option and run in lockstep mode.
+ */
+#if !defined TFTP_WINDOWSIZE || defined __DOXYGEN__
+#define TFTP_WINDOWSIZE       8
+#endif
+
+/**
+ * Request the transfer size from the server (RFC 2349) so that oversized
+ * files are rejected before any data is transferred.
+ */
+#if !defined TFTP_TSIZE || defined __DOXYGEN__
+#define TFTP_TSIZE            1
+#endif
+
+/**
+ * Max. number of transfers the TFTP client can run at the same time
+ */
+#if !defined TFTP_MAX_SESSIONS || defined __DOXYGEN__
+#define TFTP_MAX_SESSIONS     2
+#endif
+
 /**
  * @}
  */
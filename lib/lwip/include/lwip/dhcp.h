@@ -57,6 +57,7 @@ extern "C" {
 #define DHCP_FINE_TIMER_MSECS   500
 
 #define DHCP_BOOT_FILE_LEN      128U
+#define DHCP_TFTP_SERVER_NAME_LEN 64U
 
 /* AutoIP cooperation flags (struct dhcp.autoip_coop_state) */
 typedef enum {
@@ -102,6 +103,9 @@ struct dhcp
 #if LWIP_DHCP_BOOTP_FILE
   ip4_addr_t offered_si_addr;
   char boot_file_name[DHCP_BOOT_FILE_LEN];
+#if LWIP_DHCP_BOOT_OPTIONS
+  char tftp_server_name[DHCP_TFTP_SERVER_NAME_LEN];
+#endif /* LWIP_DHCP_BOOT_OPTIONS */
 #endif /* LWIP_DHCP_BOOTPFILE */
 };
 
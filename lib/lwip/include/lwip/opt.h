@@ -867,6 +867,15 @@
 #define LWIP_DHCP_BOOTP_FILE            0
 #endif
 
+/**
+ * LWIP_DHCP_BOOT_OPTIONS==1: Request and store the TFTP server name (option 66)
+ * in tftp_server_name and the bootfile name (option 67) in boot_file_name.
+ * Requires LWIP_DHCP_BOOTP_FILE.
+ */
+#if !defined LWIP_DHCP_BOOT_OPTIONS || defined __DOXYGEN__
+#define LWIP_DHCP_BOOT_OPTIONS          0
+#endif
+
 /**
  * LWIP_DHCP_GETS_NTP==1: Request NTP servers with discover/select. For each
  * response packet, an callback is called, which has to be provided by the port:
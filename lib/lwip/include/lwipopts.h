@@ -69,6 +69,8 @@
 #define LWIP_DHCP                       1
 #define LWIP_ARP                        1
 #define DHCP_DOES_ARP_CHECK             0
+#define LWIP_DHCP_BOOTP_FILE            1
+#define LWIP_DHCP_BOOT_OPTIONS          1
 #define LWIP_ICMP                       1
 
 /* ENABLE IPV4 */
@@ -78,6 +80,7 @@
 #define LWIP_NETIF_STATUS_CALLBACK      1
 #define MEMP_MEM_MALLOC                 1
 #define LWIP_TIMERS                     1
+#define LWIP_SUPPORT_CUSTOM_PBUF        1   /* RX frames are wrapped in place, see net_boot */
 
 /* Debug related */
 #define LWIP_NOASSERT                   1
@@ -86,6 +89,7 @@
 
 /* Minimal changes to opt.h required for tcp unit tests: */
 #define MEM_SIZE                        16000
+#define TCP_MSS                         1460    /* Full sized segments for HTTP boot */
 #define TCP_SND_QUEUELEN                40
 #define MEMP_NUM_TCP_SEG                TCP_SND_QUEUELEN
 #define TCP_SND_BUF                     (12 * TCP_MSS)
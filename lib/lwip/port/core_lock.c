@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2019, NVIDIA Corporation.  All rights reserved.
+ *
+ * NVIDIA Corporation and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA Corporation is strictly prohibited.
+ */
+
+#include <kernel/mutex.h>
+#include "arch/core_lock.h"
+
+static mutex_t lwip_core_mutex = MUTEX_INITIAL_VALUE(lwip_core_mutex);
+
+void
+lwip_core_lock(void)
+{
+    mutex_acquire(&lwip_core_mutex);
+}
+
+void
+lwip_core_unlock(void)
+{
+    mutex_release(&lwip_core_mutex);
+}
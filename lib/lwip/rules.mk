@@ -24,7 +24,9 @@ include $(LOCAL_DIR)/Filelists.mk
 
 MODULE_SRCS += \
 	$(LWIPNOAPPSFILES) \
-	$(TFTPCLIENTFILES)
+	$(TFTPCLIENTFILES) \
+	$(HTTPCLIENTFILES) \
+	$(LOCAL_DIR)/port/core_lock.c
 
 include make/module.mk
 
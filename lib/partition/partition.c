@@ -23,12 +23,18 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <compiler.h>
 #include <stdlib.h>
 #include <arch.h>
+#include <err.h>
 #include <lib/bio.h>
+#include <lib/cksum.h>
 #include <lib/partition.h>
 
+/* subdevices are named <device>p<n>, n is the MBR slot or GPT entry index */
+#define PARTITION_MAX_SUBDEVS 128
+
 struct chs {
 	uint8_t c;
 	uint8_t h;
@@ -44,6 +50,37 @@ struct mbr_part {
 	uint32_t lba_length;
 } __PACKED;
 
+#define GPT_SIGNATURE "EFI PART"
+#define GPT_HEADER_MIN_SIZE 92
+#define GPT_ENTRY_MIN_SIZE 128
+#define GPT_ENTRIES_MAX_SIZE (64 * 1024)
+
+struct gpt_header {
+	uint8_t signature[8];
+	uint32_t revision;
+	uint32_t header_size;
+	uint32_t header_crc32;
+	uint32_t reserved;
+	uint64_t my_lba;
+	uint64_t alternate_lba;
+	uint64_t first_usable_lba;
+	uint64_t last_usable_lba;
+	uint8_t disk_guid[16];
+	uint64_t entries_lba;
+	uint32_t num_entries;
+	uint32_t entry_size;
+	uint32_t entries_crc32;
+} __PACKED;
+
+struct gpt_entry {
+	uint8_t type_guid[16];
+	uint8_t unique_guid[16];
+	uint64_t first_lba;
+	uint64_t last_lba;
+	uint64_t attributes;
+	uint16_t name[36]; // UTF-16LE
+} __PACKED;
+
 static status_t validate_mbr_partition(bdev_t *dev, const struct mbr_part *part)
 {
 	/* check for invalid types */
@@ -64,6 +101,128 @@ static status_t validate_mbr_partition(bdev_t *dev, const struct mbr_part *part)
 	return 0;
 }
 
+/* read and check the GPT header at lba and its entry array, returns the entries in a malloced buffer */
+static status_t gpt_read(bdev_t *dev, off_t offset, uint64_t lba, uint64_t total_blocks,
+                         struct gpt_header *hdr, uint8_t **entries_out)
+{
+	STACKBUF_DMA_ALIGN(buf, dev->block_size);
+	ssize_t err;
+
+	if (lba >= total_blocks)
+		return ERR_NOT_FOUND;
+
+	err = bio_read(dev, buf, offset + lba * dev->block_size, dev->block_size);
+	if (err < (ssize_t)dev->block_size)
+		return (err < 0) ? err : ERR_IO;
+
+	memcpy(hdr, buf, sizeof(*hdr));
+	if (memcmp(hdr->signature, GPT_SIGNATURE, sizeof(hdr->signature)))
+		return ERR_NOT_FOUND;
+	if (hdr->header_size < GPT_HEADER_MIN_SIZE || hdr->header_size > dev->block_size)
+		return ERR_NOT_VALID;
+
+	/* the header crc is taken with the crc field itself zeroed */
+	memset(buf + offsetof(struct gpt_header, header_crc32), 0, sizeof(hdr->header_crc32));
+	if (crc32(0, buf, hdr->header_size) != hdr->header_crc32) {
+		dprintf(INFO, "gpt header at lba %llu has a bad crc\n", (unsigned long long)lba);
+		return ERR_NOT_VALID;
+	}
+
+	if (hdr->my_lba != lba)
+		return ERR_NOT_VALID;
+	if (hdr->first_usable_lba > hdr->last_usable_lba || hdr->last_usable_lba >= total_blocks)
+		return ERR_NOT_VALID;
+	if (hdr->entry_size < GPT_ENTRY_MIN_SIZE || (hdr->entry_size % 8) != 0)
+		return ERR_NOT_VALID;
+	if (hdr->num_entries == 0 || hdr->num_entries > GPT_ENTRIES_MAX_SIZE / hdr->entry_size)
+		return ERR_NOT_VALID;
+
+	size_t entries_len = hdr->num_entries * hdr->entry_size;
+	size_t read_len = ROUNDUP(entries_len, dev->block_size);
+	if (hdr->entries_lba >= total_blocks || read_len / dev->block_size > total_blocks - hdr->entries_lba)
+		return ERR_NOT_VALID;
+
+	uint8_t *entries = memalign(CACHE_LINE, read_len);
+	if (!entries)
+		return ERR_NO_MEMORY;
+
+	err = bio_read(dev, entries, offset + hdr->entries_lba * dev->block_size, read_len);
+	if (err < (ssize_t)read_len) {
+		free(entries);
+		return (err < 0) ? err : ERR_IO;
+	}
+
+	if (crc32(0, entries, entries_len) != hdr->entries_crc32) {
+		dprintf(INFO, "gpt entries at lba %llu have a bad crc\n", (unsigned long long)hdr->entries_lba);
+		free(entries);
+		return ERR_NOT_VALID;
+	}
+
+	*entries_out = entries;
+	return NO_ERROR;
+}
+
+/* publish the partitions of a GPT disk, returns ERR_NOT_FOUND if there is no usable GPT */
+static int gpt_publish(bdev_t *dev, const char *device, off_t offset)
+{
+	uint64_t total_blocks = (dev->size - offset) / dev->block_size;
+	uint64_t base = offset / dev->block_size;
+	struct gpt_header hdr;
+	uint8_t *entries = NULL;
+	int count = 0;
+	uint i;
+
+	if (offset % dev->block_size)
+		return ERR_NOT_FOUND;
+
+	/* fall back to the backup at the end of the disk if the primary is damaged */
+	status_t err = gpt_read(dev, offset, 1, total_blocks, &hdr, &entries);
+	if (err < 0) {
+		status_t backup_err = gpt_read(dev, offset, total_blocks - 1, total_blocks, &hdr, &entries);
+		if (backup_err < 0)
+			return (err == ERR_NOT_FOUND && backup_err == ERR_NOT_FOUND) ? ERR_NOT_FOUND : err;
+		dprintf(INFO, "gpt primary header unusable (%d), using the backup\n", err);
+	}
+
+	for (i = 0; i < hdr.num_entries && i < PARTITION_MAX_SUBDEVS; i++) {
+		const struct gpt_entry *ent = (const struct gpt_entry *)(entries + i * hdr.entry_size);
+		static const uint8_t unused_guid[16];
+		char label[sizeof(ent->name) / sizeof(ent->name[0]) + 1];
+		char subdevice[128];
+		uint j;
+
+		if (!memcmp(ent->type_guid, unused_guid, sizeof(unused_guid)))
+			continue;
+
+		/* the labels are UTF-16, plain ascii is all the log needs */
+		for (j = 0; j < countof(ent->name) && ent->name[j]; j++)
+			label[j] = (ent->name[j] < 0x80) ? ent->name[j] : '?';
+		label[j] = 0;
+
+		if (ent->first_lba > ent->last_lba || ent->first_lba < hdr.first_usable_lba ||
+		    ent->last_lba > hdr.last_usable_lba || base + ent->last_lba > (bnum_t)~0) {
+			dprintf(INFO, "gpt entry %u '%s' out of range, skipping\n", i, label);
+			continue;
+		}
+
+		sprintf(subdevice, "%sp%u", device, i);
+		dprintf(INFO, "\t%s: '%s' start 0x%llx, len 0x%llx\n", subdevice, label,
+		        (unsigned long long)ent->first_lba, (unsigned long long)(ent->last_lba - ent->first_lba + 1));
+
+		err = bio_publish_subdevice(device, subdevice, base + ent->first_lba,
+		                            ent->last_lba - ent->first_lba + 1);
+		if (err < 0) {
+			dprintf(INFO, "error publishing subdevice '%s'\n", subdevice);
+			continue;
+		}
+		count++;
+	}
+
+	free(entries);
+
+	return count;
+}
+
 int partition_publish(const char *device, off_t offset)
 {
 	int err = 0;
@@ -81,6 +240,15 @@ int partition_publish(const char *device, off_t offset)
 	// get a dma aligned and padded block to read info
 	STACKBUF_DMA_ALIGN(buf, dev->block_size);
 
+	/* GPT goes first, its protective MBR would otherwise show up as one disk sized partition */
+	count = gpt_publish(dev, device, offset);
+	if (count != ERR_NOT_FOUND) {
+		err = count;
+		bio_close(dev);
+		goto err;
+	}
+	count = 0;
+
 	/* sniff for MBR partition types */
 	do {
 		int i;
@@ -136,7 +304,7 @@ int partition_unpublish(const char *device)
 	char devname[512];
 
 	count = 0;
-	for (i=0; i < 16; i++) {
+	for (i=0; i < PARTITION_MAX_SUBDEVS; i++) {
 		sprintf(devname, "%sp%d", device, i);
 
 		dev = bio_open(devname);
@@ -30,8 +30,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <hash.h>
 #include <lib/ptable.h>
 
+/* names are stored in a fixed field and need not be terminated */
+static unsigned ptable_hash(const char *name)
+{
+	return hash_strn(name, MAX_PTENTRY_NAME) & (PTABLE_HASH_SIZE - 1);
+}
+
 void ptable_init(struct ptable *ptable)
 {
 	ASSERT(ptable);
@@ -51,6 +58,13 @@ void ptable_add(struct ptable *ptable, char *name, unsigned start,
 	ptn->start = start;
 	ptn->length = length;
 	ptn->flags = flags;
+
+	/* chain it in the name index, at the tail so the first of duplicate names wins */
+	unsigned char *link = &ptable->hash[ptable_hash(ptn->name)];
+	while (*link)
+		link = &ptable->parts[*link - 1].hash_next;
+	ptn->hash_next = 0;
+	*link = ptable->count;
 }
 
 void ptable_dump(struct ptable *ptable)
@@ -69,11 +83,11 @@ void ptable_dump(struct ptable *ptable)
 struct ptentry *ptable_find(struct ptable *ptable, const char *name)
 {
 	struct ptentry *ptn;
-	int i;
+	unsigned char i;
 
-	for (i = 0; i < ptable->count; ++i) {
-		ptn = &ptable->parts[i];
-		if (!strcmp(ptn->name, name))
+	for (i = ptable->hash[ptable_hash(name)]; i; i = ptn->hash_next) {
+		ptn = &ptable->parts[i - 1];
+		if (!strncmp(ptn->name, name, MAX_PTENTRY_NAME))
 			return ptn;
 	}
 
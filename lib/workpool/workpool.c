@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited
+ */
+
+#include <debug.h>
+#include <err.h>
+#include <limits.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include <arch/ops.h>
+#include <kernel/thread.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <lib/workpool.h>
+#include <lk/init.h>
+
+#define WORKPOOL_MAX_WORKERS	SMP_MAX_CPUS
+
+/* copies below this size aren't worth waking up the workers for */
+#define WORKPOOL_MEMCPY_MIN		(256 * 1024)
+#define WORKPOOL_MEMCPY_GRAIN	(128 * 1024)
+
+struct workpool_worker {
+	thread_t *thread;
+	uint cpu;
+	/* the owner pushes and pops at the head, thieves take from the tail */
+	struct list_node deque;
+	uint queued;
+	bool idle;
+	event_t wake;
+
+	/* statistics */
+	uint tasks;
+	uint steals;
+};
+
+static struct workpool_worker workers[WORKPOOL_MAX_WORKERS];
+static uint num_workers;
+
+static struct workpool_worker *workpool_self(void)
+{
+	uint i;
+
+	for (i = 0; i < num_workers; i++) {
+		if (workers[i].thread == current_thread)
+			return &workers[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Tasks from outside the pool go to the worker with the shortest deque,
+ * preferring the ones not sharing a cpu with the submitter. Called in a
+ * critical section.
+ */
+static struct workpool_worker *workpool_pick(void)
+{
+	struct workpool_worker *w = workpool_self();
+	uint cpu = arch_curr_cpu_num();
+	uint best_score = UINT_MAX;
+	uint i;
+
+	if (w)
+		return w;
+
+	for (i = 0; i < num_workers; i++) {
+		uint score = workers[i].queued * 4;
+
+		if (!workers[i].idle)
+			score += 2;
+		if (workers[i].cpu == cpu)
+			score += 1;
+		if (score < best_score) {
+			best_score = score;
+			w = &workers[i];
+		}
+	}
+
+	return w;
+}
+
+/* called in a critical section */
+static workpool_task_t *workpool_take(struct workpool_worker *self)
+{
+	struct workpool_worker *victim = NULL;
+	workpool_task_t *task;
+	uint i;
+
+	task = list_remove_head_type(&self->deque, workpool_task_t, node);
+	if (task) {
+		self->queued--;
+	} else {
+		for (i = 0; i < num_workers; i++) {
+			if (&workers[i] != self && workers[i].queued > (victim ? victim->queued : 0))
+				victim = &workers[i];
+		}
+		if (!victim)
+			return NULL;
+
+		task = list_remove_tail_type(&victim->deque, workpool_task_t, node);
+		victim->queued--;
+		self->steals++;
+	}
+
+	task->state = WORKPOOL_TASK_RUNNING;
+	self->tasks++;
+
+	return task;
+}
+
+static void workpool_run(workpool_task_t *task)
+{
+	task->fn(task->arg);
+
+	enter_critical_section();
+	task->state = WORKPOOL_TASK_DONE;
+	event_signal(&task->done, false);
+	exit_critical_section();
+}
+
+static int workpool_worker_routine(void *arg)
+{
+	struct workpool_worker *self = arg;
+	workpool_task_t *task;
+
+	for (;;) {
+		event_wait(&self->wake);
+
+		enter_critical_section();
+		task = workpool_take(self);
+		if (!task) {
+			self->idle = true;
+			event_unsignal(&self->wake);
+		}
+		exit_critical_section();
+
+		if (task)
+			workpool_run(task);
+	}
+
+	return 0;
+}
+
+void workpool_task_init(workpool_task_t *task, workpool_fn fn, void *arg)
+{
+	list_clear_node(&task->node);
+	task->fn = fn;
+	task->arg = arg;
+	task->state = WORKPOOL_TASK_IDLE;
+	task->worker = -1;
+	event_init(&task->done, false, 0);
+}
+
+status_t workpool_submit(workpool_task_t *task)
+{
+	struct workpool_worker *w;
+	uint i;
+
+	if (!task || !task->fn)
+		return ERR_INVALID_ARGS;
+
+	if (task->state != WORKPOOL_TASK_IDLE)
+		return ERR_ALREADY_STARTED;
+
+	/* no pool yet, the caller joins on an already finished task */
+	if (num_workers == 0) {
+		task->state = WORKPOOL_TASK_RUNNING;
+		workpool_run(task);
+		return NO_ERROR;
+	}
+
+	enter_critical_section();
+
+	w = workpool_pick();
+	list_add_head(&w->deque, &task->node);
+	w->queued++;
+	task->worker = w - workers;
+	task->state = WORKPOOL_TASK_QUEUED;
+
+	w->idle = false;
+	event_signal(&w->wake, false);
+
+	/* the owner may be busy for a while, let an idle worker steal the task */
+	if (w->queued > 1 || w->thread == current_thread) {
+		for (i = 0; i < num_workers; i++) {
+			if (workers[i].idle) {
+				workers[i].idle = false;
+				event_signal(&workers[i].wake, false);
+				break;
+			}
+		}
+	}
+
+	exit_critical_section();
+
+	return NO_ERROR;
+}
+
+status_t workpool_join(workpool_task_t *task, lk_time_t timeout)
+{
+	if (!task)
+		return ERR_INVALID_ARGS;
+
+	enter_critical_section();
+
+	if (task->state == WORKPOOL_TASK_IDLE) {
+		exit_critical_section();
+		return ERR_NOT_VALID;
+	}
+
+	if (task->state == WORKPOOL_TASK_QUEUED) {
+		list_delete(&task->node);
+		workers[task->worker].queued--;
+		task->state = WORKPOOL_TASK_RUNNING;
+		exit_critical_section();
+
+		workpool_run(task);
+		return NO_ERROR;
+	}
+
+	exit_critical_section();
+
+	return event_wait_timeout(&task->done, timeout);
+}
+
+uint workpool_num_workers(void)
+{
+	return num_workers;
+}
+
+struct workpool_for {
+	workpool_range_fn fn;
+	void *arg;
+	size_t count;
+	size_t grain;
+	int num_chunks;
+	volatile int next_chunk;
+};
+
+/* every participant keeps claiming chunks until they run out */
+static void workpool_for_task(void *arg)
+{
+	struct workpool_for *f = arg;
+	size_t start, end;
+	int chunk;
+
+	while ((chunk = atomic_add(&f->next_chunk, 1)) < f->num_chunks) {
+		start = (size_t)chunk * f->grain;
+		end = start + f->grain;
+		if (end > f->count)
+			end = f->count;
+		f->fn(f->arg, start, end);
+	}
+}
+
+status_t workpool_parallel_for_etc(size_t count, size_t grain, workpool_range_fn fn, void *arg, uint width)
+{
+	workpool_task_t tasks[WORKPOOL_MAX_WORKERS];
+	struct workpool_for f;
+	size_t num_chunks;
+	uint i;
+
+	if (!fn)
+		return ERR_INVALID_ARGS;
+
+	if (count == 0)
+		return NO_ERROR;
+
+	if (grain == 0)
+		grain = 1;
+
+	num_chunks = (count + grain - 1) / grain;
+	if (num_chunks > INT_MAX)
+		return ERR_INVALID_ARGS;
+
+	if ((width == 0) || (width > num_workers))
+		width = num_workers;
+	if (width > num_chunks)
+		width = num_chunks;
+	if (width == 0)
+		width = 1;
+
+	f.fn = fn;
+	f.arg = arg;
+	f.count = count;
+	f.grain = grain;
+	f.num_chunks = (int)num_chunks;
+	f.next_chunk = 0;
+
+	/* the caller is one of the width participants */
+	for (i = 1; i < width; i++) {
+		workpool_task_init(&tasks[i], workpool_for_task, &f);
+		workpool_submit(&tasks[i]);
+	}
+
+	workpool_for_task(&f);
+
+	for (i = 1; i < width; i++)
+		workpool_join(&tasks[i], INFINITE_TIME);
+
+	return NO_ERROR;
+}
+
+struct workpool_memcpy_args {
+	uint8_t *dst;
+	const uint8_t *src;
+};
+
+static void workpool_memcpy_range(void *arg, size_t start, size_t end)
+{
+	struct workpool_memcpy_args *m = arg;
+
+	memcpy(m->dst + start, m->src + start, end - start);
+}
+
+void workpool_memcpy(void *dst, const void *src, size_t len)
+{
+	struct workpool_memcpy_args m = {
+		.dst = dst,
+		.src = src,
+	};
+
+	if ((len < WORKPOOL_MEMCPY_MIN) || (num_workers < 2)) {
+		memcpy(dst, src, len);
+		return;
+	}
+
+	workpool_parallel_for(len, WORKPOOL_MEMCPY_GRAIN, workpool_memcpy_range, &m);
+}
+
+static void workpool_init(uint level)
+{
+	struct workpool_worker *w;
+	char name[32];
+	uint cpu;
+
+	for (cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+		if (!mp_is_cpu_online(cpu))
+			continue;
+
+		w = &workers[num_workers];
+		w->cpu = cpu;
+		list_initialize(&w->deque);
+		event_init(&w->wake, false, 0);
+		w->idle = true;
+
+		snprintf(name, sizeof(name), "workpool %u", cpu);
+		w->thread = thread_create_on_cpu(name, workpool_worker_routine, w, DEFAULT_PRIORITY,
+										 DEFAULT_STACK_SIZE, cpu);
+		if (!w->thread) {
+			dprintf(CRITICAL, "workpool: failed to create worker for cpu %u\n", cpu);
+			event_destroy(&w->wake);
+			continue;
+		}
+
+		/* publish the worker before it can be picked */
+		enter_critical_section();
+		num_workers++;
+		exit_critical_section();
+
+		thread_detach_and_resume(w->thread);
+	}
+
+	dprintf(INFO, "workpool: %u workers\n", num_workers);
+}
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static int cmd_workpool(int argc, const cmd_args *argv)
+{
+	uint i;
+
+	for (i = 0; i < num_workers; i++) {
+		printf("worker %u: cpu %u, queued %u, tasks %u, steals %u\n", i, workers[i].cpu,
+			   workers[i].queued, workers[i].tasks, workers[i].steals);
+	}
+
+	return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("workpool", "dump workpool worker statistics", &cmd_workpool)
+STATIC_COMMAND_END(workpool);
+#endif
+
+LK_INIT_HOOK(workpool, &workpool_init, LK_INIT_LEVEL_THREADING + 1);
@@ -12,6 +12,7 @@
 
 #include <debug.h>
 #include <tegrabl_ar_macro.h>
+#include <arch.h>
 #include <arch/arm64.h>
 #include <arch/mmu.h>
 #include <arch/ops.h>
@@ -319,11 +320,14 @@ void platform_init_mmu_mappings(void)
 	struct tegrabl_linuxboot_memblock *free_dram_regions = NULL;
 	uint32_t free_dram_block_count;
 
+	/* Write all MMIO mappings first and make them visible at once */
+	arm64_mmu_map_begin();
 	for (idx = 0; idx < ARRAY_SIZE(mmio_mappings); idx++) {
 		arm64_mmu_map(mmio_mappings[idx].addr, mmio_mappings[idx].addr,
 				mmio_mappings[idx].size, MMU_FLAG_EXECUTE_NOT |
 				MMU_FLAG_READWRITE | MMU_FLAG_DEVICE);
 	}
+	arm64_mmu_map_commit();
 
 	platform_init_boot_param();
 	/*
@@ -336,11 +340,13 @@ void platform_init_mmu_mappings(void)
 
 	free_dram_block_count = get_free_dram_regions_info(&free_dram_regions);
 
+	arm64_mmu_map_begin();
 	for (i = 0; i < free_dram_block_count; i++) {
 		arm64_mmu_map((uintptr_t)free_dram_regions[i].base,
 				(uintptr_t)free_dram_regions[i].base, free_dram_regions[i].size,
 				MMU_FLAG_CACHED | MMU_FLAG_READWRITE);
 	}
+	arm64_mmu_map_commit();
 }
 
 static void platform_disable_clocks(void)
@@ -377,6 +383,9 @@ void platform_uninit(void)
 	tegrabl_wdt_disable(TEGRABL_WDT_LCCPLEX);
 #endif /* CONFIG_ENABLE_WDT */
 
+	/* power off the secondary cpus while the scheduler still runs */
+	arch_quiesce();
+
 	platform_uninit_timer();
 	arch_disable_ints();
 #if defined(CONFIG_DYNAMIC_LOAD_ADDRESS)
@@ -13,10 +13,13 @@
 #include <debug.h>
 #include <inttypes.h>
 #include <tegrabl_ar_macro.h>
+#include <arch.h>
 #include <arch/arm64.h>
 #include <arch/mmu.h>
 #include <arch/ops.h>
 #include <string.h>
+#include <platform.h>
+#include <kernel/thread.h>
 #include <lib/console.h>
 #include <err.h>
 #include <tegrabl_debug.h>
@@ -399,11 +402,14 @@ void platform_init_mmu_mappings(void)
 	uintptr_t addr;
 	uint32_t gsc_idx;
 
+	/* Write all MMIO mappings first and make them visible at once */
+	arm64_mmu_map_begin();
 	for (idx = 0; idx < ARRAY_SIZE(mmio_mappings); idx++) {
 		arm64_mmu_map(mmio_mappings[idx].addr, mmio_mappings[idx].addr,
 				mmio_mappings[idx].size, MMU_FLAG_EXECUTE_NOT |
 				MMU_FLAG_READWRITE | MMU_FLAG_DEVICE);
 	}
+	arm64_mmu_map_commit();
 
 	platform_init_boot_param();
 	/*
@@ -414,6 +420,8 @@ void platform_init_mmu_mappings(void)
 					CPUBL_PARAMS_SIZE,
 					MMU_FLAG_CACHED | MMU_FLAG_READWRITE | MMU_FLAG_EXECUTE_NOT);
 
+	/* None of the carveouts below is accessed before the batch is committed */
+	arm64_mmu_map_begin();
 	arm64_mmu_map(
 			(uintptr_t)boot_params->carveout_info[CARVEOUT_MISC].base,
 			(uintptr_t)boot_params->carveout_info[CARVEOUT_MISC].base,
@@ -451,6 +459,7 @@ void platform_init_mmu_mappings(void)
 				  (uintptr_t)boot_params->carveout_info[CARVEOUT_OS].base,
 				  boot_params->carveout_info[CARVEOUT_OS].size,
 				  MMU_FLAG_CACHED | MMU_FLAG_READWRITE | MMU_FLAG_EXECUTE_NOT);
+	arm64_mmu_map_commit();
 }
 
 void platform_uninit(void)
@@ -460,6 +469,9 @@ void platform_uninit(void)
 	tegrabl_wdt_disable(TEGRABL_WDT_LCCPLEX);
 #endif /* CONFIG_ENABLE_WDT */
 
+	/* power off the secondary cpus while the scheduler still runs */
+	arch_quiesce();
+
 	platform_uninit_timer();
 
 	arch_disable_ints();
@@ -526,34 +538,84 @@ static tegrabl_error_t platform_init_bldtb_override(void *bl_dtb)
 }
 
 #if defined(CONFIG_ENABLE_SHELL)
-void enter_shell_upon_user_request(void)
+#define SHELL_WAIT_MS	2000
+#define SHELL_POLL_MS	20
+
+static thread_t *shell_wait_thread;
+static bool shell_requested;
+
+/* sleeps between console polls so that platform init keeps running meanwhile */
+static int shell_wait(void *arg)
 {
-	uint32_t i;
+	lk_time_t start = current_time();
 
-	/* wait for 2 seconds for an input from user to enter SHELL */
-	pr_info("Hit any key to stop autoboot:");
-	tegrabl_enable_timestamp(false);
+	TEGRABL_UNUSED(arg);
 
-	for (i = 4; i > 0; i--) {
-		if (tegrabl_getc_wait(500) > 0) {
-			tegrabl_display_printf(GREEN, "BOOTLOADER SHELL MODE\n");
-			tegrabl_printf("\n");
-#if defined(CONFIG_ENABLE_WDT) /*disable wdt in shell*/
-			tegrabl_wdt_disable(TEGRABL_WDT_LCCPLEX);
-#endif
-			(void)console_init();
-			console_start();
+	while ((current_time() - start) < SHELL_WAIT_MS) {
+		if (tegrabl_getc() > 0) {
+			shell_requested = true;
 			break;
 		}
+		thread_sleep(SHELL_POLL_MS);
+	}
+
+	return 0;
+}
+
+static void shell_wait_start(void)
+{
+	/* wait for 2 seconds for an input from user to enter SHELL */
+	pr_info("Hit any key to stop autoboot\n");
+
+	shell_requested = false;
+	shell_wait_thread = thread_create("shell wait", shell_wait, NULL, DEFAULT_PRIORITY,
+									  DEFAULT_STACK_SIZE);
+	if (shell_wait_thread == NULL) {
+		pr_warn("Failed to create shell wait thread\n");
+		return;
+	}
+	thread_resume(shell_wait_thread);
+}
+
+/* on the error exits of platform_init the thread cleans up after itself */
+static void shell_wait_abandon(void)
+{
+	if (shell_wait_thread != NULL) {
+		thread_detach(shell_wait_thread);
+		shell_wait_thread = NULL;
+	}
+}
+
+void enter_shell_upon_user_request(void)
+{
+	lk_time_t start = current_time();
+	lk_time_t waited;
 
-		tegrabl_printf("\t%d", i);
+	if (shell_wait_thread != NULL) {
+		thread_join(shell_wait_thread, NULL, INFINITE_TIME);
+		shell_wait_thread = NULL;
+	} else {
+		(void)shell_wait(NULL);
+	}
+
+	waited = current_time() - start;
+	if (waited < SHELL_WAIT_MS) {
+		pr_info("Autoboot wait overlapped with platform init, %u ms saved\n",
+				(uint32_t)(SHELL_WAIT_MS - waited));
+	}
+
+	if (shell_requested) {
+		tegrabl_display_printf(GREEN, "BOOTLOADER SHELL MODE\n");
+		tegrabl_printf("\n");
+#if defined(CONFIG_ENABLE_WDT) /*disable wdt in shell*/
+		tegrabl_wdt_disable(TEGRABL_WDT_LCCPLEX);
+#endif
+		(void)console_init();
+		console_start();
 	}
-	tegrabl_printf("\n");
 
 	/*enable wdt again, after exiting shell*/
 	wdt_enable();
-
-	tegrabl_enable_timestamp(true);
 }
 #endif
 
@@ -649,6 +711,11 @@ void platform_init(void)
 		goto fail;
 	}
 
+#if defined(CONFIG_ENABLE_SHELL)
+	/* the user gets to interrupt autoboot while storage and display come up */
+	shell_wait_start();
+#endif
+
 	/* configures fixed / fused storage devices */
 	err = config_storage(dev_param, boot_params->storage_devices);
 	if (err != TEGRABL_NO_ERROR) {
@@ -700,6 +767,9 @@ void platform_init(void)
 #endif
 
 fail:
+#if defined(CONFIG_ENABLE_SHELL)
+	shell_wait_abandon();
+#endif
 	if (hang_up) {
 		halt();
 	}
@@ -31,6 +31,23 @@ tegrabl_error_t net_boot_stack_init(void);
 tegrabl_error_t net_boot_load_kernel_images(void ** const boot_img_load_addr,
 											void ** const dtb_load_addr,
 											uint32_t * const boot_img_size);
+
+struct sha256_ctx;
+
+/**
+ * @brief Get the SHA-256 state of the boot image as it was hashed while it was downloaded, so
+ * that a signature check over it does not have to hash the image again. The state is handed out
+ * only once.
+ *
+ * @param data start of the data the caller wants to hash, must be the boot image load address
+ * @param len number of bytes from the start of the boot image the caller wants to hash
+ * @param ctx hash state covering the first hashed_len bytes of the image (output)
+ * @param hashed_len number of bytes covered by ctx, at most len; the caller continues hashing
+ *		  from data + hashed_len (output)
+ *
+ * @return true if a hash state is available, false if the caller has to hash the data itself
+ */
+bool net_boot_get_sha256_state(const void *data, size_t len, struct sha256_ctx *ctx, size_t *hashed_len);
 #endif /* CONFIG_ENABLE_ETHERNET_BOOT */
 
 #endif /* INCLUDED_NET_BOOT_H */
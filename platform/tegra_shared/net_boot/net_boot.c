@@ -29,18 +29,46 @@
 #include <lwip/dhcp.h>
 #include <lwip/snmp.h>
 #include <lwip/apps/tftp_client.h>
+#include <lwip/apps/http_client.h>
+#include <lwip/timeouts.h>
+#include <arch/core_lock.h>
+#include <stdio.h>
+#include <lib/cksum.h>
+#include <lib/workpool.h>
 #include <net_boot.h>
 #include <tegrabl_partition_loader.h>
+#include <tegrabl_carveout_id.h>
+#include <tegrabl_cpubl_params.h>
 #include <tegrabl_binary_types.h>
 #include <tegrabl_auth.h>
+#include <kernel/thread.h>
+#include <kernel/event.h>
+#include <arch/ops.h>
+#include <arch/defines.h>
 
-#define TFTP_SERVER_IP					"10.24.238.35"
 #define KERNEL_IMAGE					"boot.img"
 #define KERNEL_DTB						"tegra194-p2888-0001-p2822-0000.dtb"
 
 #define TFTP_MAX_RRQ_RETRIES			5
 
+#define NET_BOOT_MAX_FILES				8
+#define NET_BOOT_MAX_NAME_LEN			64
+#define NET_BOOT_MANIFEST_MAX_SIZE		4096
+#define NET_BOOT_MANIFEST_FIELDS		5
+#define NET_BOOT_HASH_CHECKPOINT_SIZE	(1024 * 1024)
+#define NET_BOOT_HASH_MAX_CHECKPOINTS	(BOOT_IMAGE_MAX_SIZE / NET_BOOT_HASH_CHECKPOINT_SIZE)
+
+#define HTTP_SERVER_PORT				80
+#define HTTP_MAX_GET_RETRIES			5
+#define HTTP_MAX_PATH_LEN				128
+
 #define MAC_RX_CH0_INTR					(32 + 194)
+
+#define NET_BOOT_RX_BUF_SIZE			1536
+#define NET_BOOT_RX_BUF_COUNT			32
+#define NET_BOOT_RX_BENCHMARK			0
+#define NET_BOOT_RX_BUDGET				16
+#define NET_BOOT_TMR_INTERVAL_MS		100
 #define DHCP_TIMEOUT_MS					(20 * 1000)
 
 #define AUX_INFO_DHCP_TIMEOUT				1
@@ -49,23 +77,98 @@
 #define AUX_INFO_DTB_RECV_ERR				4
 #define AUX_INFO_BOOT_IMAGE_RECV_ERR		5
 #define AUX_INFO_TFTP_CLIENT_INIT_FAILED	6
+#define AUX_INFO_HTTP_CLIENT_INIT_FAILED	7
+#define AUX_INFO_HTTP_GET_ERR				8
+#define AUX_INFO_MANIFEST_RECV_ERR			9
+#define AUX_INFO_MANIFEST_INVALID			10
+#define AUX_INFO_SIZE_MISMATCH				11
+#define AUX_INFO_DIGEST_MISMATCH			12
+#define AUX_INFO_RAW_RECV_ERR				13
+#define AUX_INFO_RAW_RD_REQ_TIMEOUT			14
+
+/* Receive buffer that is handed to lwIP as a PBUF_REF and recycled from pbuf_free() */
+struct rx_pbuf {
+	struct pbuf_custom pc;
+	struct rx_pbuf *next_free;
+	uint8_t *buf;
+};
+
+enum net_boot_file_type {
+	NET_BOOT_FILE_DTB,
+	NET_BOOT_FILE_KERNEL,
+	NET_BOOT_FILE_RAW,
+};
+
+/* File fetched from the boot server, as described by the manifest */
+struct net_boot_file {
+	char name[NET_BOOT_MAX_NAME_LEN];
+	enum net_boot_file_type type;
+	void *load_addr;
+	uint32_t max_size;
+	uint32_t expected_size;			/* 0 if the manifest does not give a size */
+	uint8_t sha256[SHA256_DIGEST_LEN];
+	bool has_sha256;
+	bool is_loaded;
+	struct sha256_ctx hash_ctx;		/* fed from the receive path while the file streams in */
+	uint32_t hashed_size;
+	bool is_hash_valid;
+	uint32_t size;
+	uint32_t num_rrq;
+	uint32_t aux_info_recv_err;
+	uint32_t aux_info_rrq_timeout;
+};
+
+struct net_boot_manifest {
+	uint8_t server_ip[4];
+	uint32_t num_files;
+	struct net_boot_file files[NET_BOOT_MAX_FILES];
+};
+
+/*
+ * Used when DHCP does not name a manifest. Each line is
+ *
+ *   <type> <name> <load_addr> <size> <sha256>
+ *
+ * where type is "kernel", "dtb" or "raw", load_addr is hex and size decimal. load_addr, size and sha256
+ * may be "-" to use the platform load address, accept any size up to the platform limit for the type and
+ * skip the digest check; raw images need both a load address and a size. Lines starting with '#' are
+ * comments.
+ */
+static const char default_manifest[] =
+	"dtb " KERNEL_DTB " - - -\n"
+	"kernel " KERNEL_IMAGE " - - -\n";
+
+extern int _start;
+extern int _end;
+extern struct tboot_cpubl_params *boot_params;
 
 static struct netif netif;
 struct netif *saved_netif;
 
-static void convert_ip_str_to_int(char * const ip_addr_str, uint8_t * const ip_addr_int)
-{
-	uint32_t i = 0;
-	char *tok = strtok(ip_addr_str, ".");
+static uint8_t rx_bufs[NET_BOOT_RX_BUF_COUNT][NET_BOOT_RX_BUF_SIZE] __ALIGNED(CACHE_LINE);
+static uint8_t rx_drop_buf[NET_BOOT_RX_BUF_SIZE] __ALIGNED(CACHE_LINE);
+static struct rx_pbuf rx_pbufs[NET_BOOT_RX_BUF_COUNT];
+static struct rx_pbuf *rx_free_list;
 
-	while (tok != NULL) {
-		pr_trace("tok = %s\n", tok);
-		ip_addr_int[i] = tegrabl_utils_strtoul(tok, NULL, 10);
-		pr_trace("ip = %u\n", ip_addr_int[i]);
-		tok = strtok(NULL, ".");
-		i++;
-	}
-}
+static struct net_boot_manifest manifest;
+static char manifest_buf[NET_BOOT_MANIFEST_MAX_SIZE + 1];
+
+/* Hash state of the downloaded boot image at every NET_BOOT_HASH_CHECKPOINT_SIZE boundary */
+static struct sha256_ctx kernel_hash_checkpoints[NET_BOOT_HASH_MAX_CHECKPOINTS];
+static uint32_t num_kernel_hash_checkpoints;
+static struct net_boot_file *kernel_hash_file;
+
+static event_t rx_event;
+static event_t netif_status_event;
+static thread_t *rx_thread;
+static volatile bool rx_thread_stop;
+static volatile bool rx_polling;
+
+#if NET_BOOT_RX_BENCHMARK
+static uint64_t rx_total_cycles;
+static uint32_t rx_max_cycles;
+static uint32_t rx_pkt_cnt;
+#endif
 
 err_t pass_network_packet_to_ethernet_controller(struct netif *netif, struct pbuf *p)
 {
@@ -78,7 +181,10 @@ err_t pass_network_packet_to_ethernet_controller(struct netif *netif, struct pbu
 	 */
 	for (tx_data = p; tx_data != NULL; tx_data = tx_data->next) {
 		tegrabl_eqos_send(tx_data->payload, tx_data->len);
-		unmask_interrupt(MAC_RX_CH0_INTR);   /* Enable interrupt */
+		/* Enable interrupt, unless the RX thread is polling with it masked */
+		if (!rx_polling) {
+			unmask_interrupt(MAC_RX_CH0_INTR);
+		}
 	}
 
 	/* Increment packet counters */
@@ -94,13 +200,55 @@ err_t pass_network_packet_to_ethernet_controller(struct netif *netif, struct pbu
 	return ERR_OK;
 }
 
+static void rx_pbuf_free(struct pbuf *p)
+{
+	struct rx_pbuf *rx = (struct rx_pbuf *)p;
+
+	/* pbufs may be released from the main thread (e.g. by lwIP timers) while the RX IRQ allocates */
+	enter_critical_section();
+	rx->next_free = rx_free_list;
+	rx_free_list = rx;
+	exit_critical_section();
+}
+
+static struct rx_pbuf *rx_pbuf_get(void)
+{
+	struct rx_pbuf *rx;
+
+	enter_critical_section();
+	rx = rx_free_list;
+	if (rx != NULL) {
+		rx_free_list = rx->next_free;
+	}
+	exit_critical_section();
+
+	return rx;
+}
+
+static void rx_pbuf_pool_init(void)
+{
+	uint32_t i;
+
+	rx_free_list = NULL;
+	for (i = 0; i < NET_BOOT_RX_BUF_COUNT; i++) {
+		rx_pbufs[i].pc.custom_free_function = rx_pbuf_free;
+		rx_pbufs[i].buf = rx_bufs[i];
+		rx_pbufs[i].next_free = rx_free_list;
+		rx_free_list = &rx_pbufs[i];
+	}
+}
+
 err_t process_ethernet_frame(void)
 {
 	struct pbuf *p = NULL;
-	size_t len;
+	struct rx_pbuf *rx = NULL;
+	size_t len = 0;
 	struct netif *netif = saved_netif;
-	uint8_t payload[1536];
 	err_t err = ERR_OK;
+#if NET_BOOT_RX_BENCHMARK
+	uint32_t start_cycles = arch_cycle_count();
+	uint32_t cycles;
+#endif
 
 	if (saved_netif == NULL) {
 		pr_error("Invalid netif\n");
@@ -108,82 +256,198 @@ err_t process_ethernet_frame(void)
 		goto fail;
 	}
 
-	tegrabl_eqos_receive(&payload, &len);
-	/* cboot only supports TFTP. Packages with size larger
-	 * than standard TFTP package (with 512 bytes TFTP
-	 * data for each package) will be dropped.
-	 * Ping (ICMP) with size less than 512 is also supported.
+	/*
+	 * The frame is received straight into a pool buffer which lwIP then references in place, so the
+	 * only copy left on the TFTP path is the one into the final load address.
 	 */
-	if (len > 562) {
+	rx = rx_pbuf_get();
+	if (rx == NULL) {
+		/* Still drain the controller so that the RX descriptor is returned to the DMA */
+		tegrabl_eqos_receive(rx_drop_buf, &len);
+		LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE , ("No RX buffer, dropping packet\n"));
 		LINK_STATS_INC(link.memerr);
 		LINK_STATS_INC(link.drop);
 		MIB2_STATS_NETIF_INC(netif, ifindiscards);
 		err = ERR_MEM;
 		goto fail;
 	}
-	p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
-	if (p != NULL) {
-		pbuf_copy_from_userbuffer(p, payload, len);
-		MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
-		if (((u8_t *)p->payload)[0] & 1) {
-			/* broadcast or multicast packet*/
-			LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS,
-						("broadcast/multicast packet\n"));
-			MIB2_STATS_NETIF_INC(netif, ifinnucastpkts);
-		} else {
-			/* unicast packet*/
-			LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("unicast\n"));
-			MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
-		}
 
-		LINK_STATS_INC(link.recv);
-	} else {
+	tegrabl_eqos_receive(rx->buf, &len);
+	if ((len == 0) || (len > NET_BOOT_RX_BUF_SIZE)) {
+		LINK_STATS_INC(link.lenerr);
+		LINK_STATS_INC(link.drop);
+		MIB2_STATS_NETIF_INC(netif, ifindiscards);
+		rx_pbuf_free(&rx->pc.pbuf);
+		err = ERR_MEM;
+		goto fail;
+	}
+
+	p = pbuf_alloced_custom(PBUF_RAW, (u16_t)len, PBUF_REF, &rx->pc, rx->buf, NET_BOOT_RX_BUF_SIZE);
+	if (p == NULL) {
 		LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE , ("Dropping Packet / Do Nothing\n"));
 		LINK_STATS_INC(link.memerr);
 		LINK_STATS_INC(link.drop);
 		MIB2_STATS_NETIF_INC(netif, ifindiscards);
+		rx_pbuf_free(&rx->pc.pbuf);
+		err = ERR_MEM;
 		goto fail;
 	}
 
+	MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
+	if (((u8_t *)p->payload)[0] & 1) {
+		/* broadcast or multicast packet*/
+		LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS,
+					("broadcast/multicast packet\n"));
+		MIB2_STATS_NETIF_INC(netif, ifinnucastpkts);
+	} else {
+		/* unicast packet*/
+		LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("unicast\n"));
+		MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
+	}
+	LINK_STATS_INC(link.recv);
+
+	/* lwIP owns the pbuf once netif_input() succeeds and returns the buffer via rx_pbuf_free() */
 	err = netif_input(p, netif);
 	if (err != ERR_OK) {
 		pr_error("Network layer failed to process packet, err: %d\n", err);
+		pbuf_free(p);
 		goto fail;
 	}
 
-fail:
-	if (p != NULL) {
-		pbuf_free(p);
+#if NET_BOOT_RX_BENCHMARK
+	cycles = arch_cycle_count() - start_cycles;
+	rx_total_cycles += cycles;
+	rx_pkt_cnt++;
+	if (cycles > rx_max_cycles) {
+		rx_max_cycles = cycles;
 	}
+#endif
 
+fail:
 	return err;
 }
 
+#if NET_BOOT_RX_BENCHMARK
+static void net_boot_rx_benchmark_report(const char *name)
+{
+	if (rx_pkt_cnt != 0) {
+		pr_info("%s: RX %u pkts, avg %llu cycles/pkt, max %u cycles\n", name, rx_pkt_cnt,
+				rx_total_cycles / rx_pkt_cnt, rx_max_cycles);
+	}
+	rx_total_cycles = 0;
+	rx_max_cycles = 0;
+	rx_pkt_cnt = 0;
+}
+#endif
+
 /* This callback will get called when interface is brought up/down or address is changed while up */
 static void netif_status_callback(struct netif *netif)
 {
 	pr_info("netif status changed %s\n", ip4addr_ntoa(netif_ip4_addr(netif)));
+	event_signal(&netif_status_event, false);
 }
 
 static handler_return_t pass_ethernet_frame_to_network_stack(void *arg)
 {
 	TEGRABL_UNUSED(arg);
 
+	/* Keep the interrupt masked until the RX thread has drained the controller */
 	mask_interrupt(MAC_RX_CH0_INTR);
-	/* TODO: Handle or defer using RESCHED */
-	if (tegrabl_eqos_is_dma_rx_intr_occured()) {
-		tegrabl_eqos_clear_dma_rx_intr();
-		process_ethernet_frame();               /* Call LWIP to process RX */
+	rx_polling = true;
+	event_signal(&rx_event, false);
+
+	return INT_RESCHEDULE;
+}
+
+/*
+ * Runs the lwIP input path (and with it the TFTP/HTTP receive callbacks and progress bar) in thread
+ * context. Each wakeup processes up to NET_BOOT_RX_BUDGET frames; while frames keep arriving the thread
+ * stays in poll mode with the interrupt masked and only goes back to interrupt mode once the controller
+ * is idle. The thread also drives the lwIP timers (ARP, DHCP, TCP retransmission and delayed ACKs).
+ * The boot thread calls into lwIP as well, so both hold the lwIP core lock while in the stack.
+ */
+static int net_rx_thread(void *arg)
+{
+	uint32_t budget;
+
+	TEGRABL_UNUSED(arg);
+
+	while (!rx_thread_stop) {
+		(void)event_wait_timeout(&rx_event, NET_BOOT_TMR_INTERVAL_MS);
+		if (!rx_polling) {
+			/* Timer wakeup, no RX interrupt pending */
+			lwip_core_lock();
+			sys_check_timeouts();
+			lwip_core_unlock();
+			continue;
+		}
+
+		do {
+			budget = NET_BOOT_RX_BUDGET;
+			lwip_core_lock();
+			while ((budget > 0) && !rx_thread_stop && tegrabl_eqos_is_dma_rx_intr_occured()) {
+				tegrabl_eqos_clear_dma_rx_intr();
+				process_ethernet_frame();               /* Call LWIP to process RX */
+				budget--;
+			}
+			lwip_core_unlock();
+			if (budget == 0) {
+				thread_yield();
+			}
+		} while ((budget == 0) && !rx_thread_stop);
+
+		if (!rx_thread_stop) {
+			rx_polling = false;
+			unmask_interrupt(MAC_RX_CH0_INTR);
+		}
+
+		lwip_core_lock();
+		sys_check_timeouts();
+		lwip_core_unlock();
+	}
+
+	return 0;
+}
+
+static tegrabl_error_t net_rx_thread_start(void)
+{
+	tegrabl_error_t error = TEGRABL_NO_ERROR;
+
+	event_init(&rx_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+	rx_thread_stop = false;
+	rx_polling = false;
+
+	rx_thread = thread_create("net_rx", net_rx_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+	if (rx_thread == NULL) {
+		pr_error("Failed to create net RX thread\n");
+		error = TEGRABL_ERROR(TEGRABL_ERR_NO_MEMORY, 0);
+		goto done;
+	}
+	thread_resume(rx_thread);
+
+done:
+	return error;
+}
+
+static void net_rx_thread_stop(void)
+{
+	if (rx_thread == NULL) {
+		return;
 	}
-	unmask_interrupt(MAC_RX_CH0_INTR);
 
-	return INT_NO_RESCHEDULE;
+	mask_interrupt(MAC_RX_CH0_INTR);
+	rx_thread_stop = true;
+	event_signal(&rx_event, true);
+	thread_join(rx_thread, NULL, INFINITE_TIME);
+	rx_thread = NULL;
+	event_destroy(&rx_event);
 }
 
 static err_t platform_netif_init(struct netif *netif)
 {
 	tegrabl_error_t error = TEGRABL_NO_ERROR;
 
+	rx_pbuf_pool_init();
 	register_int_handler(MAC_RX_CH0_INTR, pass_ethernet_frame_to_network_stack, 0);
 
 	/* Initialize ethernet i/f - MAC and PHY */
@@ -210,12 +474,18 @@ static err_t platform_netif_init(struct netif *netif)
 	netif->linkoutput = &pass_network_packet_to_ethernet_controller;
 	netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;  /* Program netif capabilties */
 	netif->flags |= NETIF_FLAG_LINK_UP;  /* MAC controller initialization is successful means link is up */
+	event_init(&netif_status_event, false, EVENT_FLAG_AUTOUNSIGNAL);
 	netif_set_status_callback(netif, netif_status_callback);
 	netif_set_default(netif);
 
 	/* Assume link is up - We will reach here only if link is up */
 	netif_set_link_up(netif);
 
+	error = net_rx_thread_start();
+	if (error != TEGRABL_NO_ERROR) {
+		goto cleanup;
+	}
+
 	goto done;
 
 cleanup:
@@ -224,6 +494,17 @@ done:
 	return (err_t)error;
 }
 
+static bool net_boot_dhcp_bound(void)
+{
+	bool bound;
+
+	lwip_core_lock();
+	bound = (dhcp_supplied_address(&netif) != 0);
+	lwip_core_unlock();
+
+	return bound;
+}
+
 tegrabl_error_t net_boot_stack_init(void)
 {
 	uint8_t *ip_addr = NULL;
@@ -238,8 +519,11 @@ tegrabl_error_t net_boot_stack_init(void)
 
 	lwip_init();
 
+	/* platform_netif_init() starts the RX thread, which waits for the lock until the netif is added */
+	lwip_core_lock();
 	ret_netif = netif_add(&netif, IP4_ADDR_ANY, IP4_ADDR_ANY, IP4_ADDR_ANY, NULL, &platform_netif_init,
 						  &netif_input);
+	lwip_core_unlock();
 	if (ret_netif == NULL) {
 		err = TEGRABL_ERROR(TEGRABL_ERR_ADD_FAILED, 0);
 		pr_error("Failed to add interface to the lwip netifs list\n");
@@ -253,9 +537,10 @@ tegrabl_error_t net_boot_stack_init(void)
 		pr_info("DHCP: Init: Requesting IP ...\n");
 
 		/* Bring an interface up, available for processing */
+		lwip_core_lock();
 		netif_set_up(&netif);
-
 		err = (tegrabl_error_t)dhcp_start(&netif);
+		lwip_core_unlock();
 		if (err != TEGRABL_NO_ERROR) {
 			pr_error("DHCP failed\n");
 			goto fail;
@@ -263,24 +548,27 @@ tegrabl_error_t net_boot_stack_init(void)
 
 		start_time_ms = tegrabl_get_timestamp_ms();
 
-		while (dhcp_supplied_address(&netif) == 0) {
+		while (!net_boot_dhcp_bound()) {
 			elapsed_time_ms = tegrabl_get_timestamp_ms() - start_time_ms;
 			if (elapsed_time_ms > DHCP_TIMEOUT_MS) {
 				pr_error("Failed to acquire IP address via DHCP within timeout\n");
 				err = TEGRABL_ERROR(TEGRABL_ERR_TIMEOUT, AUX_INFO_DHCP_TIMEOUT);
 				goto fail;
 			}
-			tegrabl_mdelay(500);
-			dhcp_fine_tmr();
+			/* DHCP runs in the net RX thread, which signals us once the address is bound */
+			(void)event_wait_timeout(&netif_status_event, DHCP_TIMEOUT_MS - elapsed_time_ms);
 		}
+		pr_info("DHCP: bound after %u ms\n", (uint32_t)(tegrabl_get_timestamp_ms() - start_time_ms));
 
 	} else {
 		pr_info("Configure Static IP ...\n");
 		memcpy(&static_ip.addr, &info.static_ip, 4);
 		memcpy(&netmask.addr, &info.ip_netmask, 4);
 		memcpy(&gateway.addr, &info.ip_gateway, 4);
+		lwip_core_lock();
 		netif_set_addr(&netif, &static_ip, &netmask, &gateway);
 		netif_set_up(&netif);
+		lwip_core_unlock();
 	}
 
 	ip_addr = (uint8_t *)(&(netif.ip_addr.addr));
@@ -290,69 +578,734 @@ fail:
 	return err;
 }
 
-static tegrabl_error_t download_kernel_from_tftp(uint8_t *tftp_server_ip,
-												 void *boot_img_load_addr,
-												 void *dtb_load_addr,
-												 uint32_t *boot_img_size)
+static int hex_nibble(char c)
 {
+	if ((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	if ((c >= 'a') && (c <= 'f')) {
+		return c - 'a' + 10;
+	}
+	if ((c >= 'A') && (c <= 'F')) {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+static bool parse_sha256(const char *str, uint8_t *digest)
+{
+	int hi;
+	int lo;
+	uint32_t i;
+
+	if (strlen(str) != (2 * SHA256_DIGEST_LEN)) {
+		return false;
+	}
+
+	for (i = 0; i < SHA256_DIGEST_LEN; i++) {
+		hi = hex_nibble(str[2 * i]);
+		lo = hex_nibble(str[2 * i + 1]);
+		if ((hi < 0) || (lo < 0)) {
+			return false;
+		}
+		digest[i] = (uint8_t)((hi << 4) | lo);
+	}
+
+	return true;
+}
+
+static tegrabl_error_t net_boot_manifest_add_line(struct net_boot_manifest *m, char *line)
+{
+	char *tok[NET_BOOT_MANIFEST_FIELDS];
+	struct net_boot_file *file;
+	uint32_t num_tok = 0;
+	char *t;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	t = strtok(line, " \t\r");
+	while ((t != NULL) && (num_tok < NET_BOOT_MANIFEST_FIELDS)) {
+		tok[num_tok++] = t;
+		t = strtok(NULL, " \t\r");
+	}
+
+	if ((num_tok == 0) || (tok[0][0] == '#')) {
+		goto done;
+	}
+
+	if ((num_tok != NET_BOOT_MANIFEST_FIELDS) || (t != NULL)) {
+		pr_error("Manifest: expected %u fields in entry for %s\n", NET_BOOT_MANIFEST_FIELDS, tok[0]);
+		goto invalid;
+	}
+
+	if (m->num_files == NET_BOOT_MAX_FILES) {
+		pr_error("Manifest: more than %u files\n", NET_BOOT_MAX_FILES);
+		goto invalid;
+	}
+
+	file = &m->files[m->num_files];
+	memset(file, 0, sizeof(*file));
+
+	if (strcmp(tok[0], "kernel") == 0) {
+		file->type = NET_BOOT_FILE_KERNEL;
+	} else if (strcmp(tok[0], "dtb") == 0) {
+		file->type = NET_BOOT_FILE_DTB;
+	} else if (strcmp(tok[0], "raw") == 0) {
+		file->type = NET_BOOT_FILE_RAW;
+	} else {
+		pr_error("Manifest: unknown file type %s\n", tok[0]);
+		goto invalid;
+	}
+
+	if (strlen(tok[1]) >= NET_BOOT_MAX_NAME_LEN) {
+		pr_error("Manifest: file name %s too long\n", tok[1]);
+		goto invalid;
+	}
+	strcpy(file->name, tok[1]);
+
+	if (strcmp(tok[2], "-") != 0) {
+		file->load_addr = (void *)(uintptr_t)tegrabl_utils_strtoul(tok[2], NULL, 16);
+	}
+	if (strcmp(tok[3], "-") != 0) {
+		file->expected_size = (uint32_t)tegrabl_utils_strtoul(tok[3], NULL, 10);
+	}
+	if (strcmp(tok[4], "-") != 0) {
+		if (!parse_sha256(tok[4], file->sha256)) {
+			pr_error("Manifest: invalid SHA-256 digest for %s\n", file->name);
+			goto invalid;
+		}
+		file->has_sha256 = true;
+	}
+
+	m->num_files++;
+	goto done;
+
+invalid:
+	err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_MANIFEST_INVALID);
+done:
+	return err;
+}
+
+static tegrabl_error_t net_boot_manifest_parse(struct net_boot_manifest *m, char *buf)
+{
+	char *line = buf;
+	char *eol;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	m->num_files = 0;
+
+	while ((line != NULL) && (*line != '\0')) {
+		eol = strchr(line, '\n');
+		if (eol != NULL) {
+			*eol++ = '\0';
+		}
+		err = net_boot_manifest_add_line(m, line);
+		if (err != TEGRABL_NO_ERROR) {
+			goto fail;
+		}
+		line = eol;
+	}
+
+fail:
+	return err;
+}
+
+static bool ranges_overlap(uintptr_t a_start, uint32_t a_size, uintptr_t b_start, uint32_t b_size)
+{
+	return (a_start < (b_start + b_size)) && (b_start < (a_start + a_size));
+}
+
+static bool range_within(uintptr_t start, uint32_t size, uint64_t window_start, uint64_t window_size)
+{
+	return (window_size != 0) && (start >= window_start) &&
+		   (((uint64_t)start + size) <= (window_start + window_size));
+}
+
+/*
+ * The manifest may come from DHCP and is not authenticated, so it must not be able to place a download
+ * over the heap, stacks, page tables or a carveout. Images may only go to the boot.img and DTB load areas
+ * and the OS carveout.
+ */
+static bool net_boot_load_addr_allowed(const struct net_boot_file *file, void *boot_img_load_addr,
+									   void *dtb_load_addr)
+{
+	uintptr_t start = (uintptr_t)file->load_addr;
+
+	return range_within(start, file->max_size, (uintptr_t)boot_img_load_addr, BOOT_IMAGE_MAX_SIZE) ||
+		   range_within(start, file->max_size, (uintptr_t)dtb_load_addr, DTB_MAX_SIZE) ||
+		   range_within(start, file->max_size, boot_params->carveout_info[CARVEOUT_OS].base,
+						boot_params->carveout_info[CARVEOUT_OS].size);
+}
+
+/*
+ * Fill in the platform defaults for each entry and check the manifest before anything is downloaded or
+ * hashed in place: exactly one kernel and one DTB, sizes within the platform limits, every image inside
+ * a platform load area and no two images, or an image and the bootloader itself, sharing memory.
+ */
+static tegrabl_error_t net_boot_manifest_validate(struct net_boot_manifest *m,
+												  void *boot_img_load_addr,
+												  void *dtb_load_addr)
+{
+	struct net_boot_file *file;
+	uintptr_t cboot_start = (uintptr_t)&_start;
+	uint32_t cboot_size = (uint32_t)((uintptr_t)&_end - cboot_start);
+	uint32_t num_kernel = 0;
+	uint32_t num_dtb = 0;
+	uint32_t i;
+	uint32_t j;
+
+	for (i = 0; i < m->num_files; i++) {
+		file = &m->files[i];
+
+		switch (file->type) {
+		case NET_BOOT_FILE_KERNEL:
+			num_kernel++;
+			file->max_size = BOOT_IMAGE_MAX_SIZE;
+			if (file->load_addr == NULL) {
+				file->load_addr = boot_img_load_addr;
+			}
+			file->aux_info_recv_err = AUX_INFO_BOOT_IMAGE_RECV_ERR;
+			file->aux_info_rrq_timeout = AUX_INFO_BOOT_IMAGE_RD_REQ_TIMEOUT;
+			break;
+		case NET_BOOT_FILE_DTB:
+			num_dtb++;
+			file->max_size = DTB_MAX_SIZE;
+			if (file->load_addr == NULL) {
+				file->load_addr = dtb_load_addr;
+			}
+			file->aux_info_recv_err = AUX_INFO_DTB_RECV_ERR;
+			file->aux_info_rrq_timeout = AUX_INFO_DTB_RD_REQ_TIMEOUT;
+			break;
+		default:
+			if ((file->load_addr == NULL) || (file->expected_size == 0)) {
+				pr_error("Manifest: %s needs a load address and a size\n", file->name);
+				goto invalid;
+			}
+			file->max_size = file->expected_size;
+			file->aux_info_recv_err = AUX_INFO_RAW_RECV_ERR;
+			file->aux_info_rrq_timeout = AUX_INFO_RAW_RD_REQ_TIMEOUT;
+			break;
+		}
+
+		if (file->expected_size > file->max_size) {
+			pr_error("Manifest: %s is %u bytes, limit is %u\n", file->name, file->expected_size, file->max_size);
+			goto invalid;
+		}
+		/* Stream into a buffer of exactly the expected size so that a larger file fails on the first excess block */
+		if (file->expected_size != 0) {
+			file->max_size = file->expected_size;
+		}
+
+		if (!net_boot_load_addr_allowed(file, boot_img_load_addr, dtb_load_addr)) {
+			pr_error("Manifest: %s at %p is outside the load areas\n", file->name, file->load_addr);
+			goto invalid;
+		}
+		if (ranges_overlap((uintptr_t)file->load_addr, file->max_size, cboot_start, cboot_size)) {
+			pr_error("Manifest: %s overlaps the bootloader\n", file->name);
+			goto invalid;
+		}
+		for (j = 0; j < i; j++) {
+			if (ranges_overlap((uintptr_t)file->load_addr, file->max_size,
+							   (uintptr_t)m->files[j].load_addr, m->files[j].max_size)) {
+				pr_error("Manifest: %s overlaps %s\n", file->name, m->files[j].name);
+				goto invalid;
+			}
+		}
+	}
+
+	if ((num_kernel != 1) || (num_dtb != 1)) {
+		pr_error("Manifest: needs exactly one kernel and one dtb\n");
+		goto invalid;
+	}
+
+	return TEGRABL_NO_ERROR;
+
+invalid:
+	return TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_MANIFEST_INVALID);
+}
+
+/*
+ * Receive path callback that hashes each file while it streams in, overlapping the hash with the network
+ * latency, so that neither the manifest check nor the boot image signature check needs another pass
+ * over the file. For the boot image the hash state is also saved at every checkpoint boundary, see
+ * net_boot_get_sha256_state().
+ */
+static void net_boot_hash_data(void *arg, u32_t offset, const void *data, u32_t len)
+{
+	struct net_boot_file *file = arg;
+	const uint8_t *p = data;
+	bool is_kernel = (file->type == NET_BOOT_FILE_KERNEL);
+	uint32_t chunk;
+	uint32_t next_checkpoint;
+
+	if (offset == 0) {
+		/* Transfer (re)started */
+		cksum_sha256_init(&file->hash_ctx);
+		file->hashed_size = 0;
+		file->is_hash_valid = true;
+		if (is_kernel) {
+			num_kernel_hash_checkpoints = 0;
+		}
+	}
+
+	if (!file->is_hash_valid || (offset != file->hashed_size)) {
+		file->is_hash_valid = false;
+		return;
+	}
+
+	while (len > 0) {
+		chunk = len;
+		if (is_kernel) {
+			next_checkpoint = (num_kernel_hash_checkpoints + 1) * NET_BOOT_HASH_CHECKPOINT_SIZE;
+			if (chunk > (next_checkpoint - file->hashed_size)) {
+				chunk = next_checkpoint - file->hashed_size;
+			}
+		}
+
+		cksum_sha256_update(&file->hash_ctx, p, chunk);
+		file->hashed_size += chunk;
+		p += chunk;
+		len -= chunk;
+
+		if (is_kernel && ((file->hashed_size % NET_BOOT_HASH_CHECKPOINT_SIZE) == 0) &&
+			(num_kernel_hash_checkpoints < NET_BOOT_HASH_MAX_CHECKPOINTS)) {
+			kernel_hash_checkpoints[num_kernel_hash_checkpoints++] = file->hash_ctx;
+		}
+	}
+}
+
+static void net_boot_hash_start(struct net_boot_file *file)
+{
+	/* Also covers empty files, for which the receive path never calls back */
+	net_boot_hash_data(file, 0, NULL, 0);
+	if (file->type == NET_BOOT_FILE_KERNEL) {
+		kernel_hash_file = file;
+	}
+}
+
+/* Check a received file against the size and digest given in the manifest */
+static tegrabl_error_t net_boot_file_verify(struct net_boot_file *file)
+{
+	struct sha256_ctx ctx;
+	uint8_t digest[SHA256_DIGEST_LEN];
+
+	if ((file->expected_size != 0) && (file->size != file->expected_size)) {
+		pr_error("%s: received %u bytes, manifest says %u\n", file->name, file->size, file->expected_size);
+		return TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_SIZE_MISMATCH);
+	}
+
+	if (file->has_sha256) {
+		if (file->is_hash_valid && (file->hashed_size == file->size)) {
+			ctx = file->hash_ctx;
+			cksum_sha256_final(&ctx, digest);
+		} else {
+			cksum_sha256(file->load_addr, file->size, digest);
+		}
+		if (memcmp(digest, file->sha256, SHA256_DIGEST_LEN) != 0) {
+			pr_error("%s: SHA-256 mismatch\n", file->name);
+			return TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_DIGEST_MISMATCH);
+		}
+	}
+
+	file->is_loaded = true;
+
+	return TEGRABL_NO_ERROR;
+}
+
+#define NET_BOOT_BOOTIMG_MAGIC			"ANDROID!"
+#define NET_BOOT_BOOTIMG_MAGIC_SIZE		8
+#define NET_BOOT_FDT_MAGIC				0xd00dfeedU
+
+static uint32_t net_boot_get_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/*
+ * Header check of what is at the load address, so that the full digest is only computed when the
+ * image from a previous boot may still be there. On a cold boot DRAM holds garbage and this fails.
+ */
+static bool net_boot_file_maybe_loaded(const struct net_boot_file *file)
+{
+	const uint8_t *p = file->load_addr;
+
+	switch (file->type) {
+	case NET_BOOT_FILE_KERNEL:
+		return (file->expected_size >= NET_BOOT_BOOTIMG_MAGIC_SIZE) &&
+			   (memcmp(p, NET_BOOT_BOOTIMG_MAGIC, NET_BOOT_BOOTIMG_MAGIC_SIZE) == 0);
+	case NET_BOOT_FILE_DTB:
+		/* the FDT header also gives the blob size, which has to match the manifest */
+		return (file->expected_size >= 8) && (net_boot_get_be32(p) == NET_BOOT_FDT_MAGIC) &&
+			   (net_boot_get_be32(p + 4) == file->expected_size);
+	default:
+		/* raw images have no header to go by, they are always fetched */
+		return false;
+	}
+}
+
+struct net_boot_loaded_check {
+	struct net_boot_file *file;
+	bool match;
+	workpool_task_t task;
+};
+
+static void net_boot_check_loaded(void *arg)
+{
+	struct net_boot_loaded_check *check = arg;
+	struct net_boot_file *file = check->file;
+	uint8_t digest[SHA256_DIGEST_LEN];
+
+	cksum_sha256(file->load_addr, file->expected_size, digest);
+	check->match = (memcmp(digest, file->sha256, SHA256_DIGEST_LEN) == 0);
+}
+
+/*
+ * An image that is already at its load address, e.g. from the previous net boot across a warm reset,
+ * does not have to be fetched again. This needs both the size and the digest from the manifest, and
+ * only images whose header is in place are hashed. Each of those is hashed as its own workpool task,
+ * so the images are checked on all cpus at once.
+ */
+static void net_boot_manifest_skip_loaded(struct net_boot_manifest *m)
+{
+	struct net_boot_loaded_check checks[NET_BOOT_MAX_FILES];
+	struct net_boot_file *file;
+	uint32_t num_checks = 0;
+	uint32_t i;
+
+	for (i = 0; i < m->num_files; i++) {
+		file = &m->files[i];
+		if (!file->has_sha256 || (file->expected_size == 0) || !net_boot_file_maybe_loaded(file)) {
+			continue;
+		}
+		checks[num_checks].file = file;
+		checks[num_checks].match = false;
+		workpool_task_init(&checks[num_checks].task, net_boot_check_loaded, &checks[num_checks]);
+		workpool_submit(&checks[num_checks].task);
+		num_checks++;
+	}
+
+	for (i = 0; i < num_checks; i++) {
+		workpool_join(&checks[i].task, INFINITE_TIME);
+		if (checks[i].match) {
+			file = checks[i].file;
+			pr_info("%s already loaded, skipping download\n", file->name);
+			file->size = file->expected_size;
+			file->is_loaded = true;
+		}
+	}
+}
+
+static tegrabl_error_t download_files_from_tftp(struct net_boot_manifest *m)
+{
+	struct net_boot_file *pending[NET_BOOT_MAX_FILES];
+	struct tftp_client_priv *sessions[TFTP_MAX_SESSIONS];
+	err_t status[TFTP_MAX_SESSIONS];
+	uint32_t sizes[TFTP_MAX_SESSIONS];
+	struct net_boot_file *file;
+	uint32_t num_pending = 0;
+	uint32_t num_batch;
+	uint32_t num_retry;
+	uint32_t i;
 	err_t ret = 0;
-	uint32_t retry;
 	tegrabl_error_t err = TEGRABL_NO_ERROR;
 
-	ret = tftp_client_init(tftp_server_ip);
+	ret = tftp_client_init(m->server_ip);
 	if (ret != ERR_OK) {
 		pr_error("Failed to initialize TFTP client\n");
 		err = TEGRABL_ERROR(TEGRABL_ERR_INIT_FAILED, AUX_INFO_TFTP_CLIENT_INIT_FAILED);
 		goto fail;
 	}
 
-	retry = 0;
-	while (retry++ < TFTP_MAX_RRQ_RETRIES) {
-		ret = tftp_client_recv(KERNEL_DTB, "octet", dtb_load_addr, DTB_MAX_SIZE, NULL);
-		if (ret == ERR_OK) {
+	for (i = 0; i < m->num_files; i++) {
+		if (!m->files[i].is_loaded) {
+			pending[num_pending++] = &m->files[i];
+		}
+	}
+
+	/*
+	 * The files go to different buffers, so request up to TFTP_MAX_SESSIONS of them at once and overlap
+	 * their round trips. Files whose RRQ went unanswered are requested again with the next batch.
+	 */
+	while (num_pending > 0) {
+		num_batch = (num_pending < TFTP_MAX_SESSIONS) ? num_pending : TFTP_MAX_SESSIONS;
+
+		for (i = 0; i < num_batch; i++) {
+			file = pending[i];
+			if (file->num_rrq++ >= TFTP_MAX_RRQ_RETRIES) {
+				pr_error("Failed to send RRQ of %s within max retries\n", file->name);
+				err = TEGRABL_ERROR(TEGRABL_ERR_TIMEOUT, file->aux_info_rrq_timeout);
+				goto fail;
+			}
+			net_boot_hash_start(file);
+			ret = tftp_client_recv_start(file->name, "octet", file->load_addr, file->max_size,
+										 net_boot_hash_data, file, &sessions[i]);
+			if (ret != ERR_OK) {
+				pr_error("Failed to get %s\n", file->name);
+				err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, file->aux_info_recv_err);
+				goto fail;
+			}
+		}
+
+		(void)tftp_client_recv_wait(sessions, num_batch, status, sizes);
+
+		num_retry = 0;
+		for (i = 0; i < num_batch; i++) {
+			file = pending[i];
+			if (status[i] == ERR_OK) {
+				file->size = sizes[i];
+				err = net_boot_file_verify(file);
+				if (err != TEGRABL_NO_ERROR) {
+					goto fail;
+				}
+			} else if (status[i] == ERR_CONN) {
+				pending[num_retry++] = file;
+			} else {
+				pr_error("Failed to get %s\n", file->name);
+				err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, file->aux_info_recv_err);
+				goto fail;
+			}
+		}
+		memmove(&pending[num_retry], &pending[num_batch], (num_pending - num_batch) * sizeof(pending[0]));
+		num_pending = num_pending - num_batch + num_retry;
+	}
+#if NET_BOOT_RX_BENCHMARK
+	net_boot_rx_benchmark_report("TFTP");
+#endif
+
+fail:
+	tftp_client_deinit();
+
+	return err;
+}
+
+#if defined(CONFIG_ENABLE_HTTP_BOOT)
+static tegrabl_error_t download_file_from_http(char * const name, void *dst, uint32_t dst_size,
+											   http_client_data_fn data_fn, void *data_arg,
+											   uint32_t *file_size)
+{
+	char path[HTTP_MAX_PATH_LEN];
+	uint32_t rcvd_size = 0;
+	uint32_t retry = 0;
+	err_t ret = ERR_OK;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	snprintf(path, sizeof(path), "/%s", name);
+
+	/* Interrupted transfers are resumed with a Range request from where they stopped */
+	while (retry++ < HTTP_MAX_GET_RETRIES) {
+		ret = http_client_get(path, dst, dst_size, rcvd_size, data_fn, data_arg, &rcvd_size);
+		if ((ret == ERR_OK) || (ret == ERR_BUF) || (ret == ERR_ARG) || (ret == ERR_VAL)) {
 			break;
-		} else if (ret == ERR_CONN) {
-			etharp_tmr();
-			tegrabl_mdelay(10);
+		}
+		if (rcvd_size == 0) {
+			/* Nothing received, no point in retrying against a server that isn't there */
+			break;
+		}
+		pr_warn("HTTP: %s interrupted at %u bytes, resuming\n", name, rcvd_size);
+	}
+
+	if (ret != ERR_OK) {
+		pr_error("Failed to get %s over HTTP, err: %d\n", name, ret);
+		err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_HTTP_GET_ERR);
+		goto fail;
+	}
+
+	if (file_size != NULL) {
+		*file_size = rcvd_size;
+	}
+
+fail:
+	return err;
+}
+
+static tegrabl_error_t download_files_from_http(struct net_boot_manifest *m)
+{
+	struct net_boot_file *file;
+	uint32_t i;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	if (http_client_init(m->server_ip, HTTP_SERVER_PORT) != ERR_OK) {
+		pr_error("Failed to initialize HTTP client\n");
+		err = TEGRABL_ERROR(TEGRABL_ERR_INIT_FAILED, AUX_INFO_HTTP_CLIENT_INIT_FAILED);
+		goto fail;
+	}
+
+	for (i = 0; i < m->num_files; i++) {
+		file = &m->files[i];
+		if (file->is_loaded) {
 			continue;
-		} else if (ret != ERR_OK) {
-			pr_error("Failed to get %s\n", KERNEL_DTB);
-			err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_DTB_RECV_ERR);
+		}
+
+		net_boot_hash_start(file);
+		err = download_file_from_http(file->name, file->load_addr, file->max_size, net_boot_hash_data, file,
+									  &file->size);
+		if (err != TEGRABL_NO_ERROR) {
+			goto fail;
+		}
+#if NET_BOOT_RX_BENCHMARK
+		net_boot_rx_benchmark_report(file->name);
+#endif
+
+		err = net_boot_file_verify(file);
+		if (err != TEGRABL_NO_ERROR) {
 			goto fail;
 		}
 	}
-	if (retry >= TFTP_MAX_RRQ_RETRIES) {
-		pr_error("Failed to send RRQ of %s within max retries\n", KERNEL_DTB);
-		err = TEGRABL_ERROR(TEGRABL_ERR_TIMEOUT, AUX_INFO_DTB_RD_REQ_TIMEOUT);
+
+fail:
+	http_client_deinit();
+
+	return err;
+}
+#endif /* CONFIG_ENABLE_HTTP_BOOT */
+
+static tegrabl_error_t download_manifest_from_tftp(uint8_t *server_ip, char *name, uint32_t *size)
+{
+	uint32_t retry = 0;
+	err_t ret = ERR_OK;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	ret = tftp_client_init(server_ip);
+	if (ret != ERR_OK) {
+		pr_error("Failed to initialize TFTP client\n");
+		err = TEGRABL_ERROR(TEGRABL_ERR_INIT_FAILED, AUX_INFO_TFTP_CLIENT_INIT_FAILED);
 		goto fail;
 	}
 
-	retry = 0;
-	while (retry++ < TFTP_MAX_RRQ_RETRIES) {
-		ret = tftp_client_recv(KERNEL_IMAGE, "octet", boot_img_load_addr, BOOT_IMAGE_MAX_SIZE, boot_img_size);
-		if (ret == ERR_OK) {
-			break;
-		} else if (ret == ERR_CONN) {
-			tegrabl_mdelay(10);
-			continue;
-		} else if (ret != ERR_OK) {
-			pr_error("Failed to get %s\n", KERNEL_IMAGE);
-			err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_BOOT_IMAGE_RECV_ERR);
+	do {
+		ret = tftp_client_recv(name, "octet", manifest_buf, NET_BOOT_MANIFEST_MAX_SIZE, size);
+	} while ((ret == ERR_CONN) && (++retry < TFTP_MAX_RRQ_RETRIES));
+
+	if (ret != ERR_OK) {
+		pr_error("Failed to get manifest %s\n", name);
+		err = TEGRABL_ERROR(TEGRABL_ERR_INVALID, AUX_INFO_MANIFEST_RECV_ERR);
+	}
+
+fail:
+	tftp_client_deinit();
+
+	return err;
+}
+
+/*
+ * Build the list of files to fetch. The server is taken from DHCP option 66 if that holds an IP address
+ * and from the CBO otherwise. DHCP option 67 (or the BOOTP file field) names a manifest on that server;
+ * without one the built-in default manifest is used.
+ */
+static tegrabl_error_t net_boot_manifest_load(struct net_boot_manifest *m,
+											  struct ip_info *info,
+											  void *boot_img_load_addr,
+											  void *dtb_load_addr)
+{
+	struct dhcp *dhcp = NULL;
+	ip4_addr_t server_addr;
+	uint32_t size = 0;
+	tegrabl_error_t err = TEGRABL_NO_ERROR;
+
+	memcpy(m->server_ip, info->tftp_server_ip, sizeof(m->server_ip));
+
+	if (info->is_dhcp_enabled) {
+		dhcp = netif_dhcp_data(&netif);
+	}
+
+	if ((dhcp != NULL) && (dhcp->tftp_server_name[0] != '\0')) {
+		if (ip4addr_aton(dhcp->tftp_server_name, &server_addr)) {
+			memcpy(m->server_ip, &server_addr.addr, sizeof(m->server_ip));
+		} else {
+			pr_warn("DHCP: ignoring TFTP server name %s, only IP addresses are supported\n",
+					dhcp->tftp_server_name);
+		}
+	}
+	pr_info("Boot server: %d.%d.%d.%d\n", m->server_ip[0], m->server_ip[1], m->server_ip[2], m->server_ip[3]);
+
+	if ((dhcp != NULL) && (dhcp->boot_file_name[0] != '\0')) {
+		pr_info("Manifest: %s\n", dhcp->boot_file_name);
+#if defined(CONFIG_ENABLE_HTTP_BOOT)
+		err = TEGRABL_ERROR(TEGRABL_ERR_INIT_FAILED, AUX_INFO_HTTP_CLIENT_INIT_FAILED);
+		if (http_client_init(m->server_ip, HTTP_SERVER_PORT) == ERR_OK) {
+			err = download_file_from_http(dhcp->boot_file_name, manifest_buf, NET_BOOT_MANIFEST_MAX_SIZE,
+										  NULL, NULL, &size);
+		}
+		http_client_deinit();
+		if (err != TEGRABL_NO_ERROR) {
+			err = download_manifest_from_tftp(m->server_ip, dhcp->boot_file_name, &size);
+		}
+#else
+		err = download_manifest_from_tftp(m->server_ip, dhcp->boot_file_name, &size);
+#endif
+		if (err != TEGRABL_NO_ERROR) {
 			goto fail;
 		}
+	} else {
+		size = sizeof(default_manifest) - 1;
+		memcpy(manifest_buf, default_manifest, size);
 	}
-	if (retry >= TFTP_MAX_RRQ_RETRIES) {
-		pr_error("Failed to send RRQ of %s within max retries\n", KERNEL_IMAGE);
-		err = TEGRABL_ERROR(TEGRABL_ERR_TIMEOUT, AUX_INFO_BOOT_IMAGE_RD_REQ_TIMEOUT);
+	manifest_buf[size] = '\0';
+
+	err = net_boot_manifest_parse(m, manifest_buf);
+	if (err != TEGRABL_NO_ERROR) {
 		goto fail;
 	}
 
+	err = net_boot_manifest_validate(m, boot_img_load_addr, dtb_load_addr);
+
 fail:
+	return err;
+}
+
+static struct net_boot_file *net_boot_manifest_find(struct net_boot_manifest *m, enum net_boot_file_type type)
+{
+	uint32_t i;
+
+	for (i = 0; i < m->num_files; i++) {
+		if (m->files[i].type == type) {
+			return &m->files[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void net_boot_stack_deinit(void)
+{
+	net_rx_thread_stop();
 	tegrabl_eqos_deinit();
 	netif_set_down(&netif);
 	netif_remove(&netif);
+	event_destroy(&netif_status_event);
+}
 
-	return err;
+bool net_boot_get_sha256_state(const void *data, size_t len, struct sha256_ctx *ctx, size_t *hashed_len)
+{
+	struct net_boot_file *file = kernel_hash_file;
+	uint32_t idx;
+
+	if ((file == NULL) || (ctx == NULL) || (hashed_len == NULL)) {
+		return false;
+	}
+	if ((data != file->load_addr) || !file->is_loaded || !file->is_hash_valid ||
+		(file->hashed_size != file->size)) {
+		return false;
+	}
+
+	if (len == file->size) {
+		*ctx = file->hash_ctx;
+		*hashed_len = len;
+	} else {
+		idx = (uint32_t)(((len < file->size) ? len : file->size) / NET_BOOT_HASH_CHECKPOINT_SIZE);
+		if (idx > num_kernel_hash_checkpoints) {
+			idx = num_kernel_hash_checkpoints;
+		}
+		if (idx == 0) {
+			return false;
+		}
+		*ctx = kernel_hash_checkpoints[idx - 1];
+		*hashed_len = (size_t)idx * NET_BOOT_HASH_CHECKPOINT_SIZE;
+	}
+
+	/* The state describes the image as it was received, hand it out only once */
+	kernel_hash_file = NULL;
+
+	return true;
 }
 
 tegrabl_error_t net_boot_load_kernel_images(void ** const boot_img_load_addr,
@@ -360,6 +1313,8 @@ tegrabl_error_t net_boot_load_kernel_images(void ** const boot_img_load_addr,
 											uint32_t * const boot_img_size)
 {
 	struct ip_info info = {0};
+	struct net_boot_file *kernel;
+	struct net_boot_file *dtb;
 	tegrabl_error_t err = TEGRABL_NO_ERROR;
 
 	if ((boot_img_load_addr == NULL) || (dtb_load_addr == NULL)) {
@@ -374,11 +1329,35 @@ tegrabl_error_t net_boot_load_kernel_images(void ** const boot_img_load_addr,
 		goto fail;
 	}
 
-	err = download_kernel_from_tftp(info.tftp_server_ip, *boot_img_load_addr, *dtb_load_addr, boot_img_size);
+	err = net_boot_manifest_load(&manifest, &info, *boot_img_load_addr, *dtb_load_addr);
+	if (err != TEGRABL_NO_ERROR) {
+		net_boot_stack_deinit();
+		goto fail;
+	}
+	net_boot_manifest_skip_loaded(&manifest);
+
+#if defined(CONFIG_ENABLE_HTTP_BOOT)
+	err = download_files_from_http(&manifest);
+	if (err != TEGRABL_NO_ERROR) {
+		pr_warn("HTTP boot failed, falling back to TFTP\n");
+		err = download_files_from_tftp(&manifest);
+	}
+#else
+	err = download_files_from_tftp(&manifest);
+#endif
+	net_boot_stack_deinit();
 	if (err != TEGRABL_NO_ERROR) {
 		goto fail;
 	}
 
+	kernel = net_boot_manifest_find(&manifest, NET_BOOT_FILE_KERNEL);
+	dtb = net_boot_manifest_find(&manifest, NET_BOOT_FILE_DTB);
+	*boot_img_load_addr = kernel->load_addr;
+	*dtb_load_addr = dtb->load_addr;
+	if (boot_img_size != NULL) {
+		*boot_img_size = kernel->size;
+	}
+
 	err = tegrabl_dt_set_fdt_handle(TEGRABL_DT_KERNEL, *dtb_load_addr);
 	if (err != TEGRABL_NO_ERROR) {
 		pr_error("Kernel-dtb init failed\n");
@@ -11,6 +11,10 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 MODULE := $(LOCAL_DIR)
 
+MODULE_DEPS += \
+	lib/cksum \
+	lib/workpool
+
 GLOBAL_INCLUDES += \
 	$(LOCAL_DIR)/
 
@@ -16,6 +16,15 @@ GLOBAL_INCLUDES += \
 	$(LOCAL_DIR)/include \
 	$(LOCAL_DIR)/../$(TARGET)/include
 
+# the kernel programs the timer one-shot for the next deadline instead of
+# taking a 10ms tick, set TEGRA_TICKLESS := 0 to get the periodic tick back
+TEGRA_TICKLESS ?= 1
+ifeq ($(TEGRA_TICKLESS),1)
+GLOBAL_DEFINES += \
+	PLATFORM_HAS_DYNAMIC_TIMER=1 \
+	PLATFORM_HAS_HIRES_TIMER=1
+endif
+
 MODULE_SRCS += \
 	$(LOCAL_DIR)/cpu_early_init.c \
 	$(LOCAL_DIR)/interrupts.c \
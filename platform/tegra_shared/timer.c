@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <err.h>
 #include <reg.h>
+#include <platform.h>
 #include <platform/timer.h>
 #include <platform/interrupts.h>
 #include <kernel/thread.h>
@@ -56,28 +57,22 @@ struct tegra_timer tmrs[2];
 
 static platform_timer_callback timer_callback;
 static void *timer_arg;
-static lk_time_t timer_interval;
 
-static volatile uint32_t ticks;
+#define TMRCR_EN		(1U << 31)
+#define TMRCR_PER		(1U << 30)
+#define TMRCR_PTV_MAX	0x1fffffff
 
-static handler_return_t timer_irq(void *arg)
-{
-	/*  Clears the interrupt */
-	writel((1 << 30), tmrs[0].reg_base + PCR);
-	ticks += timer_interval;
-	return timer_callback(timer_arg, ticks);
-}
+static handler_return_t timer_irq(void *arg);
 
-status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, lk_time_t interval)
+static void tegra_timer_setup(void)
 {
+	static bool setup_done;
+
+	if (setup_done)
+		return;
 
 	tmrs[0].reg_base = TMR_BT;
 	tmrs[0].intr = INT_NUM;
-	enter_critical_section();
-
-	timer_callback = callback;
-	timer_arg = arg;
-	timer_interval = interval;
 
 	/* 1. TKECR => BTKE+16 | Do not disable TSC, us and OSC counters */
 	writel(0, tmrs[0].reg_base + TKECR);
@@ -91,22 +86,140 @@ status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg
 	   10b is any change in bit 0 of the local TSC counter */
 	writel(0 , tmrs[0].reg_base + TMRCSSR);
 
-	/* 4. TMRCR{t} => BT+P*{t}+0 */
-	writel(((3 << 30)|(timer_interval*1000)) , tmrs[0].reg_base + TMRCR);
-
 	register_int_handler(tmrs[0].intr, timer_irq, 0);
 	unmask_interrupt(tmrs[0].intr);
 
+	setup_done = true;
+}
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/*
+ * Tickless: the timer only runs one-shot for the next kernel deadline and
+ * time comes from the 1us TSC counter, extended to 64 bits here. While no
+ * deadline is pending the timer is kept armed for its longest interval, so
+ * the 32 bit counter can't wrap twice between two reads.
+ */
+static volatile lk_bigtime_t time_us;
+static bool timer_keepalive;
+
+static handler_return_t timer_irq(void *arg)
+{
+	/*  Clears the interrupt */
+	writel((1 << 30), tmrs[0].reg_base + PCR);
+
+	if (timer_keepalive) {
+		current_time_hires();
+		platform_stop_timer();
+		return INT_NO_RESCHEDULE;
+	}
+
+	return timer_callback(timer_arg, current_time());
+}
+
+static void tegra_timer_arm(lk_bigtime_t interval)
+{
+	if (interval == 0)
+		interval = 1;
+	/* fires early for longer intervals, the kernel just programs the rest */
+	if (interval > TMRCR_PTV_MAX)
+		interval = TMRCR_PTV_MAX;
+
+	writel(0, tmrs[0].reg_base + TMRCR);
+	writel(TMRCR_EN | (uint32_t)interval, tmrs[0].reg_base + TMRCR);
+}
+
+status_t platform_set_oneshot_timer_hires(platform_timer_callback callback, void *arg, lk_bigtime_t interval)
+{
+	enter_critical_section();
+
+	tegra_timer_setup();
+	timer_callback = callback;
+	timer_arg = arg;
+	timer_keepalive = false;
+	tegra_timer_arm(interval);
+
+	exit_critical_section();
+
+	return 0;
+}
+
+status_t platform_set_oneshot_timer(platform_timer_callback callback, void *arg, lk_time_t interval)
+{
+	return platform_set_oneshot_timer_hires(callback, arg, interval * 1000ULL);
+}
+
+void platform_stop_timer(void)
+{
+	enter_critical_section();
+
+	tegra_timer_setup();
+	timer_keepalive = true;
+	tegra_timer_arm(TMRCR_PTV_MAX);
+
+	exit_critical_section();
+}
+
+/* returns time in milli seconds */
+lk_time_t current_time(void)
+{
+	return current_time_hires() / 1000;
+}
+
+/*
+ * Return current time in micro seconds. Callers on other cpus may race on
+ * time_us, which only ever costs the last few us, never a wrap.
+ */
+lk_bigtime_t current_time_hires(void)
+{
+	lk_bigtime_t last = time_us;
+	lk_bigtime_t now = (last & ~0xffffffffULL) | readl(TEGRA_TIMERUS_BASE + TIMERUS_CNTR_1US);
+
+	if (now < last)
+		now += 0x100000000ULL;
+	time_us = now;
+
+	return now;
+}
+#else
+static lk_time_t timer_interval;
+
+static volatile uint32_t ticks;
+
+static handler_return_t timer_irq(void *arg)
+{
+	/*  Clears the interrupt */
+	writel((1 << 30), tmrs[0].reg_base + PCR);
+	ticks += timer_interval;
+	return timer_callback(timer_arg, ticks);
+}
+#endif
+
+status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, lk_time_t interval)
+{
+	enter_critical_section();
+
+	tegra_timer_setup();
+	timer_callback = callback;
+	timer_arg = arg;
+#if !PLATFORM_HAS_DYNAMIC_TIMER
+	timer_interval = interval;
+#endif
+
+	/* 4. TMRCR{t} => BT+P*{t}+0 */
+	writel((TMRCR_EN | TMRCR_PER | (interval * 1000)), tmrs[0].reg_base + TMRCR);
+
 	exit_critical_section();
 
 	return 0;
 }
 
+#if !PLATFORM_HAS_DYNAMIC_TIMER
 /* returns time in milli seconds */
 lk_time_t current_time(void)
 {
 	return ticks;
 }
+#endif
 
 lk_bigtime_t get_time_stamp_us(void)
 {
@@ -147,8 +260,10 @@ void mdelay(uint32_t msecs)
 	udelay(msecs*1000);
 }
 
+#if !PLATFORM_HAS_DYNAMIC_TIMER
 /* Return current time in micro seconds */
 lk_bigtime_t current_time_hires(void)
 {
 	return ticks * 1000ULL;
 }
+#endif
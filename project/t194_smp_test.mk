@@ -0,0 +1,17 @@
+# top level project rules for the t194 smp test project
+#
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+TARGET := t194
+TARGET_FAMILY := t19x
+
+IS_A64_MODE := 1
+
+# bring up every CCPLEX core, run smp_tests / workpool_tests from the shell
+WITH_SMP := 1
+
+MODULES += \
+	app/kernel_boot \
+	app/shell \
+	app/tests \
+	lib/workpool
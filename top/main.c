@@ -69,9 +69,13 @@ void lk_main(void) __NO_RETURN __EXTERNALLY_VISIBLE;
 void lk_main(void)
 {
 	/*char *version_string = (char *)&__version_start;*/
+#if !WITH_SMP
 	inc_critical_section();
+#endif
 
 	// get us into some sort of thread context
+	// (with SMP the critical section count lives in the thread, so this is
+	// also where the boot critical section is entered)
 	thread_init_early();
 
 	// early arch stuff